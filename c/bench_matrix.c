@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <argp.h>
+#include "src/matrix.h"
+
+// Argp argument parser configuration
+const char* argp_program_version = "v.0.0.1";
+const char* argp_program_bug_address = "<ddebnath@purdue.edu>";
+static char doc[] = "Benchmark the matrix.h kernels over a sweep of shapes and "
+                    "write ns/op, GB/s and GFLOP/s as JSON.";
+
+static struct argp_option options[] = {
+    {"min_time", 't', "SECONDS", OPTION_ARG_OPTIONAL, "Minimum duration of each timed trial"},
+    {"repeats", 'r', "REPEATS", OPTION_ARG_OPTIONAL, "Number of timed trials per benchmark"},
+    {"ops", 'f', "FILTER", OPTION_ARG_OPTIONAL, "Only run operations whose name contains FILTER"},
+    {"shapes", 's', "FILTER", OPTION_ARG_OPTIONAL, "Only run shapes whose family (square, tall, batch) contains FILTER"},
+    {"output", 'o', "PATH", OPTION_ARG_OPTIONAL, "JSON file to write (default standard output)"},
+    {0}};
+
+// Struct to hold all arguments
+struct arguments
+{
+    double min_time;
+    unsigned int repeats;
+    const char* op_filter;
+    const char* shape_filter;
+    const char* output_path;
+};
+
+// Initialize arguments to defaults
+void init_arguments(struct arguments* arg_vals)
+{
+    arg_vals->min_time = 0.1;
+    arg_vals->repeats = 3;
+    arg_vals->op_filter = NULL;
+    arg_vals->shape_filter = NULL;
+    arg_vals->output_path = NULL;
+}
+
+// Function to parse arguments option by option
+static error_t parse_opt(int key, char* arg, struct argp_state* state)
+{
+    struct arguments *arguments = (struct arguments*)(state->input);
+
+    switch (key)
+    {
+        case 't':
+            arguments->min_time = atof(arg);
+            break;
+        case 'r':
+            arguments->repeats = atoi(arg);
+            break;
+        case 'f':
+            arguments->op_filter = arg;
+            break;
+        case 's':
+            arguments->shape_filter = arg;
+            break;
+        case 'o':
+            arguments->output_path = arg;
+            break;
+        case ARGP_KEY_END:
+            if (arguments->min_time<=0.0 || arguments->repeats==0)
+                argp_error(state, "Minimum time and repeats must be positive.");
+            break;
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+// Argument parser
+static struct argp argparser = {options, parse_opt, 0, doc};
+
+/************************************************************/
+/***********************Benchmark cases**********************/
+/************************************************************/
+
+// A shape of the sweep. Elementwise operations work on an m x k
+// data matrix (like X, with m samples of k features) and products
+// multiply it by a k x n matrix, so n = 1 is a matrix-vector
+// product like X theta.
+typedef struct
+{
+    const char* family;
+    size_t m, k, n;
+} Shape;
+
+static const Shape shapes[] = {
+    {"square", 64, 64, 64},
+    {"square", 256, 256, 256},
+    {"square", 1024, 1024, 1024},
+    {"tall", 100000, 20, 1},
+    {"tall", 100000, 100, 1},
+    {"tall", 1000000, 10, 1},
+    {"batch", 32, 20, 1},
+    {"batch", 256, 100, 1},
+    {"batch", 1024, 1000, 1},
+};
+
+// Operands of all benchmarks for one shape
+typedef struct
+{
+    size_t m, k, n;
+    Matrix x, dest;         // m x k
+    Matrix signs;           // m x k, +-1 so repeated products stay bounded
+    Matrix w, prod;         // k x n, m x n
+    Matrix row, col;        // 1 x k, m x 1
+    IntMatrix ix, idest;    // m x k
+    IntMatrix iw, iprod;    // k x n, m x n
+    IntMatrix irow;         // 1 x k
+    IntMatrix idx;          // m row indices
+} Operands;
+
+static Operands operands_create(const Shape* shape)
+{
+    Operands ops;
+    size_t m = shape->m, k = shape->k, n = shape->n;
+
+    ops.m = m;
+    ops.k = k;
+    ops.n = n;
+    ops.x = mat_create(m, k);
+    ops.dest = mat_create(m, k);
+    ops.signs = mat_create(m, k);
+    ops.w = mat_create(k, n);
+    ops.prod = mat_create(m, n);
+    ops.row = mat_create(1, k);
+    ops.col = mat_create(m, 1);
+    ops.ix = intmat_create(m, k);
+    ops.idest = intmat_create(m, k);
+    ops.iw = intmat_create(k, n);
+    ops.iprod = intmat_create(m, n);
+    ops.irow = intmat_create(1, k);
+    ops.idx = intmat_create(m, 1);
+
+    mat_fill_random(&ops.x, 1);
+    mat_fill_random(&ops.dest, 2);
+    mat_fill_random(&ops.w, 3);
+    mat_fill_random(&ops.row, 4);
+    mat_fill_random(&ops.col, 5);
+    for (size_t i=0; i<m*k; i++)
+        ops.signs.data[i] = ops.x.data[i]<0.5? -1.0: 1.0;
+    intmat_fill_random(&ops.ix, 0, 10, true, 6);
+    intmat_fill_random(&ops.idest, 0, 10, true, 7);
+    intmat_fill_random(&ops.iw, 0, 10, true, 8);
+    intmat_fill_random(&ops.irow, 0, 10, true, 9);
+    intmat_fill_random(&ops.idx, 0, (int)m, true, 10);
+    return ops;
+}
+
+static void operands_destroy(Operands* ops)
+{
+    mat_destroy(&ops->x);
+    mat_destroy(&ops->dest);
+    mat_destroy(&ops->signs);
+    mat_destroy(&ops->w);
+    mat_destroy(&ops->prod);
+    mat_destroy(&ops->row);
+    mat_destroy(&ops->col);
+    intmat_destroy(&ops->ix);
+    intmat_destroy(&ops->idest);
+    intmat_destroy(&ops->iw);
+    intmat_destroy(&ops->iprod);
+    intmat_destroy(&ops->irow);
+    intmat_destroy(&ops->idx);
+}
+
+static void run_mat_create(Operands* ops)
+{
+    Matrix mat = mat_create(ops->m, ops->k);
+    mat_destroy(&mat);
+}
+static void run_mat_copy_inplace(Operands* ops) { mat_copy_inplace(&ops->x, &ops->dest); }
+static void run_mat_fill(Operands* ops) { mat_fill(&ops->dest, 0.5); }
+static void run_mat_fill_random(Operands* ops) { mat_fill_random(&ops->dest, 11); }
+static void run_mat_scale(Operands* ops) { mat_scale(&ops->dest, -1.0); }
+static void run_mat_add_scalar(Operands* ops) { mat_add_scalar(&ops->dest, 0.5); }
+static void run_mat_axpby(Operands* ops) { mat_axpby(&ops->dest, 1.0, &ops->x, 0.5); }
+static void run_mat_add(Operands* ops) { mat_add(&ops->dest, &ops->x); }
+static void run_mat_sub(Operands* ops) { mat_sub(&ops->dest, &ops->x); }
+static void run_mat_elem_mul(Operands* ops) { mat_elem_mul(&ops->dest, &ops->signs); }
+static void run_mat_abs_sum(Operands* ops) { mat_abs_sum(&ops->x); }
+static void run_mat_norm(Operands* ops) { mat_norm(&ops->x); }
+static void run_mat_vec_add_row(Operands* ops) { mat_vec_add(&ops->dest, &ops->row); }
+static void run_mat_vec_sub_row(Operands* ops) { mat_vec_sub(&ops->dest, &ops->row); }
+static void run_mat_vec_sub_col(Operands* ops) { mat_vec_sub(&ops->dest, &ops->col); }
+static void run_mat_repeat(Operands* ops)
+{
+    Matrix mat = mat_repeat(&ops->row, 0, ops->m);
+    mat_destroy(&mat);
+}
+static void run_mat_gather(Operands* ops) { mat_gather(&ops->x, &ops->dest, &ops->idx, 0); }
+static void run_mat_mul(Operands* ops) { mat_mul_inplace(&ops->x, false, &ops->w, false, &ops->prod); }
+static void run_mat_mul_trans(Operands* ops) { mat_mul_inplace(&ops->x, true, &ops->prod, false, &ops->w); }
+static void run_intmat_fill(Operands* ops) { intmat_fill(&ops->idest, 5); }
+static void run_intmat_fill_random(Operands* ops) { intmat_fill_random(&ops->idest, 0, 10, true, 12); }
+static void run_intmat_add(Operands* ops) { intmat_add(&ops->idest, &ops->ix); }
+static void run_intmat_sub(Operands* ops) { intmat_sub(&ops->idest, &ops->ix); }
+static void run_intmat_vec_sub(Operands* ops) { intmat_vec_sub(&ops->idest, &ops->irow); }
+static void run_intmat_repeat(Operands* ops)
+{
+    IntMatrix mat = intmat_repeat(&ops->irow, 0, ops->m);
+    intmat_destroy(&mat);
+}
+static void run_intmat_gather(Operands* ops) { intmat_gather(&ops->ix, &ops->idest, &ops->idx, 0); }
+static void run_igemm(Operands* ops)
+{
+    igemm(CblasNoTrans, CblasNoTrans, ops->m, ops->n, ops->k,
+          1, ops->ix.data, ops->k, ops->iw.data, ops->n,
+          0, ops->iprod.data, ops->n);
+}
+
+// A benchmarked operation. Bytes and flops are per call, from the
+// m x k data matrix (e elements) and the k x n right-hand side.
+typedef struct
+{
+    const char* name;
+    void (*run)(Operands* ops);
+    IGemmKernel kernel;                 // igemm micro-kernel, if used
+    double bytes_per_elem;              // Memory traffic per element of data
+    double flops_per_elem;
+    bool product;                       // Traffic and flops of a product instead
+    size_t elem_size;
+} BenchOp;
+
+static const BenchOp bench_ops[] = {
+    {"mat_create", run_mat_create, IGEMM_AUTO, 8, 0, false, sizeof(double)},
+    {"mat_copy_inplace", run_mat_copy_inplace, IGEMM_AUTO, 16, 0, false, sizeof(double)},
+    {"mat_fill", run_mat_fill, IGEMM_AUTO, 8, 0, false, sizeof(double)},
+    {"mat_fill_random", run_mat_fill_random, IGEMM_AUTO, 8, 0, false, sizeof(double)},
+    {"mat_scale", run_mat_scale, IGEMM_AUTO, 16, 1, false, sizeof(double)},
+    {"mat_add_scalar", run_mat_add_scalar, IGEMM_AUTO, 16, 1, false, sizeof(double)},
+    {"mat_axpby", run_mat_axpby, IGEMM_AUTO, 24, 3, false, sizeof(double)},
+    {"mat_add", run_mat_add, IGEMM_AUTO, 24, 1, false, sizeof(double)},
+    {"mat_sub", run_mat_sub, IGEMM_AUTO, 24, 1, false, sizeof(double)},
+    {"mat_elem_mul", run_mat_elem_mul, IGEMM_AUTO, 24, 1, false, sizeof(double)},
+    {"mat_abs_sum", run_mat_abs_sum, IGEMM_AUTO, 8, 1, false, sizeof(double)},
+    {"mat_norm", run_mat_norm, IGEMM_AUTO, 8, 2, false, sizeof(double)},
+    {"mat_vec_add_row", run_mat_vec_add_row, IGEMM_AUTO, 16, 1, false, sizeof(double)},
+    {"mat_vec_sub_row", run_mat_vec_sub_row, IGEMM_AUTO, 16, 1, false, sizeof(double)},
+    {"mat_vec_sub_col", run_mat_vec_sub_col, IGEMM_AUTO, 16, 1, false, sizeof(double)},
+    {"mat_repeat", run_mat_repeat, IGEMM_AUTO, 8, 0, false, sizeof(double)},
+    {"mat_gather", run_mat_gather, IGEMM_AUTO, 16, 0, false, sizeof(double)},
+    {"mat_mul", run_mat_mul, IGEMM_AUTO, 0, 0, true, sizeof(double)},
+    {"mat_mul_trans", run_mat_mul_trans, IGEMM_AUTO, 0, 0, true, sizeof(double)},
+    {"intmat_fill", run_intmat_fill, IGEMM_AUTO, 4, 0, false, sizeof(int)},
+    {"intmat_fill_random", run_intmat_fill_random, IGEMM_AUTO, 4, 0, false, sizeof(int)},
+    {"intmat_add", run_intmat_add, IGEMM_AUTO, 12, 1, false, sizeof(int)},
+    {"intmat_sub", run_intmat_sub, IGEMM_AUTO, 12, 1, false, sizeof(int)},
+    {"intmat_vec_sub", run_intmat_vec_sub, IGEMM_AUTO, 8, 1, false, sizeof(int)},
+    {"intmat_repeat", run_intmat_repeat, IGEMM_AUTO, 4, 0, false, sizeof(int)},
+    {"intmat_gather", run_intmat_gather, IGEMM_AUTO, 8, 0, false, sizeof(int)},
+    {"igemm_generic", run_igemm, IGEMM_GENERIC, 0, 0, true, sizeof(int)},
+    {"igemm_avx2", run_igemm, IGEMM_AVX2, 0, 0, true, sizeof(int)},
+    {"igemm_avx512", run_igemm, IGEMM_AVX512, 0, 0, true, sizeof(int)},
+};
+
+// Monotonic clock in seconds
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Time "iterations" calls of an operation, in seconds
+static double time_op(const BenchOp* op, Operands* ops, size_t iterations)
+{
+    double start = now_seconds();
+    for (size_t i=0; i<iterations; i++)
+        op->run(ops);
+    return now_seconds() - start;
+}
+
+static int compare_doubles(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x>y) - (x<y);
+}
+
+// Benchmark one operation on one shape and write its JSON object.
+// The iteration count is doubled until a trial lasts at least
+// min_time; the best and median of the trials are reported.
+static void bench_one(const BenchOp* op, const Shape* shape, Operands* ops,
+                      const struct arguments* arg_vals, FILE* out, bool first)
+{
+    size_t iterations = 1;
+    double elapsed, best, median, bytes, flops;
+    double* trials;
+
+    // Warm up caches, page faults and lazy initialization
+    op->run(ops);
+    while ((elapsed = time_op(op, ops, iterations))<arg_vals->min_time)
+    {
+        double grow = elapsed>0.0? 1.2*arg_vals->min_time/elapsed: 10.0;
+        iterations *= grow<2.0? 2: grow>10.0? 10: (size_t)grow;
+    }
+
+    trials = (double *)malloc(arg_vals->repeats*sizeof(double));
+    for (unsigned int r=0; r<arg_vals->repeats; r++)
+        trials[r] = time_op(op, ops, iterations) / (double)iterations;
+    qsort(trials, arg_vals->repeats, sizeof(double), compare_doubles);
+    best = trials[0];
+    median = trials[arg_vals->repeats/2];
+    free(trials);
+
+    if (op->product)
+    {
+        bytes = (double)op->elem_size * (double)(shape->m*shape->k
+                + shape->k*shape->n + shape->m*shape->n);
+        flops = 2.0 * (double)shape->m * (double)shape->k * (double)shape->n;
+    }
+    else
+    {
+        double elems = (double)shape->m * (double)shape->k;
+        bytes = op->bytes_per_elem * elems;
+        flops = op->flops_per_elem * elems;
+    }
+
+    fprintf(out, "%s\n    {\"op\": \"%s\", \"shape\": \"%s\", "
+            "\"m\": %zu, \"k\": %zu, \"n\": %zu, \"iterations\": %zu, "
+            "\"ns_per_op\": %.1f, \"ns_per_op_median\": %.1f, "
+            "\"gb_per_s\": %.3f, \"gflop_per_s\": %.3f}",
+            first? "": ",", op->name, shape->family,
+            shape->m, shape->k, shape->n, iterations,
+            best*1e9, median*1e9, bytes/best/1e9, flops/best/1e9);
+    fprintf(stderr, "%-20s %-6s %8zu x %-5zu x %-5zu %12.1f ns/op\n",
+            op->name, shape->family, shape->m, shape->k, shape->n, best*1e9);
+}
+
+int main(int argc, char** argv)
+{
+    struct arguments arg_vals;
+    size_t n_shapes = sizeof(shapes)/sizeof(shapes[0]);
+    size_t n_ops = sizeof(bench_ops)/sizeof(bench_ops[0]);
+    bool first = true;
+    FILE* out = stdout;
+
+    // Parse arguments
+    init_arguments(&arg_vals);
+    argp_parse(&argparser, argc, argv, 0, 0, &arg_vals);
+
+    if (arg_vals.output_path!=NULL)
+    {
+        out = fopen(arg_vals.output_path, "w");
+        if (out==NULL)
+        {
+            perror("ERROR: Could not open output file.");
+            return 1;
+        }
+    }
+
+    fprintf(out, "{\n  \"benchmark\": \"bench_matrix\",\n"
+            "  \"min_time\": %g,\n  \"repeats\": %u,\n  \"results\": [",
+            arg_vals.min_time, arg_vals.repeats);
+    for (size_t s=0; s<n_shapes; s++)
+    {
+        Operands ops;
+
+        if (arg_vals.shape_filter!=NULL
+                && strstr(shapes[s].family, arg_vals.shape_filter)==NULL)
+            continue;
+        ops = operands_create(&shapes[s]);
+        for (size_t o=0; o<n_ops; o++)
+        {
+            const BenchOp* op = &bench_ops[o];
+
+            if (arg_vals.op_filter!=NULL
+                    && strstr(op->name, arg_vals.op_filter)==NULL)
+                continue;
+            // Kernels the processor lacks would fall back silently
+            if (op->kernel!=IGEMM_AUTO && igemm_set_kernel(op->kernel)!=op->kernel)
+                continue;
+            bench_one(op, &shapes[s], &ops, &arg_vals, out, first);
+            first = false;
+            igemm_set_kernel(IGEMM_AUTO);
+        }
+        operands_destroy(&ops);
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out!=stdout)
+        fclose(out);
+    return 0;
+}
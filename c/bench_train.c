@@ -0,0 +1,561 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <argp.h>
+#include "src/matrix.h"
+#include "src/helpers.h"
+#include "src/losses.h"
+#include "src/sgd.h"
+#include "src/sampler.h"
+
+// Argp argument parser configuration
+const char* argp_program_version = "v.0.0.1";
+const char* argp_program_bug_address = "<ddebnath@purdue.edu>";
+static char doc[] = "Benchmark end-to-end training over a sweep of dataset sizes, "
+                    "batch sizes, thread counts and solvers, and write throughput, "
+                    "time to a target loss, peak memory and test MSE as CSV or JSON.";
+
+static struct argp_option options[] = {
+    {"n_samples", 'M', "LIST", OPTION_ARG_OPTIONAL, "Comma separated numbers of samples"},
+    {"n_features", 'N', "LIST", OPTION_ARG_OPTIONAL, "Comma separated numbers of features"},
+    {"batch_size", 'B', "LIST", OPTION_ARG_OPTIONAL, "Comma separated batch sizes"},
+    {"threads", 'j', "LIST", OPTION_ARG_OPTIONAL, "Comma separated thread counts for the parallel solvers"},
+    {"solvers", 'a', "LIST", OPTION_ARG_OPTIONAL, "Comma separated solvers (gd, sgd, mixed, hogwild, sync)"},
+    {"n_iter", 'i', "N_ITER", OPTION_ARG_OPTIONAL, "Number of iterations per trial"},
+    {"learning_rate", 'n', "LEARNING_RATE", OPTION_ARG_OPTIONAL, "Learning rate"},
+    {"target_loss", 'l', "LOSS", OPTION_ARG_OPTIONAL, "Training loss to time the solvers to (0 skips it)"},
+    {"warmup", 'w', "TRIALS", OPTION_ARG_OPTIONAL, "Untimed warm-up trials per configuration"},
+    {"trials", 'r', "TRIALS", OPTION_ARG_OPTIONAL, "Timed trials per configuration"},
+    {"seed", 'S', "SEED", OPTION_ARG_OPTIONAL, "Random number seed"},
+    {"json", 'J', 0, 0, "Write JSON instead of CSV"},
+    {"output", 'o', "PATH", OPTION_ARG_OPTIONAL, "File to write (default standard output)"},
+    {0}};
+
+#define MAX_SWEEP 16
+
+// Solvers of the sweep
+typedef enum
+{
+    SOLVER_GD,
+    SOLVER_SGD,
+    SOLVER_MIXED,
+    SOLVER_HOGWILD,
+    SOLVER_SYNC
+} Solver;
+
+static const char* solver_names[] = {"gd", "sgd", "mixed", "hogwild", "sync"};
+
+// Struct to hold all arguments
+struct arguments
+{
+    size_t n_samples[MAX_SWEEP], n_features[MAX_SWEEP];
+    size_t batch_sizes[MAX_SWEEP], n_threads[MAX_SWEEP];
+    Solver solvers[MAX_SWEEP];
+    size_t n_n_samples, n_n_features, n_batch_sizes, n_n_threads, n_solvers;
+    unsigned int n_iter;
+    double learning_rate;
+    double target_loss;
+    unsigned int warmup, trials;
+    unsigned int seed;
+    bool json;
+    const char* output_path;
+};
+
+// Initialize arguments to defaults
+void init_arguments(struct arguments* arg_vals)
+{
+    arg_vals->n_samples[0] = 100000;
+    arg_vals->n_n_samples = 1;
+    arg_vals->n_features[0] = 20;
+    arg_vals->n_n_features = 1;
+    arg_vals->batch_sizes[0] = 32;
+    arg_vals->n_batch_sizes = 1;
+    arg_vals->n_threads[0] = 1;
+    arg_vals->n_n_threads = 1;
+    arg_vals->solvers[0] = SOLVER_GD;
+    arg_vals->solvers[1] = SOLVER_SGD;
+    arg_vals->n_solvers = 2;
+    arg_vals->n_iter = 1000;
+    arg_vals->learning_rate = 0.001;
+    arg_vals->target_loss = 0.0;
+    arg_vals->warmup = 1;
+    arg_vals->trials = 5;
+    arg_vals->seed = 42;
+    arg_vals->json = false;
+    arg_vals->output_path = NULL;
+}
+
+// Parse a comma separated list of positive integers, returns the
+// number of values or 0 if the list is invalid
+static size_t parse_size_list(const char* arg, size_t* values)
+{
+    size_t count = 0;
+    char* end;
+
+    while (*arg!='\0')
+    {
+        if (count==MAX_SWEEP)
+            return 0;
+        values[count] = strtoull(arg, &end, 10);
+        if (end==arg || values[count]==0 || (*end!=',' && *end!='\0'))
+            return 0;
+        count++;
+        arg = *end==','? end+1: end;
+    }
+    return count;
+}
+
+// Parse a comma separated list of solver names
+static size_t parse_solver_list(const char* arg, Solver* solvers)
+{
+    size_t count = 0;
+    size_t n_names = sizeof(solver_names)/sizeof(solver_names[0]);
+
+    while (*arg!='\0')
+    {
+        size_t len = strcspn(arg, ",");
+        size_t s;
+
+        for (s=0; s<n_names; s++)
+            if (strlen(solver_names[s])==len && strncmp(arg, solver_names[s], len)==0)
+                break;
+        if (s==n_names || count==MAX_SWEEP)
+            return 0;
+        solvers[count++] = (Solver)s;
+        arg += arg[len]==','? len+1: len;
+    }
+    return count;
+}
+
+// Function to parse arguments option by option
+static error_t parse_opt(int key, char* arg, struct argp_state* state)
+{
+    struct arguments *arguments = (struct arguments*)(state->input);
+
+    switch (key)
+    {
+        case 'M':
+            if ((arguments->n_n_samples = parse_size_list(arg, arguments->n_samples))==0)
+                argp_error(state, "Invalid list of numbers of samples.");
+            break;
+        case 'N':
+            if ((arguments->n_n_features = parse_size_list(arg, arguments->n_features))==0)
+                argp_error(state, "Invalid list of numbers of features.");
+            break;
+        case 'B':
+            if ((arguments->n_batch_sizes = parse_size_list(arg, arguments->batch_sizes))==0)
+                argp_error(state, "Invalid list of batch sizes.");
+            break;
+        case 'j':
+            if ((arguments->n_n_threads = parse_size_list(arg, arguments->n_threads))==0)
+                argp_error(state, "Invalid list of thread counts.");
+            break;
+        case 'a':
+            if ((arguments->n_solvers = parse_solver_list(arg, arguments->solvers))==0)
+                argp_error(state, "Invalid list of solvers.");
+            break;
+        case 'i':
+            arguments->n_iter = atoi(arg);
+            break;
+        case 'n':
+            arguments->learning_rate = atof(arg);
+            break;
+        case 'l':
+            arguments->target_loss = atof(arg);
+            break;
+        case 'w':
+            arguments->warmup = atoi(arg);
+            break;
+        case 'r':
+            arguments->trials = atoi(arg);
+            break;
+        case 'S':
+            arguments->seed = atoi(arg);
+            break;
+        case 'J':
+            arguments->json = true;
+            break;
+        case 'o':
+            arguments->output_path = arg;
+            break;
+        case ARGP_KEY_END:
+            if (arguments->trials==0 || arguments->n_iter==0)
+                argp_error(state, "Trials and iterations must be positive.");
+            break;
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+// Argument parser
+static struct argp argparser = {options, parse_opt, 0, doc};
+
+/************************************************************/
+/*************************Statistics*************************/
+/************************************************************/
+
+// Mean of repeated measurements and the half-width of its 95%
+// confidence interval (Student's t)
+typedef struct
+{
+    double mean, ci95;
+} Estimate;
+
+static Estimate estimate(const double* values, size_t n)
+{
+    // Two-sided 97.5% quantiles of Student's t for 1 to 30 degrees
+    // of freedom, the normal quantile beyond
+    static const double t_quantiles[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    Estimate est = {0.0, 0.0};
+    double var = 0.0;
+
+    if (n==0)
+        return est;
+    for (size_t i=0; i<n; i++)
+        est.mean += values[i];
+    est.mean /= (double)n;
+    if (n==1)
+        return est;
+    for (size_t i=0; i<n; i++)
+        var += (values[i] - est.mean) * (values[i] - est.mean);
+    var /= (double)(n - 1);
+    est.ci95 = (n-1<=30? t_quantiles[n-2]: 1.96) * sqrt(var / (double)n);
+    return est;
+}
+
+/************************************************************/
+/**************************Trials****************************/
+/************************************************************/
+
+// One point of the sweep
+typedef struct
+{
+    Solver solver;
+    size_t n_samples, n_features;
+    size_t batch_size, n_threads;
+} Config;
+
+// Measurements of a configuration over its trials, sent from the
+// child process that ran it
+typedef struct
+{
+    bool ok;
+    Estimate seconds, samples_per_s, test_mse, time_to_target;
+    unsigned int n_reached;
+} Summary;
+
+// Monotonic clock in seconds
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Train once with the configured solver
+static SGDResult train(const Config* cfg, const struct arguments* arg_vals,
+                       Matrix* x, Matrix* y, FMatrix* x_f,
+                       double tol, unsigned int seed)
+{
+    LossFunctions l2 = l2_loss_functions();
+
+    switch (cfg->solver)
+    {
+        case SOLVER_GD:
+            return gradient_descent(x, y, arg_vals->learning_rate, &l2,
+                                    arg_vals->n_iter, tol, seed);
+        case SOLVER_MIXED:
+            return stochastic_gradient_descent_mixed(x_f, y, cfg->batch_size,
+                        SAMPLE_SHUFFLE, arg_vals->learning_rate, &l2,
+                        arg_vals->n_iter, tol, seed);
+        case SOLVER_HOGWILD:
+            return parallel_sgd_hogwild(x, y, cfg->batch_size, SAMPLE_SHUFFLE,
+                        arg_vals->learning_rate, &l2, arg_vals->n_iter, tol,
+                        seed, cfg->n_threads);
+        case SOLVER_SYNC:
+            return parallel_sgd_sync(x, y, cfg->batch_size, SAMPLE_SHUFFLE,
+                        arg_vals->learning_rate, arg_vals->n_iter, tol,
+                        seed, cfg->n_threads);
+        case SOLVER_SGD:
+        default:
+            return stochastic_gradient_descent(x, y, cfg->batch_size,
+                        SAMPLE_SHUFFLE, arg_vals->learning_rate, &l2,
+                        arg_vals->n_iter, tol, seed);
+    }
+}
+
+// Generate the dataset of a configuration and run its trials. Each
+// trial uses its own seed for the initial theta and the sampling
+// (the dataset is the same), so the spread of the test MSE covers
+// the randomness of the solver. Throughput assumes all n_iter
+// iterations run (tol 0); the time to the target loss is measured
+// by separate runs that stop once the training loss falls below it.
+static Summary run_config(const Config* cfg, const struct arguments* arg_vals)
+{
+    Summary summary;
+    size_t n_test = cfg->n_samples / 5;
+    Matrix x = mat_create(cfg->n_samples, cfg->n_features);
+    Matrix y = mat_create(cfg->n_samples, 1);
+    Matrix x_train = mat_create(cfg->n_samples - n_test, cfg->n_features);
+    Matrix y_train = mat_create(cfg->n_samples - n_test, 1);
+    Matrix x_test = mat_create(n_test, cfg->n_features);
+    Matrix y_test = mat_create(n_test, 1);
+    Matrix y_pred = mat_create(n_test, 1);
+    FMatrix x_train_f;
+    double* seconds = (double *)malloc(arg_vals->trials*sizeof(double));
+    double* samples_per_s = (double *)malloc(arg_vals->trials*sizeof(double));
+    double* test_mse = (double *)malloc(arg_vals->trials*sizeof(double));
+    double* time_to_target = (double *)malloc(arg_vals->trials*sizeof(double));
+    double samples_per_iter = cfg->solver==SOLVER_GD? (double)x_train.nrows
+                                                    : (double)cfg->batch_size;
+
+    memset(&summary, 0, sizeof(summary));
+    make_regression_dataset(&x, &y, -300.7, 2.0, arg_vals->seed);
+    split_into_train_test(&x, &y, &x_train, &y_train, &x_test, &y_test,
+                          arg_vals->seed);
+    mat_destroy(&x);
+    mat_destroy(&y);
+    x_train_f = cfg->solver==SOLVER_MIXED? fmat_from_mat(&x_train)
+                                         : fmat_create(1, 1);
+
+    for (unsigned int w=0; w<arg_vals->warmup; w++)
+    {
+        SGDResult result = train(cfg, arg_vals, &x_train, &y_train, &x_train_f,
+                                 0.0, arg_vals->seed + w);
+        destroy_sgdresult(&result);
+    }
+
+    for (unsigned int r=0; r<arg_vals->trials; r++)
+    {
+        unsigned int seed = arg_vals->seed + arg_vals->warmup + r;
+        double start = now_seconds();
+        SGDResult result = train(cfg, arg_vals, &x_train, &y_train, &x_train_f,
+                                 0.0, seed);
+
+        seconds[r] = now_seconds() - start;
+        samples_per_s[r] = samples_per_iter * arg_vals->n_iter / seconds[r];
+        mat_mul_inplace(&x_test, false, &(result.theta_sol), false, &y_pred);
+        mat_add_scalar(&y_pred, result.bias);
+        test_mse[r] = l2_loss(&y_test, &y_pred);
+        destroy_sgdresult(&result);
+
+        if (arg_vals->target_loss>0.0)
+        {
+            start = now_seconds();
+            result = train(cfg, arg_vals, &x_train, &y_train, &x_train_f,
+                           arg_vals->target_loss, seed);
+            if (result.converged)
+                time_to_target[summary.n_reached++] = now_seconds() - start;
+            destroy_sgdresult(&result);
+        }
+    }
+
+    summary.ok = true;
+    summary.seconds = estimate(seconds, arg_vals->trials);
+    summary.samples_per_s = estimate(samples_per_s, arg_vals->trials);
+    summary.test_mse = estimate(test_mse, arg_vals->trials);
+    summary.time_to_target = estimate(time_to_target, summary.n_reached);
+
+    free(seconds);
+    free(samples_per_s);
+    free(test_mse);
+    free(time_to_target);
+    fmat_destroy(&x_train_f);
+    mat_destroy(&x_train);
+    mat_destroy(&y_train);
+    mat_destroy(&x_test);
+    mat_destroy(&y_test);
+    mat_destroy(&y_pred);
+    return summary;
+}
+
+// Run a configuration in a child process, so that its peak resident
+// memory is its own and not the high water mark of the sweep so far.
+// The solvers' progress output is discarded. Returns false if the
+// child failed.
+static bool run_isolated(const Config* cfg, const struct arguments* arg_vals,
+                         Summary* summary, double* peak_rss_mb)
+{
+    int fds[2];
+    int status;
+    pid_t pid;
+    struct rusage usage;
+    ssize_t n_read;
+
+    if (pipe(fds)!=0)
+    {
+        perror("ERROR: Could not create a pipe.");
+        return false;
+    }
+    fflush(NULL);
+    pid = fork();
+    if (pid<0)
+    {
+        perror("ERROR: Could not fork.");
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid==0)
+    {
+        Summary result;
+
+        close(fds[0]);
+        if (freopen("/dev/null", "w", stdout)==NULL)
+            _exit(1);
+        result = run_config(cfg, arg_vals);
+        _exit(write(fds[1], &result, sizeof(result))==(ssize_t)sizeof(result)? 0: 1);
+    }
+
+    close(fds[1]);
+    n_read = read(fds[0], summary, sizeof(*summary));
+    close(fds[0]);
+    if (wait4(pid, &status, 0, &usage)<0 || !WIFEXITED(status)
+            || WEXITSTATUS(status)!=0 || n_read!=(ssize_t)sizeof(*summary))
+        return false;
+    *peak_rss_mb = (double)usage.ru_maxrss / 1024.0;   // ru_maxrss is in KiB
+    return summary->ok;
+}
+
+/************************************************************/
+/**************************Output****************************/
+/************************************************************/
+
+static void write_header(FILE* out, const struct arguments* arg_vals)
+{
+    if (arg_vals->json)
+        fprintf(out, "{\n  \"benchmark\": \"bench_train\",\n"
+                "  \"n_iter\": %u,\n  \"learning_rate\": %g,\n"
+                "  \"target_loss\": %g,\n  \"warmup\": %u,\n  \"trials\": %u,\n"
+                "  \"results\": [",
+                arg_vals->n_iter, arg_vals->learning_rate,
+                arg_vals->target_loss, arg_vals->warmup, arg_vals->trials);
+    else
+        fprintf(out, "solver,n_samples,n_features,batch_size,n_threads,"
+                "seconds,seconds_ci95,samples_per_s,samples_per_s_ci95,"
+                "test_mse,test_mse_ci95,reached_target,time_to_target,"
+                "time_to_target_ci95,peak_rss_mb\n");
+}
+
+static void write_row(FILE* out, const struct arguments* arg_vals,
+                      const Config* cfg, const Summary* s,
+                      double peak_rss_mb, bool first)
+{
+    if (arg_vals->json)
+    {
+        fprintf(out, "%s\n    {\"solver\": \"%s\", \"n_samples\": %zu, "
+                "\"n_features\": %zu, \"batch_size\": %zu, \"n_threads\": %zu, "
+                "\"seconds\": %.6f, \"seconds_ci95\": %.6f, "
+                "\"samples_per_s\": %.1f, \"samples_per_s_ci95\": %.1f, "
+                "\"test_mse\": %.6f, \"test_mse_ci95\": %.6f, "
+                "\"reached_target\": %u, ",
+                first? "": ",", solver_names[cfg->solver], cfg->n_samples,
+                cfg->n_features, cfg->batch_size, cfg->n_threads,
+                s->seconds.mean, s->seconds.ci95,
+                s->samples_per_s.mean, s->samples_per_s.ci95,
+                s->test_mse.mean, s->test_mse.ci95, s->n_reached);
+        if (s->n_reached>0)
+            fprintf(out, "\"time_to_target\": %.6f, \"time_to_target_ci95\": %.6f, ",
+                    s->time_to_target.mean, s->time_to_target.ci95);
+        else
+            fprintf(out, "\"time_to_target\": null, \"time_to_target_ci95\": null, ");
+        fprintf(out, "\"peak_rss_mb\": %.1f}", peak_rss_mb);
+    }
+    else
+    {
+        fprintf(out, "%s,%zu,%zu,%zu,%zu,%.6f,%.6f,%.1f,%.1f,%.6f,%.6f,%u,",
+                solver_names[cfg->solver], cfg->n_samples, cfg->n_features,
+                cfg->batch_size, cfg->n_threads,
+                s->seconds.mean, s->seconds.ci95,
+                s->samples_per_s.mean, s->samples_per_s.ci95,
+                s->test_mse.mean, s->test_mse.ci95, s->n_reached);
+        if (s->n_reached>0)
+            fprintf(out, "%.6f,%.6f,", s->time_to_target.mean, s->time_to_target.ci95);
+        else
+            fprintf(out, ",,");
+        fprintf(out, "%.1f\n", peak_rss_mb);
+    }
+    fflush(out);
+}
+
+int main(int argc, char** argv)
+{
+    struct arguments arg_vals;
+    FILE* out = stdout;
+    bool first = true;
+    int status = 0;
+
+    // Parse arguments
+    init_arguments(&arg_vals);
+    argp_parse(&argparser, argc, argv, 0, 0, &arg_vals);
+
+    if (arg_vals.output_path!=NULL)
+    {
+        out = fopen(arg_vals.output_path, "w");
+        if (out==NULL)
+        {
+            perror("ERROR: Could not open output file.");
+            return 1;
+        }
+    }
+
+    write_header(out, &arg_vals);
+    for (size_t m=0; m<arg_vals.n_n_samples; m++)
+    for (size_t f=0; f<arg_vals.n_n_features; f++)
+    for (size_t s=0; s<arg_vals.n_solvers; s++)
+    {
+        Solver solver = arg_vals.solvers[s];
+        bool batched = solver!=SOLVER_GD;
+        bool parallel = solver==SOLVER_HOGWILD || solver==SOLVER_SYNC;
+
+        // Batch sizes and thread counts only multiply the solvers
+        // that use them
+        for (size_t b=0; b<(batched? arg_vals.n_batch_sizes: 1); b++)
+        for (size_t t=0; t<(parallel? arg_vals.n_n_threads: 1); t++)
+        {
+            Config cfg;
+            Summary summary;
+            double peak_rss_mb;
+
+            cfg.solver = solver;
+            cfg.n_samples = arg_vals.n_samples[m];
+            cfg.n_features = arg_vals.n_features[f];
+            cfg.batch_size = batched? arg_vals.batch_sizes[b]
+                                    : cfg.n_samples - cfg.n_samples/5;
+            cfg.n_threads = parallel? arg_vals.n_threads[t]: 1;
+
+            fprintf(stderr, "%s: %zu samples, %zu features, batch %zu, %zu threads\n",
+                    solver_names[cfg.solver], cfg.n_samples, cfg.n_features,
+                    cfg.batch_size, cfg.n_threads);
+            if (cfg.n_samples<5 || cfg.batch_size>cfg.n_samples - cfg.n_samples/5)
+            {
+                fprintf(stderr, "ERROR: Too few samples for this configuration, skipped.\n");
+                status = 1;
+                continue;
+            }
+            if (!run_isolated(&cfg, &arg_vals, &summary, &peak_rss_mb))
+            {
+                fprintf(stderr, "ERROR: Configuration failed, skipped.\n");
+                status = 1;
+                continue;
+            }
+            write_row(out, &arg_vals, &cfg, &summary, peak_rss_mb, first);
+            first = false;
+        }
+    }
+    if (arg_vals.json)
+        fprintf(out, "\n  ]\n}\n");
+
+    if (out!=stdout)
+        fclose(out);
+    return status;
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <argp.h>
+#include "src/matrix.h"
+#include "src/dataset.h"
+#include "src/helpers.h"
+
+// Argp argument parser configuration
+const char* argp_program_version = "v.0.0.1";
+const char* argp_program_bug_address = "<ddebnath@purdue.edu>";
+static char doc[] = "Write a synthetic linear regression dataset of any size to a binary dataset file.";
+
+static struct argp_option options[] = {
+    {"n_features", 'N', "N_FEATURES", 0, "Number of features"},
+    {"n_samples", 'M', "N_SAMPLES", 0, "Number of samples"},
+    {"bias", 'b', "BIAS", OPTION_ARG_OPTIONAL, "Bias term"},
+    {"noise intensity", 'I', "NOISE_INTENSITY", OPTION_ARG_OPTIONAL, "Intensity of Gaussian noise to be added"},
+    {"seed", 'S', "SEED", OPTION_ARG_OPTIONAL, "Random number seed"},
+    {"output", 'o', "PATH", OPTION_ARG_OPTIONAL, "Dataset file to write"},
+    {"float", 'F', 0, 0, "Store X and y in single precision"},
+    {0}};
+
+// Struct to hold all arguments
+struct arguments
+{
+    size_t n_features, n_samples;
+    double bias, noise_intensity;
+    unsigned int seed;
+    const char* output_path;
+    bool single_precision;
+};
+
+// Initialize arguments to defaults
+void init_arguments(struct arguments* arg_vals)
+{
+    arg_vals->n_features = 20;
+    arg_vals->n_samples = 100000;
+    arg_vals->bias = -300.7;
+    arg_vals->noise_intensity = 2.0;
+    arg_vals->seed = 42;
+    arg_vals->output_path = NULL;
+    arg_vals->single_precision = false;
+}
+
+// Function to parse arguments option by option
+static error_t parse_opt(int key, char* arg, struct argp_state* state)
+{
+    struct arguments *arguments = (struct arguments*)(state->input);
+
+    switch (key)
+    {
+        case 'N':
+            arguments->n_features = strtoull(arg, NULL, 10);
+            break;
+        case 'M':
+            arguments->n_samples = strtoull(arg, NULL, 10);
+            break;
+        case 'b':
+            arguments->bias = atof(arg);
+            break;
+        case 'I':
+            arguments->noise_intensity = atof(arg);
+            break;
+        case 'S':
+            arguments->seed = atoi(arg);
+            break;
+        case 'o':
+            arguments->output_path = arg;
+            break;
+        case 'F':
+            arguments->single_precision = true;
+            break;
+        case ARGP_KEY_END:
+            if (arguments->output_path==NULL)
+                argp_error(state, "An output path is required (-oPATH).");
+            break;
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+// Argument parser
+static struct argp argparser = {options, parse_opt, 0, doc};
+
+int main(int argc, char** argv)
+{
+    struct arguments arg_vals;
+    struct timeval start_t, end_t;
+    DatasetDType dtype;
+    double duration, bytes;
+
+    // Parse arguments
+    init_arguments(&arg_vals);
+    argp_parse(&argparser, argc, argv, 0, 0, &arg_vals);
+    dtype = arg_vals.single_precision? DATASET_F32: DATASET_F64;
+
+    gettimeofday(&start_t, NULL);
+    if (!make_regression_file(arg_vals.output_path,
+                              arg_vals.n_samples, arg_vals.n_features,
+                              arg_vals.bias, arg_vals.noise_intensity,
+                              arg_vals.seed, dtype))
+        return 1;
+    gettimeofday(&end_t, NULL);
+
+    duration = (end_t.tv_sec - start_t.tv_sec) + (end_t.tv_usec - start_t.tv_usec) / 1000000.0;
+    bytes = (double)arg_vals.n_samples * (double)(arg_vals.n_features + 1)
+            * (arg_vals.single_precision? sizeof(float): sizeof(double));
+    printf("Wrote %zu x %zu dataset to %s in %.6f seconds "
+           "(%.0f rows/s, %.1f MB/s).\n",
+           arg_vals.n_samples, arg_vals.n_features, arg_vals.output_path,
+           duration, (double)arg_vals.n_samples / duration,
+           bytes / duration / 1e6);
+
+    return 0;
+}
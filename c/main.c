@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <unistd.h>
 #include <sys/time.h>
 #include <argp.h>
 #include "src/matrix.h"
@@ -6,6 +7,11 @@
 #include "src/losses.h"
 #include "src/sgd.h"
 #include "src/stats.h"
+#include "src/sampler.h"
+#include "src/dataset.h"
+#include "src/csv.h"
+#include "src/stream.h"
+#include "src/sparse.h"
 
 // Argp argument parser configuration
 const char* argp_program_version = "v.0.0.1";
@@ -23,6 +29,20 @@ static struct argp_option options[] = {
     {"test_frac", 'f', "TEST_FRAC", OPTION_ARG_OPTIONAL, "Fraction of data for test set"},
     {"n_iter", 'i', "N_ITER", OPTION_ARG_OPTIONAL, "Number of iterations"},
     {"tol", 't', "TOL", OPTION_ARG_OPTIONAL, "Tolerance for convergence"},
+    {"gram", 'G', 0, 0, "Run gradient descent on the precomputed Gram matrix X^T X"},
+    {"ridge", 'r', "RIDGE", OPTION_ARG_OPTIONAL, "Ridge term for the normal equation solver"},
+    {"dataset", 'D', "PATH", OPTION_ARG_OPTIONAL, "Train on a binary dataset file instead of synthetic data"},
+    {"csv", 'C', "PATH", OPTION_ARG_OPTIONAL, "Train on a CSV file instead of synthetic data"},
+    {"target", 'T', "COLUMN", OPTION_ARG_OPTIONAL, "Target column of the CSV file (negative counts from the end)"},
+    {"save_dataset", 'o', "PATH", OPTION_ARG_OPTIONAL, "Write the synthetic dataset to a binary dataset file"},
+    {"float", 'F', 0, 0, "Store X in single precision for stochastic gradient descent"},
+    {"stream", 's', 0, 0, "Stream the dataset or CSV file from disk in chunks and train with stochastic gradient descent only"},
+    {"chunk_rows", 'c', "ROWS", OPTION_ARG_OPTIONAL, "Rows per chunk when streaming"},
+    {"hogwild", 'H', 0, 0, "Also run Hogwild parallel stochastic gradient descent with 1, 2, 4, ... threads"},
+    {"sync", 'y', 0, 0, "Also run synchronous data-parallel stochastic gradient descent with 1, 2, 4, ... threads"},
+    {"sparse", 'Z', 0, 0, "Also run stochastic gradient descent on X compressed to sparse (CSR) form"},
+    {"threads", 'j', "N_THREADS", OPTION_ARG_OPTIONAL, "Maximum number of threads for parallel solvers (0 uses all processors)"},
+    {"sampling", 'P', "POLICY", OPTION_ARG_OPTIONAL, "Minibatch sampling policy (shuffle, affine, sequential, replacement)"},
     {0}};
 
 // Struct to hold all arguments
@@ -30,12 +50,26 @@ struct arguments
 {
     unsigned int n_iter;
     double tol;
-    unsigned int n_features, n_samples;
+    size_t n_features, n_samples;
     double bias, noise_intensity;
     double learning_rate;
     unsigned int batch_size;
     double test_frac;
     unsigned int seed;
+    SamplingPolicy sampling;
+    bool gram;
+    bool single_precision;
+    double ridge;
+    const char* dataset_path;
+    const char* csv_path;
+    long target_column;
+    const char* save_path;
+    bool stream;
+    size_t chunk_rows;
+    bool hogwild;
+    bool sync;
+    bool sparse;
+    unsigned int n_threads;
 };
 
 // Initialize arguments to defaults
@@ -51,6 +85,20 @@ void init_arguments(struct arguments* arg_vals)
     arg_vals->batch_size = 32;
     arg_vals->test_frac = 0.2;
     arg_vals->seed = 42;
+    arg_vals->sampling = SAMPLE_SHUFFLE;
+    arg_vals->gram = false;
+    arg_vals->single_precision = false;
+    arg_vals->dataset_path = NULL;
+    arg_vals->csv_path = NULL;
+    arg_vals->target_column = -1;
+    arg_vals->save_path = NULL;
+    arg_vals->stream = false;
+    arg_vals->chunk_rows = 65536;
+    arg_vals->hogwild = false;
+    arg_vals->sync = false;
+    arg_vals->sparse = false;
+    arg_vals->n_threads = 0;
+    arg_vals->ridge = 0.0;
 }
 
 // Print arguments
@@ -58,7 +106,7 @@ void print_arguments(struct arguments* arg_vals)
 {
     printf("Arguments:\n"
            "n_iter = %u, tol = %f,\n"
-           "n_features = %u, n_samples = %u\n"
+           "n_features = %zu, n_samples = %zu\n"
            "bias = %f, noise_intensity = %f\n"
            "learning_rate = %f, batch_size = %u\n"
            "test_frac = %f, seed = %u\n\n",
@@ -77,10 +125,10 @@ static error_t parse_opt(int key, char* arg, struct argp_state* state)
     switch (key)
     {
         case 'N':
-            arguments->n_features = atoi(arg);
+            arguments->n_features = strtoull(arg, NULL, 10);
             break;
         case 'M':
-            arguments->n_samples = atoi(arg);
+            arguments->n_samples = strtoull(arg, NULL, 10);
             break;
         case 'b':
             arguments->bias = atof(arg);
@@ -106,6 +154,49 @@ static error_t parse_opt(int key, char* arg, struct argp_state* state)
         case 'f':
             arguments->test_frac = atof(arg);
             break;
+        case 'r':
+            arguments->ridge = atof(arg);
+            break;
+        case 'G':
+            arguments->gram = true;
+            break;
+        case 'F':
+            arguments->single_precision = true;
+            break;
+        case 'D':
+            arguments->dataset_path = arg;
+            break;
+        case 'C':
+            arguments->csv_path = arg;
+            break;
+        case 'T':
+            arguments->target_column = atol(arg);
+            break;
+        case 'o':
+            arguments->save_path = arg;
+            break;
+        case 's':
+            arguments->stream = true;
+            break;
+        case 'c':
+            arguments->chunk_rows = strtoull(arg, NULL, 10);
+            break;
+        case 'H':
+            arguments->hogwild = true;
+            break;
+        case 'y':
+            arguments->sync = true;
+            break;
+        case 'Z':
+            arguments->sparse = true;
+            break;
+        case 'j':
+            arguments->n_threads = atoi(arg);
+            break;
+        case 'P':
+            if (!sampler_parse_policy(arg, &(arguments->sampling)))
+                argp_error(state, "Unknown sampling policy.");
+            break;
         default:
             return ARGP_ERR_UNKNOWN;
     }
@@ -115,6 +206,100 @@ static error_t parse_opt(int key, char* arg, struct argp_state* state)
 // Argument parser
 static struct argp argparser = {options, parse_opt, 0, doc};
 
+// Print the time per phase of a solver run (built with SGD_PROFILE)
+static void print_profile(const SGDProfile* profile)
+{
+    double phases = 0.0;
+
+    if (!profile->enabled)
+        return;
+    printf("%-10s %12s %8s %12s %10s\n", "Phase", "Time (s)", "Share", "Calls", "ns/call");
+    for (int p=0; p<PROFILE_N_PHASES; p++)
+    {
+        if (profile->calls[p]==0)
+            continue;
+        phases += profile->seconds[p];
+        printf("%-10s %12.6f %7.1f%% %12llu %10.1f\n",
+               sgd_profile_phase_name((ProfilePhase)p), profile->seconds[p],
+               100.0 * profile->seconds[p] / profile->total_seconds,
+               profile->calls[p], 1e9 * profile->seconds[p] / (double)profile->calls[p]);
+    }
+    printf("%-10s %12.6f %7.1f%%\n", "other", profile->total_seconds - phases,
+           100.0 * (profile->total_seconds - phases) / profile->total_seconds);
+    printf("%-10s %12.6f\n", "total", profile->total_seconds);
+}
+
+// Mean squared error of theta and bias over all rows of a stream,
+// read one chunk at a time
+static double stream_mse(DataStream* stream, SGDResult* result)
+{
+    Matrix x_buffer = mat_create(stream_chunk_size(stream, 0), stream->n_features);
+    Matrix y_buffer = mat_create(stream_chunk_size(stream, 0), 1);
+    Matrix pred_buffer = mat_create(stream_chunk_size(stream, 0), 1);
+    double sum = 0.0;
+
+    for (size_t k=0; k<stream->n_chunks; k++)
+    {
+        size_t rows = stream_chunk_size(stream, k);
+        Matrix x = mat_view(&x_buffer, 0, 0, rows, stream->n_features);
+        Matrix y = mat_view(&y_buffer, 0, 0, rows, 1);
+        Matrix y_pred = mat_view(&pred_buffer, 0, 0, rows, 1);
+
+        if (!stream_read_chunk(stream, k, &x, &y))
+            break;
+        mat_mul_inplace(&x, false, &(result->theta_sol), false, &y_pred);
+        mat_add_scalar(&y_pred, result->bias);
+        sum += l2_loss(&y, &y_pred) * (double)rows;
+    }
+
+    mat_destroy(&x_buffer);
+    mat_destroy(&y_buffer);
+    mat_destroy(&pred_buffer);
+    return sum / (double)stream->n_samples;
+}
+
+// Train on a dataset or CSV file streamed from disk
+static int run_stream(struct arguments* arg_vals, LossFunctions* l2)
+{
+    DataStream stream;
+    CSVOptions csv_options = csv_default_options();
+    SGDResult result;
+    struct timeval start_t, end_t;
+    double duration;
+    bool ok;
+
+    csv_options.target_column = arg_vals->target_column;
+    if (arg_vals->dataset_path!=NULL)
+        ok = stream_open(&stream, arg_vals->dataset_path, arg_vals->chunk_rows, NULL);
+    else if (arg_vals->csv_path!=NULL)
+        ok = stream_open(&stream, arg_vals->csv_path, arg_vals->chunk_rows, &csv_options);
+    else
+    {
+        fprintf(stderr, "ERROR: Streaming needs a dataset or CSV file.\n");
+        return 1;
+    }
+    if (!ok)
+        return 1;
+    printf("Streaming %zu x %zu samples in %zu chunks of %zu rows.\n",
+           stream.n_samples, stream.n_features, stream.n_chunks, stream.chunk_rows);
+
+    // Stochastic gradient descent
+    gettimeofday(&start_t, NULL);
+    result = stochastic_gradient_descent_stream(&stream, arg_vals->batch_size,
+                          arg_vals->sampling, arg_vals->learning_rate,
+                          l2, arg_vals->n_iter, arg_vals->tol, arg_vals->seed);
+    gettimeofday(&end_t, NULL);
+
+    duration = (end_t.tv_sec - start_t.tv_sec) + (end_t.tv_usec - start_t.tv_usec) / 1000000.0;
+    printf("Streaming stochastic gradient descent took %.6f seconds.\n", duration);
+    printf("MSE (all rows): %.4f\n", stream_mse(&stream, &result));
+    print_profile(&(result.profile));
+
+    destroy_sgdresult(&result);
+    stream_close(&stream);
+    return 0;
+}
+
 int main(int argc, char** argv)
 {
     struct arguments arg_vals;
@@ -125,34 +310,101 @@ int main(int argc, char** argv)
     print_arguments(&arg_vals);
 
     double duration = 0;
+    double sgd_duration, sgd_mse;
 
     struct timeval start_t, end_t;
     
-    // Generate dataset
-    Matrix x = mat_create(arg_vals.n_samples, arg_vals.n_features);
-    Matrix y = mat_create(arg_vals.n_samples, 1);
-    Matrix x_test = mat_create(arg_vals.n_samples * arg_vals.test_frac, 
-                               arg_vals.n_features);
-    Matrix y_test = mat_create(arg_vals.n_samples * arg_vals.test_frac, 1);
-    Matrix x_train = mat_create(arg_vals.n_samples - x_test.nrows, 
-                                arg_vals.n_features);
-    Matrix y_train = mat_create(arg_vals.n_samples - x_test.nrows, 1);
-
+    Matrix x, y, x_train, y_train, x_test, y_test;
     Matrix y_pred;
+    Dataset dataset;
+    CSVOptions csv_options = csv_default_options();
+    CSVStats csv_stats;
+    size_t n_test;
     
     SGDResult result;
-    
-    make_regression_dataset(&x, &y, arg_vals.bias, 
-                    arg_vals.noise_intensity, arg_vals.seed);
-    split_into_train_test(&x, &y, &x_train, &y_train, 
-            &x_test, &y_test, arg_vals.seed);
+    LossFunctions l2 = l2_loss_functions();
+
+    // Out-of-core training never loads the whole file
+    if (arg_vals.stream)
+        return run_stream(&arg_vals, &l2);
+
+    if (arg_vals.dataset_path!=NULL)
+    {
+        // Map the dataset file. Double precision files are used in
+        // place; single precision files are widened for the solvers.
+        gettimeofday(&start_t, NULL);
+        if (!dataset_open(&dataset, arg_vals.dataset_path))
+            return 1;
+        if (dataset.dtype==DATASET_F64)
+        {
+            x = dataset.x;
+            y = dataset.y;
+        }
+        else
+        {
+            x = mat_from_fmat(&dataset.x_f);
+            y = mat_from_fmat(&dataset.y_f);
+        }
+        gettimeofday(&end_t, NULL);
+        duration = (end_t.tv_sec - start_t.tv_sec) + (end_t.tv_usec - start_t.tv_usec) / 1000000.0;
+        printf("Loaded %zu x %zu dataset from %s in %.6f seconds.\n",
+               x.nrows, x.ncols, arg_vals.dataset_path, duration);
+    }
+    else if (arg_vals.csv_path!=NULL)
+    {
+        csv_options.target_column = arg_vals.target_column;
+        if (!csv_load(arg_vals.csv_path, &csv_options, &x, &y, &csv_stats))
+            return 1;
+        printf("Parsed %zu x %zu CSV file %s in %.6f seconds (%.1f MB/s).\n",
+               csv_stats.n_rows, csv_stats.n_cols, arg_vals.csv_path,
+               csv_stats.seconds, csv_stats.mb_per_s);
+        if (arg_vals.save_path!=NULL)
+            dataset_save(arg_vals.save_path, &x, &y,
+                         arg_vals.single_precision? DATASET_F32: DATASET_F64);
+    }
+
+    if (arg_vals.dataset_path!=NULL || arg_vals.csv_path!=NULL)
+    {
+        // Rows of data files are taken to be shuffled already,
+        // so the test set is its last rows (views, nothing is copied)
+        n_test = x.nrows * arg_vals.test_frac;
+        x_train = mat_view(&x, 0, 0, x.nrows - n_test, x.ncols);
+        y_train = mat_view(&y, 0, 0, x.nrows - n_test, 1);
+        x_test = mat_view(&x, x.nrows - n_test, 0, n_test, x.ncols);
+        y_test = mat_view(&y, x.nrows - n_test, 0, n_test, 1);
+    }
+    else
+    {
+        // Generate dataset
+        x = mat_create(arg_vals.n_samples, arg_vals.n_features);
+        y = mat_create(arg_vals.n_samples, 1);
+        x_test = mat_create(arg_vals.n_samples * arg_vals.test_frac, 
+                            arg_vals.n_features);
+        y_test = mat_create(arg_vals.n_samples * arg_vals.test_frac, 1);
+        x_train = mat_create(arg_vals.n_samples - x_test.nrows, 
+                             arg_vals.n_features);
+        y_train = mat_create(arg_vals.n_samples - x_test.nrows, 1);
+
+        make_regression_dataset(&x, &y, arg_vals.bias, 
+                        arg_vals.noise_intensity, arg_vals.seed);
+        if (arg_vals.save_path!=NULL)
+            dataset_save(arg_vals.save_path, &x, &y,
+                         arg_vals.single_precision? DATASET_F32: DATASET_F64);
+        split_into_train_test(&x, &y, &x_train, &y_train, 
+                &x_test, &y_test, arg_vals.seed);
+    }
     
     gettimeofday(&start_t, NULL);
 
     // Gradient descent
-    result = gradient_descent(&x_train, &y_train, arg_vals.learning_rate, 
-                              &l2_loss, &l2_gradient,
-                              arg_vals.n_iter, arg_vals.tol, arg_vals.seed);
+    if (arg_vals.gram)
+        result = gradient_descent_gram(&x_train, &y_train,
+                                       arg_vals.learning_rate,
+                                       arg_vals.n_iter, arg_vals.tol,
+                                       arg_vals.seed);
+    else
+        result = gradient_descent(&x_train, &y_train, arg_vals.learning_rate, 
+                                  &l2, arg_vals.n_iter, arg_vals.tol, arg_vals.seed);
 
     gettimeofday(&end_t, NULL);
 
@@ -166,30 +418,166 @@ int main(int argc, char** argv)
     printf("MSE: %.4f\n", l2_loss(&y_test, &y_pred));
     printf("MAE: %.4f\n", stats_mae(&y_test, &y_pred));
     printf("R-squared: %.4f\n", stats_r2(&y_test, &y_pred));
+    print_profile(&(result.profile));
 
     mat_destroy(&y_pred);
     destroy_sgdresult(&result);
 
-    // Stochastic gradient descent
+    // Stochastic gradient descent. Single precision dataset files are
+    // viewed directly, otherwise X is converted before the timer starts.
+    FMatrix x_train_f;
+
+    if (arg_vals.single_precision)
+        x_train_f = arg_vals.dataset_path!=NULL && dataset.dtype==DATASET_F32?
+                fmat_view(&dataset.x_f, 0, 0, x_train.nrows, x_train.ncols):
+                fmat_from_mat(&x_train);
     gettimeofday(&start_t, NULL);
     
-    result = stochastic_gradient_descent(&x_train, &y_train, arg_vals.batch_size,
-                              arg_vals.learning_rate, &l2_loss, &l2_gradient,
-                              arg_vals.n_iter, arg_vals.tol, arg_vals.seed);
+    if (arg_vals.single_precision)
+        result = stochastic_gradient_descent_mixed(&x_train_f, &y_train,
+                              arg_vals.batch_size, arg_vals.sampling,
+                              arg_vals.learning_rate, &l2, arg_vals.n_iter,
+                              arg_vals.tol, arg_vals.seed);
+    else
+        result = stochastic_gradient_descent(&x_train, &y_train, arg_vals.batch_size,
+                              arg_vals.sampling, arg_vals.learning_rate,
+                              &l2, arg_vals.n_iter, arg_vals.tol, arg_vals.seed);
     gettimeofday(&end_t, NULL);
 
+    if (arg_vals.single_precision)
+        fmat_destroy(&x_train_f);
+
     duration = (end_t.tv_sec - start_t.tv_sec) + (end_t.tv_usec - start_t.tv_usec) / 1000000.0;
     printf("Stochastic gradient descent took %.6f seconds.\n", duration);
+    sgd_duration = duration;
     
     y_pred = mat_mul(&x_test, false, &(result.theta_sol), false);
     mat_add_scalar(&y_pred, result.bias);
 
-    printf("MSE: %.4f\n", l2_loss(&y_test, &y_pred));
+    sgd_mse = l2_loss(&y_test, &y_pred);
+    printf("MSE: %.4f\n", sgd_mse);
     printf("MAE: %.4f\n", stats_mae(&y_test, &y_pred));
     printf("R-squared: %.4f\n", stats_r2(&y_test, &y_pred));
+    print_profile(&(result.profile));
  
     mat_destroy(&y_pred);
     destroy_sgdresult(&result);
+
+    // Hogwild SGD, speedup and MSE relative to the serial solver
+    if (arg_vals.hogwild)
+    {
+        unsigned int max_threads = arg_vals.n_threads>0? arg_vals.n_threads
+                : (unsigned int)sysconf(_SC_NPROCESSORS_ONLN);
+
+        // Powers of two, then max_threads itself
+        for (unsigned int t=1; ; t = t*2<max_threads? t*2: max_threads)
+        {
+            gettimeofday(&start_t, NULL);
+            result = parallel_sgd_hogwild(&x_train, &y_train, arg_vals.batch_size,
+                              arg_vals.sampling, arg_vals.learning_rate,
+                              &l2, arg_vals.n_iter, arg_vals.tol, arg_vals.seed, t);
+            gettimeofday(&end_t, NULL);
+
+            duration = (end_t.tv_sec - start_t.tv_sec) + (end_t.tv_usec - start_t.tv_usec) / 1000000.0;
+            y_pred = mat_mul(&x_test, false, &(result.theta_sol), false);
+            mat_add_scalar(&y_pred, result.bias);
+            printf("Hogwild SGD with %u threads took %.6f seconds (%.2fx speedup), "
+                   "MSE: %.4f (%.3f x serial).\n",
+                   t, duration, sgd_duration/duration,
+                   l2_loss(&y_test, &y_pred), l2_loss(&y_test, &y_pred)/sgd_mse);
+            print_profile(&(result.profile));
+
+            mat_destroy(&y_pred);
+            destroy_sgdresult(&result);
+            if (t>=max_threads)
+                break;
+        }
+    }
+
+    // Synchronous data-parallel SGD, speedup relative to one thread
+    // and MSE relative to the serial solver
+    if (arg_vals.sync)
+    {
+        unsigned int max_threads = arg_vals.n_threads>0? arg_vals.n_threads
+                : (unsigned int)sysconf(_SC_NPROCESSORS_ONLN);
+        double sync_duration = 0.0;
+
+        // Powers of two, then max_threads itself
+        for (unsigned int t=1; ; t = t*2<max_threads? t*2: max_threads)
+        {
+            gettimeofday(&start_t, NULL);
+            result = parallel_sgd_sync(&x_train, &y_train, arg_vals.batch_size,
+                              arg_vals.sampling, arg_vals.learning_rate,
+                              arg_vals.n_iter, arg_vals.tol, arg_vals.seed, t);
+            gettimeofday(&end_t, NULL);
+
+            duration = (end_t.tv_sec - start_t.tv_sec) + (end_t.tv_usec - start_t.tv_usec) / 1000000.0;
+            if (t==1)
+                sync_duration = duration;
+            y_pred = mat_mul(&x_test, false, &(result.theta_sol), false);
+            mat_add_scalar(&y_pred, result.bias);
+            printf("Synchronous SGD with %u threads took %.6f seconds (%.2fx speedup), "
+                   "MSE: %.4f (%.3f x serial).\n",
+                   t, duration, sync_duration/duration,
+                   l2_loss(&y_test, &y_pred), l2_loss(&y_test, &y_pred)/sgd_mse);
+            print_profile(&(result.profile));
+
+            mat_destroy(&y_pred);
+            destroy_sgdresult(&result);
+            if (t>=max_threads)
+                break;
+        }
+    }
+
+    // Sparse SGD on the CSR form of the training set
+    if (arg_vals.sparse)
+    {
+        CSRMatrix x_sparse = csr_from_dense(&x_train);
+
+        printf("Sparse X has %zu nonzeros (%.2f%% dense).\n", x_sparse.nnz,
+               100.0 * (double)x_sparse.nnz / ((double)x_train.nrows * (double)x_train.ncols));
+        gettimeofday(&start_t, NULL);
+        result = stochastic_gradient_descent_sparse(&x_sparse, &y_train,
+                              arg_vals.batch_size, arg_vals.sampling,
+                              arg_vals.learning_rate, arg_vals.n_iter,
+                              arg_vals.tol, arg_vals.seed);
+        gettimeofday(&end_t, NULL);
+
+        duration = (end_t.tv_sec - start_t.tv_sec) + (end_t.tv_usec - start_t.tv_usec) / 1000000.0;
+        y_pred = mat_mul(&x_test, false, &(result.theta_sol), false);
+        mat_add_scalar(&y_pred, result.bias);
+        printf("Sparse SGD took %.6f seconds, MSE: %.4f (%.3f x serial).\n",
+               duration, l2_loss(&y_test, &y_pred), l2_loss(&y_test, &y_pred)/sgd_mse);
+        print_profile(&(result.profile));
+
+        mat_destroy(&y_pred);
+        destroy_sgdresult(&result);
+        csr_destroy(&x_sparse);
+    }
+
+    // Normal equations
+    gettimeofday(&start_t, NULL);
+
+    result = normal_equation_solve(&x_train, &y_train, arg_vals.ridge);
+    gettimeofday(&end_t, NULL);
+
+    duration = (end_t.tv_sec - start_t.tv_sec) + (end_t.tv_usec - start_t.tv_usec) / 1000000.0;
+    printf("Normal equation solve took %.6f seconds.\n", duration);
+
+    if (result.converged)
+    {
+        y_pred = mat_mul(&x_test, false, &(result.theta_sol), false);
+        mat_add_scalar(&y_pred, result.bias);
+
+        printf("MSE: %.4f\n", l2_loss(&y_test, &y_pred));
+        printf("MAE: %.4f\n", stats_mae(&y_test, &y_pred));
+        printf("R-squared: %.4f\n", stats_r2(&y_test, &y_pred));
+        mat_destroy(&y_pred);
+    }
+    else
+        printf("Normal equation solve failed, X^T X is singular.\n");
+
+    destroy_sgdresult(&result);
     
     // Destroy dataset
     mat_destroy(&x);
@@ -198,6 +586,8 @@ int main(int argc, char** argv)
     mat_destroy(&y_train);
     mat_destroy(&x_test);
     mat_destroy(&y_test);
+    if (arg_vals.dataset_path!=NULL)
+        dataset_close(&dataset);
 
     return 0;
 }
@@ -0,0 +1,502 @@
+// Multi-threaded loading of CSV files into matrices
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "matrix.h"
+#include "csv.h"
+
+#define CSV_MAX_THREADS 64
+
+// Files smaller than this are parsed on the calling thread only
+#define CSV_MT_MIN_BYTES (1 << 20)
+
+// Longest token handed to strtod by the slow path
+#define CSV_MAX_TOKEN 128
+
+// Powers of ten that are exact in double precision
+static const double exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// A byte range of the file holding whole lines, and the rows
+// parsed from it
+typedef struct
+{
+    const char* begin;
+    const char* end;
+    size_t n_rows;      // Rows in the range (first pass)
+    size_t first_row;   // Row of the first line in x and y
+    size_t n_cols, target;
+    char delimiter;
+    Matrix* x;
+    Matrix* y;
+    bool ok;
+} CSVTask;
+
+// Default options: comma separated, last column is y, all threads
+CSVOptions csv_default_options(void)
+{
+    CSVOptions options;
+    options.delimiter = ',';
+    options.target_column = -1;
+    options.n_threads = 0;
+    return options;
+}
+
+// Parse a floating point number from [begin, end). "next" receives
+// the first character after the number (begin if there is none).
+// Decimal numbers with up to 15 significant digits and small
+// exponents are converted exactly with a single multiplication or
+// division (Clinger's fast path); everything else (long mantissas,
+// large exponents, inf, nan) goes through strtod.
+double csv_parse_double(const char* begin, const char* end,
+                        const char** next)
+{
+    const char* p = begin;
+    const char* start;
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool negative = false, any = false;
+    char token[CSV_MAX_TOKEN];
+    char* token_end;
+    size_t len;
+    double value;
+
+    while (p<end && (*p==' ' || *p=='\t'))
+        p++;
+    start = p;
+
+    if (p<end && (*p=='-' || *p=='+'))
+        negative = *(p++)=='-';
+    for (; p<end && *p>='0' && *p<='9'; p++)
+    {
+        any = true;
+        if (digits<19)
+        {
+            mantissa = mantissa*10 + (uint64_t)(*p-'0');
+            digits += mantissa!=0;
+        }
+        else
+            exponent++;
+    }
+    if (p<end && *p=='.')
+        for (p++; p<end && *p>='0' && *p<='9'; p++)
+        {
+            any = true;
+            if (digits<19)
+            {
+                mantissa = mantissa*10 + (uint64_t)(*p-'0');
+                digits += mantissa!=0;
+                exponent--;
+            }
+        }
+    if (any && p<end && (*p=='e' || *p=='E'))
+    {
+        const char* q = p+1;
+        bool exp_negative = false;
+        int exp_value = 0;
+
+        if (q<end && (*q=='-' || *q=='+'))
+            exp_negative = *(q++)=='-';
+        if (q<end && *q>='0' && *q<='9')
+        {
+            for (; q<end && *q>='0' && *q<='9'; q++)
+                if (exp_value<100000)
+                    exp_value = exp_value*10 + (*q-'0');
+            exponent += exp_negative? -exp_value: exp_value;
+            p = q;
+        }
+    }
+
+    if (any && mantissa<=((uint64_t)1 << 53) && exponent>=-22 && exponent<=22)
+    {
+        value = (double)mantissa;
+        value = exponent<0? value/exact_pow10[-exponent]
+                          : value*exact_pow10[exponent];
+        *next = p;
+        return negative? -value: value;
+    }
+
+    // Slow path. The input is not NUL-terminated, so the token is
+    // copied first.
+    for (len=0; start+len<end && len<CSV_MAX_TOKEN-1; len++)
+    {
+        char c = start[len];
+        if (c==',' || c==';' || c=='\t' || c=='\n' || c=='\r' || c==' ')
+            break;
+        token[len] = c;
+    }
+    token[len] = '\0';
+    value = strtod(token, &token_end);
+    *next = token_end==token? begin: start + (token_end-token);
+    return value;
+}
+
+// End of the line starting at "p" (excluding "\r\n" or "\n")
+// and the start of the line after it
+static const char* line_end(const char* p, const char* end,
+                            const char** next_line)
+{
+    const char* newline = (const char*)memchr(p, '\n', end-p);
+    const char* stop = newline!=NULL? newline: end;
+
+    *next_line = newline!=NULL? newline+1: end;
+    if (stop>p && stop[-1]=='\r')
+        stop--;
+    return stop;
+}
+
+// Whether [p, stop) holds only blanks
+static bool blank_line(const char* p, const char* stop)
+{
+    for (; p<stop; p++)
+        if (*p!=' ' && *p!='\t')
+            return false;
+    return true;
+}
+
+// First pass: count the (non-blank) rows of a range
+static void* count_rows(void* arg)
+{
+    CSVTask* task = (CSVTask*)arg;
+    const char* p = task->begin;
+    const char* next;
+
+    task->n_rows = 0;
+    while (p<task->end)
+    {
+        const char* stop = line_end(p, task->end, &next);
+        task->n_rows += !blank_line(p, stop);
+        p = next;
+    }
+    return NULL;
+}
+
+// Parse the CSV lines in [begin, end) into consecutive rows of x
+// and y, starting at row "first_row". Blank lines are skipped.
+// Every line must have "n_cols" fields; field "target" goes to y.
+bool csv_parse_rows(const char* begin, const char* end, char delimiter,
+                    size_t n_cols, size_t target,
+                    Matrix* x, Matrix* y, size_t first_row)
+{
+    const char* p = begin;
+    const char* next;
+    size_t row = first_row;
+
+    while (p<end)
+    {
+        const char* stop = line_end(p, end, &next);
+        double* x_row = &(x->data[row*x->stride]);
+        const char* q = p;
+
+        if (blank_line(p, stop))
+        {
+            p = next;
+            continue;
+        }
+
+        for (size_t c=0, j=0; c<n_cols; c++)
+        {
+            const char* after;
+            double value = csv_parse_double(q, stop, &after);
+
+            while (after<stop && (*after==' ' || *after=='\t'))
+                after++;
+            // Every field but the last must end in a delimiter
+            if (after==q || (c+1<n_cols?
+                    after>=stop || *after!=delimiter: after!=stop))
+            {
+                fprintf(stderr, "ERROR: Could not parse CSV row %zu, column %zu.\n",
+                        row+1, c+1);
+                return false;
+            }
+            if (c==target)
+                y->data[row*y->stride] = value;
+            else
+                x_row[j++] = value;
+            q = after+1;
+        }
+        row++;
+        p = next;
+    }
+    return true;
+}
+
+// Second pass: parse the rows of a range into x and y
+static void* parse_rows(void* arg)
+{
+    CSVTask* task = (CSVTask*)arg;
+    task->ok = csv_parse_rows(task->begin, task->end, task->delimiter,
+                              task->n_cols, task->target,
+                              task->x, task->y, task->first_row);
+    return NULL;
+}
+
+// Skip a header line and find the number of columns and the
+// target column from the first row. "begin" is moved to the first
+// row.
+static bool csv_layout(const char** begin, const char* end,
+                       const CSVOptions* opts, size_t* n_cols, size_t* target)
+{
+    const char* next;
+    const char* after;
+    const char* first_end = line_end(*begin, end, &next);
+    long column;
+
+    csv_parse_double(*begin, first_end, &after);
+    if (after==*begin)
+    {
+        *begin = next;
+        first_end = line_end(*begin, end, &next);
+    }
+
+    *n_cols = 1;
+    for (const char* p=*begin; p<first_end; p++)
+        *n_cols += *p==opts->delimiter;
+    column = opts->target_column<0? (long)*n_cols + opts->target_column
+                                  : opts->target_column;
+    if (*n_cols<2 || column<0 || column>=(long)*n_cols)
+    {
+        perror("ERROR: CSV file needs at least two columns and a valid target column.");
+        return false;
+    }
+    *target = (size_t)column;
+    return true;
+}
+
+// Map a whole file read-only for a sequential scan
+static const char* map_file(const char* path, size_t* size)
+{
+    struct stat file_stat;
+    void* map;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd<0 || fstat(fd, &file_stat)!=0 || file_stat.st_size==0)
+    {
+        perror("ERROR: Could not open CSV file or file is empty.");
+        if (fd>=0)
+            close(fd);
+        return NULL;
+    }
+    *size = (size_t)file_stat.st_size;
+    map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map==MAP_FAILED)
+    {
+        perror("ERROR: Could not map CSV file.");
+        return NULL;
+    }
+    madvise(map, *size, MADV_SEQUENTIAL);
+    return (const char*)map;
+}
+
+// Run fn on every task, the calling thread takes the first one
+static void run_tasks(void* (*fn)(void*), CSVTask* tasks, unsigned int n_tasks)
+{
+    pthread_t threads[CSV_MAX_THREADS];
+    bool started[CSV_MAX_THREADS];
+
+    for (unsigned int t=1; t<n_tasks; t++)
+        started[t] = pthread_create(&threads[t], NULL, fn, &tasks[t])==0;
+    fn(&tasks[0]);
+    for (unsigned int t=1; t<n_tasks; t++)
+    {
+        if (started[t])
+            pthread_join(threads[t], NULL);
+        else
+            fn(&tasks[t]);
+    }
+}
+
+static double seconds_since(const struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec)
+            + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Load a CSV file of numbers into x (all columns but the target)
+// and y (the target column). The file is mapped and split into
+// byte ranges on line boundaries; one pass counts the rows of
+// every range so that x and y can be allocated once, and a second
+// pass parses all ranges in parallel straight into their rows.
+bool csv_load(const char* path, const CSVOptions* options,
+              Matrix* x, Matrix* y, CSVStats* stats)
+{
+    CSVTask tasks[CSV_MAX_THREADS];
+    CSVOptions opts = options!=NULL? *options: csv_default_options();
+    struct timespec start_t;
+    const char* data;
+    const char* begin;
+    const char* end;
+    size_t size, n_cols, target, n_rows = 0;
+    unsigned int n_threads;
+    bool ok = true;
+
+    x->data = NULL;
+    y->data = NULL;
+    clock_gettime(CLOCK_MONOTONIC, &start_t);
+
+    data = map_file(path, &size);
+    if (data==NULL)
+        return false;
+    begin = data;
+    end = data + size;
+    if (!csv_layout(&begin, end, &opts, &n_cols, &target))
+    {
+        munmap((void*)data, size);
+        return false;
+    }
+
+    // Byte ranges starting at line boundaries
+    n_threads = opts.n_threads>0? opts.n_threads
+                                : (unsigned int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_threads<1)
+        n_threads = 1;
+    if (n_threads>CSV_MAX_THREADS)
+        n_threads = CSV_MAX_THREADS;
+    if ((size_t)(end-begin)<CSV_MT_MIN_BYTES)
+        n_threads = 1;
+    for (unsigned int t=0; t<n_threads; t++)
+    {
+        const char* split = begin + (size_t)(end-begin)/n_threads*t;
+        if (t>0)
+        {
+            const char* newline;
+            if (split<tasks[t-1].begin)
+                split = tasks[t-1].begin;
+            newline = (const char*)memchr(split, '\n', end-split);
+            split = newline!=NULL? newline+1: end;
+            tasks[t-1].end = split;
+        }
+        tasks[t].begin = split;
+        tasks[t].end = end;
+        tasks[t].n_cols = n_cols;
+        tasks[t].target = target;
+        tasks[t].delimiter = opts.delimiter;
+        tasks[t].x = x;
+        tasks[t].y = y;
+    }
+
+    // Count rows, then parse every range into its own rows
+    run_tasks(count_rows, tasks, n_threads);
+    for (unsigned int t=0; t<n_threads; t++)
+    {
+        tasks[t].first_row = n_rows;
+        n_rows += tasks[t].n_rows;
+    }
+    if (n_rows==0)
+    {
+        perror("ERROR: CSV file has no data rows.");
+        munmap((void*)data, size);
+        return false;
+    }
+    *x = mat_create(n_rows, n_cols-1);
+    *y = mat_create(n_rows, 1);
+    run_tasks(parse_rows, tasks, n_threads);
+    for (unsigned int t=0; t<n_threads; t++)
+        ok = ok && tasks[t].ok;
+
+    munmap((void*)data, size);
+    if (!ok)
+    {
+        mat_destroy(x);
+        mat_destroy(y);
+        return false;
+    }
+
+    if (stats!=NULL)
+    {
+        stats->n_rows = n_rows;
+        stats->n_cols = n_cols;
+        stats->bytes = size;
+        stats->seconds = seconds_since(&start_t);
+        stats->mb_per_s = stats->seconds>0.0?
+                (double)size / 1e6 / stats->seconds: 0.0;
+    }
+    return true;
+}
+
+// Index a CSV file for reading it in chunks of "chunk_rows" rows:
+// records the byte offset of the first line of every chunk. Only
+// line breaks are scanned, nothing is parsed.
+bool csv_index(const char* path, const CSVOptions* options,
+               size_t chunk_rows, CSVIndex* index)
+{
+    CSVOptions opts = options!=NULL? *options: csv_default_options();
+    const char* data;
+    const char* begin;
+    const char* end;
+    const char* next;
+    size_t size, capacity = 16;
+
+    memset(index, 0, sizeof(CSVIndex));
+    if (chunk_rows==0)
+    {
+        perror("ERROR: Chunks must have at least one row.");
+        return false;
+    }
+    data = map_file(path, &size);
+    if (data==NULL)
+        return false;
+    begin = data;
+    end = data + size;
+    if (!csv_layout(&begin, end, &opts, &(index->n_cols), &(index->target)))
+    {
+        munmap((void*)data, size);
+        return false;
+    }
+
+    index->delimiter = opts.delimiter;
+    index->chunk_rows = chunk_rows;
+    index->chunk_offsets = (size_t *)malloc(capacity*sizeof(size_t));
+    for (const char* p=begin; p<end; p=next)
+    {
+        const char* stop = line_end(p, end, &next);
+        if (blank_line(p, stop))
+            continue;
+        if (index->n_rows%chunk_rows==0)
+        {
+            if (index->n_chunks+2>capacity)
+            {
+                capacity *= 2;
+                index->chunk_offsets = (size_t *)realloc(index->chunk_offsets,
+                                            capacity*sizeof(size_t));
+            }
+            index->chunk_offsets[index->n_chunks++] = (size_t)(p-data);
+        }
+        index->n_rows++;
+    }
+    index->chunk_offsets[index->n_chunks] = size;
+    munmap((void*)data, size);
+
+    if (index->n_rows==0)
+    {
+        perror("ERROR: CSV file has no data rows.");
+        csv_index_destroy(index);
+        return false;
+    }
+    return true;
+}
+
+// Free a CSV index
+void csv_index_destroy(CSVIndex* index)
+{
+    if (index==NULL)
+        return;
+    free(index->chunk_offsets);
+    index->chunk_offsets = NULL;
+    index->n_chunks = 0;
+}
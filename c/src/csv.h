@@ -0,0 +1,58 @@
+// Multi-threaded loading of CSV files into matrices
+
+#ifndef _CSV_H_
+#define _CSV_H_
+
+#include <stdbool.h>
+#include "matrix.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Options for csv_load. A first line that does not start with a
+// number is taken to be a header and skipped.
+typedef struct
+{
+    char delimiter;
+    long target_column;      // Column for y, negative counts from the end
+    unsigned int n_threads;  // 0 uses all online processors
+} CSVOptions;
+
+// Statistics of a csv_load call
+typedef struct
+{
+    size_t n_rows, n_cols;
+    size_t bytes;
+    double seconds;
+    double mb_per_s;
+} CSVStats;
+
+// Byte offsets of the chunks of a CSV file (see csv_index).
+// Chunk k holds rows [k*chunk_rows, (k+1)*chunk_rows) and spans the
+// bytes [chunk_offsets[k], chunk_offsets[k+1]).
+typedef struct
+{
+    char delimiter;
+    size_t n_rows, n_cols, target;
+    size_t chunk_rows, n_chunks;
+    size_t* chunk_offsets;  // n_chunks + 1 entries
+} CSVIndex;
+
+CSVOptions csv_default_options(void);
+bool csv_load(const char* path, const CSVOptions* options,
+              Matrix* x, Matrix* y, CSVStats* stats);
+double csv_parse_double(const char* begin, const char* end,
+                        const char** next);
+bool csv_parse_rows(const char* begin, const char* end, char delimiter,
+                    size_t n_cols, size_t target,
+                    Matrix* x, Matrix* y, size_t first_row);
+bool csv_index(const char* path, const CSVOptions* options,
+               size_t chunk_rows, CSVIndex* index);
+void csv_index_destroy(CSVIndex* index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _CSV_H_
@@ -0,0 +1,336 @@
+// Binary dataset files for training input
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "matrix.h"
+#include "dataset.h"
+
+// Bytes per stored element
+static size_t dtype_size(DatasetDType dtype)
+{
+    return dtype==DATASET_F32? sizeof(float): sizeof(double);
+}
+
+static size_t align_up(size_t offset)
+{
+    return (offset + DATASET_ALIGN - 1) / DATASET_ALIGN * DATASET_ALIGN;
+}
+
+// Offset of the statistics block and of X
+static size_t stats_offset(void)
+{
+    return sizeof(DatasetHeader);
+}
+
+static size_t x_offset(size_t n_features)
+{
+    return align_up(stats_offset() + (2*n_features + 2)*sizeof(double));
+}
+
+// Write "n_elem" doubles from "data" to "file" in the given dtype
+static bool write_values(FILE* file, const double* data, size_t n_elem,
+                         DatasetDType dtype)
+{
+    float buffer[256];
+
+    if (dtype==DATASET_F64)
+        return fwrite(data, sizeof(double), n_elem, file)==n_elem;
+
+    for (size_t i=0; i<n_elem; i+=256)
+    {
+        size_t n = n_elem-i < 256? n_elem-i: 256;
+        for (size_t j=0; j<n; j++)
+            buffer[j] = (float)data[i+j];
+        if (fwrite(buffer, sizeof(float), n, file)!=n)
+            return false;
+    }
+    return true;
+}
+
+// Welford update of the running mean and squared deviations
+static void update_stats(double* mean, double* m2, double value, size_t count)
+{
+    double delta = value - *mean;
+    *mean += delta / (double)count;
+    *m2 += delta * (value - *mean);
+}
+
+// Open "path" for writing a dataset with "n_features" features
+bool dataset_writer_open(DatasetWriter* writer, const char* path,
+                         size_t n_features, DatasetDType dtype)
+{
+    writer->file = NULL;
+    writer->y_spool = NULL;
+    writer->means = NULL;
+    writer->m2 = NULL;
+    writer->dtype = dtype;
+    writer->n_samples = 0;
+    writer->n_features = n_features;
+
+    if (path==NULL || n_features==0
+            || (dtype!=DATASET_F64 && dtype!=DATASET_F32))
+    {
+        perror("ERROR: Invalid path, number of features or dtype for dataset.");
+        return false;
+    }
+
+    writer->file = fopen(path, "wb");
+    writer->y_spool = tmpfile();
+    writer->means = (double *)calloc(n_features+1, sizeof(double));
+    writer->m2 = (double *)calloc(n_features+1, sizeof(double));
+    if (writer->file==NULL || writer->y_spool==NULL
+            || writer->means==NULL || writer->m2==NULL
+            || fseek(writer->file, (long)x_offset(n_features), SEEK_SET)!=0)
+    {
+        perror("ERROR: Could not open dataset file for writing.");
+        if (writer->file!=NULL)
+            fclose(writer->file);
+        if (writer->y_spool!=NULL)
+            fclose(writer->y_spool);
+        free(writer->means);
+        free(writer->m2);
+        writer->file = NULL;
+        return false;
+    }
+    return true;
+}
+
+// Append the rows of x (M x n_features) and y (M x 1)
+bool dataset_writer_append(DatasetWriter* writer, Matrix* x, Matrix* y)
+{
+    size_t n_features = writer->n_features;
+
+    if (writer->file==NULL || x==NULL || y==NULL
+            || x->data==NULL || y->data==NULL)
+    {
+        perror("ERROR: Dataset writer is closed or arguments are null.");
+        return false;
+    }
+    if (x->ncols!=n_features || y->nrows!=x->nrows || y->ncols!=1)
+    {
+        perror("ERROR: Rows do not match the dimensions of the dataset.");
+        return false;
+    }
+
+    for (size_t i=0; i<x->nrows; i++)
+    {
+        const double* row = &(x->data[i*x->stride]);
+        double target = y->data[i*y->stride];
+        size_t count = writer->n_samples + i + 1;
+
+        if (!write_values(writer->file, row, n_features, writer->dtype)
+                || !write_values(writer->y_spool, &target, 1, writer->dtype))
+        {
+            perror("ERROR: Could not write to dataset file.");
+            return false;
+        }
+        for (size_t j=0; j<n_features; j++)
+            update_stats(&(writer->means[j]), &(writer->m2[j]), row[j], count);
+        update_stats(&(writer->means[n_features]), &(writer->m2[n_features]),
+                     target, count);
+    }
+    writer->n_samples += x->nrows;
+    return true;
+}
+
+// Write y, the statistics and the header, and close the file
+bool dataset_writer_close(DatasetWriter* writer)
+{
+    DatasetHeader header;
+    size_t n_features = writer->n_features;
+    size_t n_samples = writer->n_samples;
+    size_t elem = dtype_size(writer->dtype);
+    double* stats;
+    char buffer[65536];
+    size_t n_read;
+    bool ok = true;
+
+    if (writer->file==NULL)
+        return false;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DATASET_MAGIC, sizeof(DATASET_MAGIC));
+    header.version = DATASET_VERSION;
+    header.dtype = (uint32_t)writer->dtype;
+    header.n_samples = n_samples;
+    header.n_features = n_features;
+    header.x_offset = x_offset(n_features);
+    header.y_offset = align_up(header.x_offset + n_samples*n_features*elem);
+
+    // Means followed by (population) standard deviations; the
+    // entries for y come last
+    stats = (double *)calloc(2*n_features + 2, sizeof(double));
+    for (size_t j=0; j<=n_features && n_samples>0; j++)
+    {
+        size_t out = j<n_features? j: 2*n_features;
+        size_t out_std = j<n_features? n_features+j: 2*n_features+1;
+        stats[out] = writer->means[j];
+        stats[out_std] = sqrt(writer->m2[j] / (double)n_samples);
+    }
+
+    // y after the padding that follows X
+    ok = fseek(writer->file, (long)header.y_offset, SEEK_SET)==0;
+    rewind(writer->y_spool);
+    while (ok && (n_read = fread(buffer, 1, sizeof(buffer), writer->y_spool))>0)
+        ok = fwrite(buffer, 1, n_read, writer->file)==n_read;
+
+    ok = ok && fseek(writer->file, 0, SEEK_SET)==0
+            && fwrite(&header, sizeof(header), 1, writer->file)==1
+            && fwrite(stats, sizeof(double), 2*n_features+2, writer->file)
+                    ==2*n_features+2;
+    ok = fclose(writer->file)==0 && ok;
+    if (!ok)
+        perror("ERROR: Could not write dataset file.");
+
+    fclose(writer->y_spool);
+    free(stats);
+    free(writer->means);
+    free(writer->m2);
+    writer->file = NULL;
+    writer->y_spool = NULL;
+    writer->means = NULL;
+    writer->m2 = NULL;
+    return ok;
+}
+
+// Write x and y to a dataset file in one go
+bool dataset_save(const char* path, Matrix* x, Matrix* y,
+                  DatasetDType dtype)
+{
+    DatasetWriter writer;
+
+    if (x==NULL || !dataset_writer_open(&writer, path, x->ncols, dtype))
+        return false;
+    if (!dataset_writer_append(&writer, x, y))
+    {
+        dataset_writer_close(&writer);
+        return false;
+    }
+    return dataset_writer_close(&writer);
+}
+
+// Whether "header" describes a well-formed dataset that fits in a
+// file of "file_size" bytes. The header comes from an untrusted file,
+// so every size computed from it is checked for wrap-around.
+bool dataset_header_valid(const DatasetHeader* header, size_t file_size)
+{
+    size_t elem = dtype_size((DatasetDType)header->dtype);
+    size_t x_bytes, y_bytes, x_end, y_end;
+
+    if (memcmp(header->magic, DATASET_MAGIC, sizeof(DATASET_MAGIC))!=0
+            || header->version!=DATASET_VERSION
+            || (header->dtype!=DATASET_F64 && header->dtype!=DATASET_F32)
+            || header->n_samples==0 || header->n_features==0)
+        return false;
+
+    // The statistics must fit in the file before x_offset is computed
+    if (header->n_features>file_size/(2*sizeof(double)))
+        return false;
+
+    if (__builtin_mul_overflow(header->n_samples, header->n_features, &x_bytes)
+            || __builtin_mul_overflow(x_bytes, elem, &x_bytes)
+            || __builtin_mul_overflow(header->n_samples, elem, &y_bytes)
+            || __builtin_add_overflow(header->x_offset, x_bytes, &x_end)
+            || __builtin_add_overflow(header->y_offset, y_bytes, &y_end))
+        return false;
+
+    return header->x_offset==x_offset(header->n_features)
+            && header->y_offset>=x_end
+            && y_end<=file_size;
+}
+
+// Map a dataset file into memory. Nothing is read or copied up
+// front; pages are faulted in as the solvers touch them.
+bool dataset_open(Dataset* dataset, const char* path)
+{
+    const DatasetHeader* header;
+    const double* stats;
+    struct stat file_stat;
+    int fd;
+
+    memset(dataset, 0, sizeof(Dataset));
+
+    fd = open(path, O_RDONLY);
+    if (fd<0)
+    {
+        perror("ERROR: Could not open dataset file.");
+        return false;
+    }
+    if (fstat(fd, &file_stat)!=0 || (size_t)file_stat.st_size<sizeof(DatasetHeader))
+    {
+        perror("ERROR: Dataset file is too small.");
+        close(fd);
+        return false;
+    }
+
+    dataset->map_size = (size_t)file_stat.st_size;
+    dataset->map = mmap(NULL, dataset->map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (dataset->map==MAP_FAILED)
+    {
+        perror("ERROR: Could not map dataset file.");
+        dataset->map = NULL;
+        return false;
+    }
+
+    // Validate the header before trusting any offset in it
+    header = (const DatasetHeader*)dataset->map;
+    if (!dataset_header_valid(header, dataset->map_size))
+    {
+        perror("ERROR: Not a valid dataset file.");
+        dataset_close(dataset);
+        return false;
+    }
+
+    dataset->dtype = (DatasetDType)header->dtype;
+    dataset->n_samples = header->n_samples;
+    dataset->n_features = header->n_features;
+
+    // Read-only views, the mapping is shared and never copied
+    if (dataset->dtype==DATASET_F64)
+    {
+        dataset->x.data = (double*)((char*)dataset->map + header->x_offset);
+        dataset->x.nrows = dataset->n_samples;
+        dataset->x.ncols = dataset->x.stride = dataset->n_features;
+        dataset->y.data = (double*)((char*)dataset->map + header->y_offset);
+        dataset->y.nrows = dataset->n_samples;
+        dataset->y.ncols = dataset->y.stride = 1;
+    }
+    else
+    {
+        dataset->x_f.data = (float*)((char*)dataset->map + header->x_offset);
+        dataset->x_f.nrows = dataset->n_samples;
+        dataset->x_f.ncols = dataset->x_f.stride = dataset->n_features;
+        dataset->y_f.data = (float*)((char*)dataset->map + header->y_offset);
+        dataset->y_f.nrows = dataset->n_samples;
+        dataset->y_f.ncols = dataset->y_f.stride = 1;
+    }
+
+    stats = (const double*)((const char*)dataset->map + stats_offset());
+    dataset->feature_means.data = (double*)stats;
+    dataset->feature_stds.data = (double*)&stats[dataset->n_features];
+    dataset->feature_means.nrows = dataset->feature_stds.nrows = 1;
+    dataset->feature_means.ncols = dataset->feature_stds.ncols = dataset->n_features;
+    dataset->feature_means.stride = dataset->feature_stds.stride = dataset->n_features;
+    dataset->y_mean = stats[2*dataset->n_features];
+    dataset->y_std = stats[2*dataset->n_features+1];
+    return true;
+}
+
+// Unmap a dataset file. Views taken from it become invalid.
+void dataset_close(Dataset* dataset)
+{
+    if (dataset==NULL)
+        return;
+    if (dataset->map!=NULL)
+        munmap(dataset->map, dataset->map_size);
+    memset(dataset, 0, sizeof(Dataset));
+}
@@ -0,0 +1,87 @@
+// Binary dataset files for training input
+
+#ifndef _DATASET_H_
+#define _DATASET_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// File layout (version 1, native byte order):
+//     DatasetHeader                          (48 bytes)
+//     feature means, feature stds            (2 x n_features doubles)
+//     y mean, y std                          (2 doubles)
+//     X, row-major n_samples x n_features    (at x_offset, 64-byte aligned)
+//     y, n_samples                           (at y_offset, 64-byte aligned)
+// X and y are stored in the dtype of the file; the statistics are
+// always double precision.
+#define DATASET_MAGIC "LRSGDDS"
+#define DATASET_VERSION 1
+#define DATASET_ALIGN 64
+
+typedef enum
+{
+    DATASET_F64 = 0,
+    DATASET_F32 = 1
+} DatasetDType;
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t dtype;
+    uint64_t n_samples, n_features;
+    uint64_t x_offset, y_offset;  // In bytes from the start of the file
+} DatasetHeader;
+
+// Writer appending rows to a dataset file. The number of samples
+// need not be known up front: X is streamed to the file, y is
+// spooled to a temporary file, and the header, statistics and y
+// are written by dataset_writer_close.
+typedef struct
+{
+    FILE* file;
+    FILE* y_spool;
+    DatasetDType dtype;
+    size_t n_samples, n_features;
+    double* means;   // Running means (Welford), n_features + 1 (y last)
+    double* m2;      // Running sums of squared deviations
+} DatasetWriter;
+
+// Dataset file mapped into memory. x and y (or x_f and y_f for
+// single precision files) are read-only views of the mapping: they
+// share the page cache with every other process reading the file,
+// and writing through them is an error. feature_means and
+// feature_stds are 1 x n_features views of the stored statistics.
+typedef struct
+{
+    DatasetDType dtype;
+    size_t n_samples, n_features;
+    Matrix x, y;
+    FMatrix x_f, y_f;
+    Matrix feature_means, feature_stds;
+    double y_mean, y_std;
+    void* map;
+    size_t map_size;
+} Dataset;
+
+bool dataset_writer_open(DatasetWriter* writer, const char* path,
+                         size_t n_features, DatasetDType dtype);
+bool dataset_writer_append(DatasetWriter* writer, Matrix* x, Matrix* y);
+bool dataset_writer_close(DatasetWriter* writer);
+bool dataset_save(const char* path, Matrix* x, Matrix* y,
+                  DatasetDType dtype);
+bool dataset_header_valid(const DatasetHeader* header, size_t file_size);
+bool dataset_open(Dataset* dataset, const char* path);
+void dataset_close(Dataset* dataset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _DATASET_H_
@@ -1,76 +1,207 @@
 // Helper functions
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "matrix.h"
+#include "random.h"
+#include "dataset.h"
 #include "helpers.h"
 
+// Rows generated per chunk when writing a dataset file
+#define REGRESSION_CHUNK_ROWS 65536
+#define REGRESSION_MAX_THREADS 64
+
+// Parameters of a synthetic linear regression problem, drawn from
+// stream 0 of the seed:
+//     x[i][j] = means[j] + stds[j] * z,  z ~ N(0, 1)
+//     y[i]    = x[i] coeff + bias + noise_intensity * z'
+// with means and stds in [0.5, 10.5) and coeff in [-25, 25).
+typedef struct
+{
+    size_t n_features;
+    double bias, noise_intensity;
+    unsigned int seed;
+    double* means;
+    double* stds;
+    double* coeff;
+} RegressionModel;
+
+// Rows [begin, end) of the dataset, stored from row "begin - first"
+// of x and y
+typedef struct
+{
+    const RegressionModel* model;
+    Matrix* x;
+    Matrix* y;
+    size_t first, begin, end;
+} RegressionTask;
+
+static void regression_model_init(RegressionModel* model, size_t n_features,
+                                  double bias, double noise_intensity,
+                                  unsigned int seed)
+{
+    RandomStream rng;
+
+    model->n_features = n_features;
+    model->bias = bias;
+    model->noise_intensity = noise_intensity;
+    model->seed = seed;
+    model->means = (double *)malloc(3*n_features*sizeof(double));
+    model->stds = &(model->means[n_features]);
+    model->coeff = &(model->means[2*n_features]);
+
+    random_init(&rng, seed, 0);
+    for (size_t j=0; j<n_features; j++)
+    {
+        model->means[j] = 0.5 + 10.0*random_uniform(&rng);
+        model->stds[j] = 0.5 + 10.0*random_uniform(&rng);
+        model->coeff[j] = 50.0*random_uniform(&rng) - 25.0;
+    }
+}
+
+// Row i of the dataset is drawn from stream i+1 of the seed, so a
+// row is the same whichever thread or chunk generates it
+static void* regression_rows(void* arg)
+{
+    const RegressionTask* task = (const RegressionTask*)arg;
+    const RegressionModel* model = task->model;
+    size_t n = model->n_features;
+    RandomStream rng;
+    double noise;
+
+    for (size_t i=task->begin; i<task->end; i++)
+    {
+        double* row = &(task->x->data[(i-task->first)*task->x->stride]);
+        double target = model->bias;
+
+        random_init(&rng, model->seed, (uint64_t)i+1);
+        random_normal_fill(&rng, row, n);
+        random_normal_fill(&rng, &noise, 1);
+        for (size_t j=0; j<n; j++)
+        {
+            row[j] = model->means[j] + model->stds[j]*row[j];
+            target += row[j]*model->coeff[j];
+        }
+        task->y->data[(i-task->first)*task->y->stride] =
+                target + model->noise_intensity*noise;
+    }
+    return NULL;
+}
+
+// Generate rows [first, first + x->nrows) into x and y, splitting
+// the rows over all online processors
+static void regression_generate(const RegressionModel* model, size_t first,
+                                Matrix* x, Matrix* y)
+{
+    RegressionTask tasks[REGRESSION_MAX_THREADS];
+    pthread_t threads[REGRESSION_MAX_THREADS];
+    bool started[REGRESSION_MAX_THREADS];
+    unsigned int n_threads = (unsigned int)sysconf(_SC_NPROCESSORS_ONLN);
+    size_t n_rows = x->nrows, rows_per_thread;
+
+    if (n_threads<1)
+        n_threads = 1;
+    if (n_threads>REGRESSION_MAX_THREADS)
+        n_threads = REGRESSION_MAX_THREADS;
+    if (n_rows<n_threads)
+        n_threads = 1;
+
+    rows_per_thread = (n_rows + n_threads - 1) / n_threads;
+    for (unsigned int t=0; t<n_threads; t++)
+    {
+        size_t begin = t*rows_per_thread < n_rows? t*rows_per_thread: n_rows;
+        size_t end = (t+1)*rows_per_thread < n_rows? (t+1)*rows_per_thread: n_rows;
+
+        tasks[t].model = model;
+        tasks[t].x = x;
+        tasks[t].y = y;
+        tasks[t].first = first;
+        tasks[t].begin = first + begin;
+        tasks[t].end = first + end;
+        started[t] = false;
+    }
+
+    // The calling thread takes the first range
+    for (unsigned int t=1; t<n_threads; t++)
+        started[t] = pthread_create(&threads[t], NULL,
+                                    regression_rows, &tasks[t])==0;
+    regression_rows(&tasks[0]);
+    for (unsigned int t=1; t<n_threads; t++)
+    {
+        if (started[t])
+            pthread_join(threads[t], NULL);
+        else
+            regression_rows(&tasks[t]);
+    }
+}
+
 // Make a dataset for solving a linear regression problem.
-// The data is generated as y = x * coeff + noise + bias
+// The data is generated as y = x * coeff + noise + bias, with
+// Gaussian features and noise (see RegressionModel). Rows are
+// generated in parallel straight into x and y, no temporaries of
+// the size of the dataset are allocated.
 void make_regression_dataset(Matrix* x, 
                              Matrix* y, 
                              double bias,
                              double noise_intensity,
                              unsigned int seed)
 {
-    Matrix prod;
-    Matrix noise_mean = mat_create(1, 1);
-    Matrix noise_std = mat_create(1, 1);
-    Matrix means = mat_create(x->ncols, 1);
-    Matrix stds = mat_create(x->ncols, 1);
-    Matrix coeff = mat_create(x->ncols, 1);
-    Matrix bias_vec = mat_create(x->nrows, 1);
-    Matrix noise_vec = mat_create(x->nrows, 1);
+    RegressionModel model;
 
     // Ensure that y has same number of rows as x
     if (x->nrows != y->nrows || y->ncols != 1)
     {
         perror("ERROR: Dimensions of y must be M x 1 (if dim(X) = M x N)");
-        mat_destroy(&bias_vec);
-        mat_destroy(&noise_vec);
-        mat_destroy(&coeff);
         return;
     }
+    if (x->data==NULL || y->data==NULL)
+        return;
+
+    regression_model_init(&model, x->ncols, bias, noise_intensity, seed);
+    regression_generate(&model, 0, x, y);
+    free(model.means);
+}
+
+// Write a synthetic dataset of "n_samples" rows to a dataset file.
+// The rows are the ones make_regression_dataset generates with the
+// same arguments. They are generated chunk by chunk, so memory use
+// does not depend on the number of samples.
+bool make_regression_file(const char* path,
+                          size_t n_samples, size_t n_features,
+                          double bias, double noise_intensity,
+                          unsigned int seed, DatasetDType dtype)
+{
+    RegressionModel model;
+    DatasetWriter writer;
+    size_t chunk_rows = n_samples<REGRESSION_CHUNK_ROWS?
+                        n_samples: REGRESSION_CHUNK_ROWS;
+    Matrix x, y;
+    bool ok = true;
+
+    if (n_samples==0 || !dataset_writer_open(&writer, path, n_features, dtype))
+        return false;
+
+    regression_model_init(&model, n_features, bias, noise_intensity, seed);
+    x = mat_create(chunk_rows, n_features);
+    y = mat_create(chunk_rows, 1);
+    for (size_t first=0; ok && first<n_samples; first+=chunk_rows)
+    {
+        size_t rows = n_samples-first < chunk_rows? n_samples-first: chunk_rows;
+        Matrix x_chunk = mat_view(&x, 0, 0, rows, n_features);
+        Matrix y_chunk = mat_view(&y, 0, 0, rows, 1);
+
+        regression_generate(&model, first, &x_chunk, &y_chunk);
+        ok = dataset_writer_append(&writer, &x_chunk, &y_chunk);
+    }
+    ok = dataset_writer_close(&writer) && ok;
 
-    // Generate x matrix
-    mat_fill_random(&means, seed);
-    mat_scale(&means, 10.0);
-    mat_fill_random(&stds, seed);
-    mat_scale(&stds, 10.0);
-    mat_fill_random_gaussian(x, &means, &stds, seed);
-
-    // Generate bias array
-    mat_fill(&bias_vec, bias);
-
-    // Generate noise array
-    mat_fill(&noise_mean, 0.0);
-    mat_fill(&noise_std, 1.0);
-    mat_fill_random_gaussian(&noise_vec, &noise_mean, &noise_std, seed);
-    mat_scale(&noise_vec, noise_intensity);
-
-    // Generate coefficients to be between -25.0 and 25.0
-    mat_fill_random(&coeff, seed);
-    mat_scale(&coeff, 50.0);
-    mat_add_scalar(&coeff, -25.0);
-
-    // Generate y = x coeff + bias + noise
-    prod = mat_mul(x, false, &coeff, false);
-    mat_add(&prod, &bias_vec);
-    mat_add(&prod, &noise_vec);
-
-    mat_copy_inplace(&prod, y);
-
-    // Delete means and stds
-    mat_destroy(&means);
-    mat_destroy(&stds);
-    mat_destroy(&noise_mean);
-    mat_destroy(&noise_std);
-
-    // Delete coefficients, noise_vec, prod and bias_vec
-    mat_destroy(&noise_vec);
-    mat_destroy(&bias_vec);
-    mat_destroy(&prod);
-    mat_destroy(&coeff);
+    mat_destroy(&x);
+    mat_destroy(&y);
+    free(model.means);
+    return ok;
 }
 
 // Split x_train and y_train into training and test sets
@@ -104,6 +235,7 @@ void split_into_train_test(Matrix* x, Matrix* y,
         return;
     }
     
+    unsigned int n_threads = (unsigned int)sysconf(_SC_NPROCESSORS_ONLN);
     IntMatrix rand_idxs = intmat_create(x->nrows, 1);
     IntMatrix train_idxs = intmat_create(x_train->nrows, 1);
     IntMatrix test_idxs = intmat_create(x_test->nrows, 1);
@@ -119,12 +251,12 @@ void split_into_train_test(Matrix* x, Matrix* y,
     intmat_gather(&rand_idxs, &train_idxs, &range_idxs, 0);
     
     // Fill x_test and y_test
-    mat_gather(x, x_test, &test_idxs, 0);
-    mat_gather(y, y_test, &test_idxs, 0);
+    mat_gather_rows(x, x_test, &test_idxs, n_threads);
+    mat_gather_rows(y, y_test, &test_idxs, n_threads);
 
     // Fill x_train and y_train
-    mat_gather(x, x_train, &train_idxs, 0);
-    mat_gather(y, y_train, &train_idxs, 0);
+    mat_gather_rows(x, x_train, &train_idxs, n_threads);
+    mat_gather_rows(y, y_train, &train_idxs, n_threads);
 
     intmat_destroy(&rand_idxs);
     intmat_destroy(&train_idxs);
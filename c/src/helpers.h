@@ -2,13 +2,28 @@
 #define _HELPERS_H_
 
 #include <stdlib.h>
+#include <stdbool.h>
+#include "matrix.h"
+#include "dataset.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 void make_regression_dataset(Matrix* x, Matrix* y,
                              double bias, double noise_intensity,
                              unsigned int seed);
+bool make_regression_file(const char* path,
+                          size_t n_samples, size_t n_features,
+                          double bias, double noise_intensity,
+                          unsigned int seed, DatasetDType dtype);
 void split_into_train_test(Matrix* x, Matrix* y,
                            Matrix* x_train, Matrix* y_train,
                            Matrix* x_test, Matrix* y_test,
                            unsigned int seed);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif // _HELPERS_H_
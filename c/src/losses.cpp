@@ -0,0 +1,200 @@
+// Loss functions in linear regression
+//
+// Written on top of the expression templates of matrix_expr.hpp,
+// so elementwise work is fused into single loops and products go
+// straight to BLAS without temporaries. The functions keep C
+// linkage (see losses.h).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cblas.h>
+#include "matrix.h"
+#include "matrix_expr.hpp"
+#include "losses.h"
+
+using mx::Mat;
+using mx::MatRef;
+using mx::t;
+
+// l2 loss = ||y_true - y_pred||^2/N
+// where y_true is ground truth,
+// y_pred is predicted values and N is the 
+// number of observations.
+double l2_loss(Matrix* y_true, Matrix* y_pred)
+{
+    // loss = ||y_true - y_pred||^2, in one pass
+    return mx::sum_sq(MatRef(*y_true) - MatRef(*y_pred)) / y_pred->nrows;
+}
+ 
+// Gradient of the L2 loss with respect to theta (coefficients)
+// given by gradient = X.T (X theta - y)
+Matrix l2_gradient(Matrix* x, Matrix* y, Matrix* theta)
+{
+    MatRef x_ref(*x);
+
+    // One dgemv each, the residual is the only temporary
+    Mat residual(x_ref * MatRef(*theta) - MatRef(*y));
+    Mat grad(t(x_ref) * residual);
+
+    return grad.release();
+}
+
+// Fused L2 loss and gradient. The residual r = X theta - y is
+// computed once and both quantities are derived from it:
+//     loss = ||r||^2/N  (returned)
+//     grad = X.T r      (written into grad)
+// residual (N x 1) and grad (n_features x 1) are caller-provided
+// buffers, so no temporaries are allocated.
+double l2_loss_gradient(Matrix* x, Matrix* y, Matrix* theta,
+                        Matrix* residual, Matrix* grad)
+{
+    return l2_loss_gradient_centered(x, y, NULL, theta, residual, grad);
+}
+
+// Offset of the centered residual from the uncentered one,
+// y_mean - x_mean theta (0 without centering):
+//     (X - 1 x_mean^T) theta - (y - y_mean) = X theta - y + offset
+double centering_offset(const Centering* centering, Matrix* theta)
+{
+    if (centering==NULL)
+        return 0.0;
+    return centering->y_mean - ddot_64(theta->nrows,
+                    centering->x_mean->data, 1,
+                    theta->data, theta->stride);
+}
+
+// Fused L2 loss and gradient of the implicitly centered problem
+// (see Centering). With the offset c = y_mean - x_mean theta,
+//     r    = X theta - y + c
+//     grad = (X - 1 x_mean^T)^T r = X^T r - x_mean^T sum(r)
+// which are the residual and gradient of the centered data, at the
+// cost of one dot product and one axpy of length n_features.
+double l2_loss_gradient_centered(Matrix* x, Matrix* y,
+                                 const Centering* centering, Matrix* theta,
+                                 Matrix* residual, Matrix* grad)
+{
+    double offset, residual_sum = 0.0;
+
+    if (x==NULL || y==NULL || theta==NULL || residual==NULL || grad==NULL)
+    {
+        perror("ERROR: Null pointers in array arguments.");
+        return 0.0;
+    }
+    if (y->nrows!=x->nrows || y->ncols!=1 || theta->nrows!=x->ncols
+            || theta->ncols!=1 || residual->nrows!=x->nrows
+            || residual->ncols!=1 || grad->nrows!=x->ncols
+            || grad->ncols!=1)
+    {
+        perror("ERROR: Arrays do not match expected dimensions.");
+        return 0.0;
+    }
+    if (centering!=NULL && (centering->x_mean->nrows!=1
+            || centering->x_mean->ncols!=x->ncols))
+    {
+        perror("ERROR: Centering means do not match the number of features.");
+        return 0.0;
+    }
+
+    MatRef x_ref(*x), r(*residual), g(*grad);
+
+    // residual = X theta - y + offset
+    offset = centering_offset(centering, theta);
+    r = x_ref * MatRef(*theta) - MatRef(*y);
+    if (centering!=NULL)
+    {
+        r += offset;
+        residual_sum = mx::sum(r);
+    }
+
+    // grad = X.T residual - x_mean.T sum(residual)
+    g = t(x_ref) * r;
+    if (centering!=NULL)
+        g -= residual_sum * t(MatRef(*centering->x_mean));
+
+    return mx::sum_sq(r) / x->nrows;
+}
+
+/************************************************************/
+/*****************Single precision variants******************/
+/************************************************************/
+
+// l2 loss for single precision data (see l2_loss)
+double l2_loss_float(FMatrix* y_true, FMatrix* y_pred)
+{
+    double loss = 0.0;
+
+    for (size_t i=0; i<y_true->nrows; i++)
+        for (size_t j=0; j<y_true->ncols; j++)
+        {
+            double diff = (double)y_true->data[i*y_true->stride+j]
+                            - (double)y_pred->data[i*y_pred->stride+j];
+            loss += diff * diff;
+        }
+
+    return loss / y_pred->nrows;
+}
+
+// Gradient of the L2 loss for single precision data,
+// gradient = X.T (X theta - y) via cblas_sgemm
+FMatrix l2_gradient_float(FMatrix* x, FMatrix* y, FMatrix* theta)
+{
+    FMatrix grad, x_theta_prod;
+
+    x_theta_prod = fmat_mul(x, false, theta, false);
+    fmat_sub(&x_theta_prod, y);
+    grad = fmat_mul(x, true, &x_theta_prod, false);
+
+    fmat_destroy(&x_theta_prod);
+
+    return grad;
+}
+
+/************************************************************/
+/***********Solver callbacks (see LossFunctions)*************/
+/************************************************************/
+
+// L2 loss callback
+double l2_loss_fn(Matrix* y_true, Matrix* y_pred,
+                  MatArena* workspace, void* ctx)
+{
+    (void)workspace;
+    (void)ctx;
+    return l2_loss(y_true, y_pred);
+}
+
+// Fused L2 loss and gradient callback, the residual
+// lives in the workspace
+double l2_loss_gradient_fn(Matrix* x, Matrix* y, const Centering* centering,
+                           Matrix* theta, Matrix* grad,
+                           MatArena* workspace, void* ctx)
+{
+    Matrix residual;
+    double loss;
+
+    (void)ctx;
+    residual = workspace!=NULL? mat_arena_alloc(workspace, x->nrows, 1)
+                              : mat_create(x->nrows, 1);
+    loss = l2_loss_gradient_centered(x, y, centering, theta, &residual, grad);
+    mat_destroy(&residual);
+
+    return loss;
+}
+
+// L2 gradient callback
+void l2_gradient_fn(Matrix* x, Matrix* y, const Centering* centering,
+                    Matrix* theta, Matrix* grad,
+                    MatArena* workspace, void* ctx)
+{
+    l2_loss_gradient_fn(x, y, centering, theta, grad, workspace, ctx);
+}
+
+// Callbacks for the L2 loss
+LossFunctions l2_loss_functions(void)
+{
+    LossFunctions fns;
+    fns.loss_fn = &l2_loss_fn;
+    fns.grad_fn = &l2_gradient_fn;
+    fns.loss_grad_fn = &l2_loss_gradient_fn;
+    fns.ctx = NULL;
+    return fns;
+}
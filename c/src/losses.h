@@ -3,7 +3,75 @@
 
 #include "matrix.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Implicit centering of the data passed to the gradient callbacks:
+// they must compute the gradient for X - 1 x_mean^T and y - y_mean
+// without forming either. Centering reduces y = x theta + b to
+// y = x theta, and since the loss folds the means into the residual
+// and gradient, the solvers fit the intercept while reading the
+// caller's X directly, never copying it. A NULL Centering means the
+// data is used as is.
+typedef struct
+{
+    const Matrix* x_mean;   // 1 x n_features
+    double y_mean;
+} Centering;
+
+// Loss function callbacks used by the solvers. Gradients are
+// written into "grad"; temporaries should be drawn from
+// "workspace", which the solver resets every iteration. "ctx" is
+// the user context pointer of the LossFunctions they belong to.
+// loss_fn compares uncentered values; the solvers shift y_pred by
+// y_mean - x_mean theta so that its residuals are the centered ones.
+typedef double (*loss_fn_type)(Matrix* y_true, Matrix* y_pred,
+                               MatArena* workspace, void* ctx);
+typedef void (*grad_fn_type)(Matrix* x, Matrix* y,
+                             const Centering* centering, Matrix* theta,
+                             Matrix* grad, MatArena* workspace,
+                             void* ctx);
+typedef double (*loss_grad_fn_type)(Matrix* x, Matrix* y,
+                                    const Centering* centering,
+                                    Matrix* theta, Matrix* grad,
+                                    MatArena* workspace, void* ctx);
+
+// A loss for the solvers. loss_grad_fn is optional; if set, it
+// returns the loss and writes the gradient in a single call and
+// is used instead of loss_fn and grad_fn.
+typedef struct
+{
+    loss_fn_type loss_fn;
+    grad_fn_type grad_fn;
+    loss_grad_fn_type loss_grad_fn;
+    void* ctx;
+} LossFunctions;
+
 double l2_loss(Matrix* y_true, Matrix* y_pred);
 Matrix l2_gradient(Matrix* x, Matrix* y, Matrix* theta);
+double l2_loss_gradient(Matrix* x, Matrix* y, Matrix* theta,
+                        Matrix* residual, Matrix* grad);
+double l2_loss_gradient_centered(Matrix* x, Matrix* y,
+                                 const Centering* centering, Matrix* theta,
+                                 Matrix* residual, Matrix* grad);
+double centering_offset(const Centering* centering, Matrix* theta);
+double l2_loss_fn(Matrix* y_true, Matrix* y_pred,
+                  MatArena* workspace, void* ctx);
+void l2_gradient_fn(Matrix* x, Matrix* y, const Centering* centering,
+                    Matrix* theta, Matrix* grad,
+                    MatArena* workspace, void* ctx);
+double l2_loss_gradient_fn(Matrix* x, Matrix* y, const Centering* centering,
+                           Matrix* theta, Matrix* grad,
+                           MatArena* workspace, void* ctx);
+LossFunctions l2_loss_functions(void);
+
+// Single precision variants. Sums are accumulated in double.
+double l2_loss_float(FMatrix* y_true, FMatrix* y_pred);
+FMatrix l2_gradient_float(FMatrix* x, FMatrix* y, FMatrix* theta);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif // _LOSSES_H_
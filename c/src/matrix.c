@@ -2,11 +2,21 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <cblas.h>
 #include <time.h>
 #include <stdbool.h>
 #include <math.h>
+#include <float.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "matrix.h"
+#include "random.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define IGEMM_X86
+#endif
 
 
 /************************************************************/
@@ -20,8 +30,8 @@
 /************************************************************/
 
 // Scales a vector x := alpha * x. (?scal)
-void iscal(const unsigned int num_elem, const int alpha,
-           int *x, const unsigned int incx)
+void iscal(const size_t num_elem, const int alpha,
+           int *x, const size_t incx)
 {
     if (x==NULL || incx==0)
         return;
@@ -30,9 +40,9 @@ void iscal(const unsigned int num_elem, const int alpha,
 }
 
 // Copies a vector y := x. (?copy)
-void icopy(const unsigned int num_elem, const int* x,
-           const unsigned int incx, int* y,
-           const unsigned int incy)
+void icopy(const size_t num_elem, const int* x,
+           const size_t incx, int* y,
+           const size_t incy)
 {
     if (x==NULL || y==NULL)
         return;
@@ -46,9 +56,9 @@ void icopy(const unsigned int num_elem, const int* x,
 
 // Scales a vector x and adds it to another vector y.(?axpy)
 // y := alpha * x + y
-void iaxpy(const unsigned int num_elem, const int alpha,
-           const int* x, const unsigned int incx,
-           int* y, const unsigned int incy)
+void iaxpy(const size_t num_elem, const int alpha,
+           const int* x, const size_t incx,
+           int* y, const size_t incy)
 {
     if (x==NULL || y==NULL)
         return;
@@ -60,6 +70,232 @@ void iaxpy(const unsigned int num_elem, const int alpha,
         y[i*incy] += alpha * x[i*incx];
 }
 
+// Blocking of igemm. A packed IGEMM_MR x IGEMM_KC panel of A and a
+// IGEMM_KC x IGEMM_NR panel of B fit in L1 together, a packed
+// IGEMM_MC x IGEMM_KC block of A fits in L2 and a IGEMM_KC x
+// IGEMM_NC block of B in L3. IGEMM_MC is a multiple of IGEMM_MR.
+#define IGEMM_MR 6
+#define IGEMM_NR 16
+#define IGEMM_KC 256
+#define IGEMM_MC 96
+#define IGEMM_NC 4096
+
+// Micro-kernel: C[0:mr, 0:nr] += A_panel B_panel, where the panels
+// are packed IGEMM_MR x kc and kc x IGEMM_NR (zero padded)
+typedef void (*igemm_kernel_fn)(size_t kc, const int* a, const int* b,
+                                int* c, size_t ldc, size_t mr, size_t nr);
+
+static size_t igemm_round_up(size_t x, size_t multiple)
+{
+    return (x + multiple - 1) / multiple * multiple;
+}
+
+// Pack rows [i0, i0+mc) and columns [l0, l0+kc) of alpha op(A) into
+// panels of IGEMM_MR rows stored column by column, the rows of the
+// last panel padded with zeros
+static void igemm_pack_a(bool trans, const int* a, size_t lda, int alpha,
+                         size_t i0, size_t mc, size_t l0, size_t kc,
+                         int* packed)
+{
+    for (size_t p=0; p<mc; p+=IGEMM_MR, packed+=IGEMM_MR*kc)
+    {
+        size_t rows = mc-p<IGEMM_MR? mc-p: IGEMM_MR;
+
+        if (trans)
+            for (size_t l=0; l<kc; l++)
+                for (size_t r=0; r<rows; r++)
+                    packed[l*IGEMM_MR+r] = alpha * a[(l0+l)*lda + i0+p+r];
+        else
+            for (size_t r=0; r<rows; r++)
+                for (size_t l=0; l<kc; l++)
+                    packed[l*IGEMM_MR+r] = alpha * a[(i0+p+r)*lda + l0+l];
+        for (size_t l=0; l<kc; l++)
+            for (size_t r=rows; r<IGEMM_MR; r++)
+                packed[l*IGEMM_MR+r] = 0;
+    }
+}
+
+// Pack rows [l0, l0+kc) and columns [j0, j0+nc) of op(B) into panels
+// of IGEMM_NR columns stored row by row, the columns of the last
+// panel padded with zeros
+static void igemm_pack_b(bool trans, const int* b, size_t ldb,
+                         size_t l0, size_t kc, size_t j0, size_t nc,
+                         int* packed)
+{
+    for (size_t q=0; q<nc; q+=IGEMM_NR, packed+=IGEMM_NR*kc)
+    {
+        size_t cols = nc-q<IGEMM_NR? nc-q: IGEMM_NR;
+
+        if (trans)
+            for (size_t j=0; j<cols; j++)
+                for (size_t l=0; l<kc; l++)
+                    packed[l*IGEMM_NR+j] = b[(j0+q+j)*ldb + l0+l];
+        else
+            for (size_t l=0; l<kc; l++)
+                for (size_t j=0; j<cols; j++)
+                    packed[l*IGEMM_NR+j] = b[(l0+l)*ldb + j0+q+j];
+        for (size_t l=0; l<kc; l++)
+            for (size_t j=cols; j<IGEMM_NR; j++)
+                packed[l*IGEMM_NR+j] = 0;
+    }
+}
+
+// Add the valid mr x nr part of a tile accumulated in memory to C
+static void igemm_add_tile(const int* tile, int* c, size_t ldc,
+                           size_t mr, size_t nr)
+{
+    for (size_t i=0; i<mr; i++)
+        for (size_t j=0; j<nr; j++)
+            c[i*ldc+j] += tile[i*IGEMM_NR+j];
+}
+
+// Portable micro-kernel
+static void igemm_kernel_generic(size_t kc, const int* a, const int* b,
+                                 int* c, size_t ldc, size_t mr, size_t nr)
+{
+    int tile[IGEMM_MR*IGEMM_NR] = {0};
+
+    for (size_t l=0; l<kc; l++)
+        for (size_t i=0; i<IGEMM_MR; i++)
+            for (size_t j=0; j<IGEMM_NR; j++)
+                tile[i*IGEMM_NR+j] += a[l*IGEMM_MR+i] * b[l*IGEMM_NR+j];
+    igemm_add_tile(tile, c, ldc, mr, nr);
+}
+
+#ifdef IGEMM_X86
+// AVX2 micro-kernel: each row of the tile is two 8-lane registers,
+// 12 accumulators in all
+__attribute__((target("avx2")))
+static void igemm_kernel_avx2(size_t kc, const int* a, const int* b,
+                              int* c, size_t ldc, size_t mr, size_t nr)
+{
+    __m256i acc[IGEMM_MR][2];
+
+    for (size_t i=0; i<IGEMM_MR; i++)
+        acc[i][0] = acc[i][1] = _mm256_setzero_si256();
+    for (size_t l=0; l<kc; l++)
+    {
+        __m256i b0 = _mm256_loadu_si256((const __m256i*)(b + l*IGEMM_NR));
+        __m256i b1 = _mm256_loadu_si256((const __m256i*)(b + l*IGEMM_NR + 8));
+
+        for (size_t i=0; i<IGEMM_MR; i++)
+        {
+            __m256i ai = _mm256_set1_epi32(a[l*IGEMM_MR+i]);
+            acc[i][0] = _mm256_add_epi32(acc[i][0], _mm256_mullo_epi32(ai, b0));
+            acc[i][1] = _mm256_add_epi32(acc[i][1], _mm256_mullo_epi32(ai, b1));
+        }
+    }
+
+    if (mr==IGEMM_MR && nr==IGEMM_NR)
+    {
+        for (size_t i=0; i<IGEMM_MR; i++)
+            for (size_t h=0; h<2; h++)
+            {
+                __m256i* ci = (__m256i*)(c + i*ldc + 8*h);
+                _mm256_storeu_si256(ci, _mm256_add_epi32(_mm256_loadu_si256(ci),
+                                                          acc[i][h]));
+            }
+    }
+    else
+    {
+        int tile[IGEMM_MR*IGEMM_NR];
+
+        for (size_t i=0; i<IGEMM_MR; i++)
+            for (size_t h=0; h<2; h++)
+                _mm256_storeu_si256((__m256i*)(tile + i*IGEMM_NR + 8*h), acc[i][h]);
+        igemm_add_tile(tile, c, ldc, mr, nr);
+    }
+}
+
+// AVX-512 micro-kernel: each row of the tile is one 16-lane register
+__attribute__((target("avx512f")))
+static void igemm_kernel_avx512(size_t kc, const int* a, const int* b,
+                                int* c, size_t ldc, size_t mr, size_t nr)
+{
+    __m512i acc[IGEMM_MR];
+
+    for (size_t i=0; i<IGEMM_MR; i++)
+        acc[i] = _mm512_setzero_si512();
+    for (size_t l=0; l<kc; l++)
+    {
+        __m512i bl = _mm512_loadu_si512((const void*)(b + l*IGEMM_NR));
+
+        for (size_t i=0; i<IGEMM_MR; i++)
+            acc[i] = _mm512_add_epi32(acc[i], _mm512_mullo_epi32(
+                            _mm512_set1_epi32(a[l*IGEMM_MR+i]), bl));
+    }
+
+    if (mr==IGEMM_MR && nr==IGEMM_NR)
+    {
+        for (size_t i=0; i<IGEMM_MR; i++)
+            _mm512_storeu_si512((void*)(c + i*ldc), _mm512_add_epi32(
+                            _mm512_loadu_si512((const void*)(c + i*ldc)), acc[i]));
+    }
+    else
+    {
+        int tile[IGEMM_MR*IGEMM_NR];
+
+        for (size_t i=0; i<IGEMM_MR; i++)
+            _mm512_storeu_si512((void*)(tile + i*IGEMM_NR), acc[i]);
+        igemm_add_tile(tile, c, ldc, mr, nr);
+    }
+}
+#endif // IGEMM_X86
+
+// Micro-kernels by IGemmKernel (unavailable ones fall back to the
+// portable kernel; igemm_set_kernel never selects them)
+static const igemm_kernel_fn igemm_kernels[] = {
+    igemm_kernel_generic,
+    igemm_kernel_generic,
+#ifdef IGEMM_X86
+    igemm_kernel_avx2,
+    igemm_kernel_avx512,
+#else
+    igemm_kernel_generic,
+    igemm_kernel_generic,
+#endif
+};
+
+// Micro-kernel in use, IGEMM_AUTO until the first igemm call or
+// igemm_set_kernel
+static int igemm_kernel_id = IGEMM_AUTO;
+
+// Fastest micro-kernel supported by the processor
+static IGemmKernel igemm_best_kernel(void)
+{
+#ifdef IGEMM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return IGEMM_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return IGEMM_AVX2;
+#endif
+    return IGEMM_GENERIC;
+}
+
+// Select the micro-kernel of igemm. IGEMM_AUTO, or a kernel the
+// processor does not support, selects the fastest supported one.
+// Returns the kernel selected.
+IGemmKernel igemm_set_kernel(IGemmKernel kernel)
+{
+    IGemmKernel best = igemm_best_kernel();
+
+    if (kernel==IGEMM_AUTO || kernel>best)
+        kernel = best;
+    __atomic_store_n(&igemm_kernel_id, (int)kernel, __ATOMIC_RELAXED);
+    return kernel;
+}
+
+// Micro-kernel in use, resolved on first use
+static IGemmKernel igemm_current_kernel(void)
+{
+    int id = __atomic_load_n(&igemm_kernel_id, __ATOMIC_RELAXED);
+
+    if (id==IGEMM_AUTO)
+        return igemm_set_kernel(IGEMM_AUTO);
+    return (IGemmKernel)id;
+}
+
 // General dense matrix multiplication for integer matrices. (?gemm)
 // C := alpha * op(A) op(B) + beta * C
 // Conventions for ?gemm in the BLAS standard are used.
@@ -67,17 +303,26 @@ void iaxpy(const unsigned int num_elem, const int alpha,
 // (e.g. "https://www.intel.com/content/www/us/en
 // /docs/onemkl/developer-reference-c/2023-1/cblas-gemm
 // -001.html#GUID-97718E5C-6E0A-44F0-B2B1-A551F0F164B2")
+//
+// The product is blocked as in Goto and van de Geijn, "Anatomy of
+// high-performance matrix multiplication" (TOMS 2008): KC x NC
+// blocks of op(B) and MC x KC blocks of alpha op(A) are packed into
+// contiguous panels, IGEMM_NR columns and IGEMM_MR rows wide, and a
+// micro-kernel accumulates each IGEMM_MR x IGEMM_NR tile of C in
+// registers. Transposition is absorbed by the packing. The
+// micro-kernel is chosen at run time (see igemm_set_kernel).
 void igemm(const CBLAS_TRANSPOSE transa, const CBLAS_TRANSPOSE transb, 
-        const unsigned int m, const unsigned int n, const unsigned int k, 
-        const int alpha, const int* a, const unsigned int lda, 
-        const int* b, const unsigned int ldb,
-        const int beta, int* c, const unsigned int ldc)
-{
-    int* a_trans = NULL;
-    int* b_trans = NULL;
-    unsigned int min_lda, min_ldb, min_ldc;
+        const size_t m, const size_t n, const size_t k, 
+        const int alpha, const int* a, const size_t lda, 
+        const int* b, const size_t ldb,
+        const int beta, int* c, const size_t ldc)
+{
+    size_t min_lda, min_ldb, min_ldc;
     bool a_transpose_p = transa==CblasTrans;
     bool b_transpose_p = transb==CblasTrans;
+    igemm_kernel_fn kernel;
+    int* packed_a;
+    int* packed_b;
 
     // Validation
     if (a==NULL || b==NULL || c==NULL)
@@ -95,7 +340,7 @@ void igemm(const CBLAS_TRANSPOSE transa, const CBLAS_TRANSPOSE transb,
         min_lda = m > 1? m: 1;
     else
         min_lda = k > 1? k: 1;
-    if (lda!=min_lda)
+    if (lda<min_lda)
     {
         perror("ERROR! Invalid LDA.");
         return;
@@ -104,92 +349,75 @@ void igemm(const CBLAS_TRANSPOSE transa, const CBLAS_TRANSPOSE transb,
         min_ldb = k > 1? k: 1;
     else
         min_ldb = n > 1? n: 1;
-    if (ldb!=min_ldb)
+    if (ldb<min_ldb)
     {
         perror("ERROR! Invalid LDB.");
         return;
     }
     min_ldc = n > 1? n: 1;
-    if (ldc!=min_ldc)
+    if (ldc<min_ldc)
     {
         perror("ERROR! Invalid LDC.");
         return;
     }
 
+    // C := beta * C, once. C is not read if beta is zero.
+    if (beta!=1)
+        for (size_t i=0; i<m; i++)
+            for (size_t j=0; j<n; j++)
+                c[i*ldc+j] = beta==0? 0: beta * c[i*ldc+j];
+
     // Quick return
-    if (alpha==0 && beta==1)
+    if (alpha==0 || m==0 || n==0 || k==0)
         return;
-    if (alpha==0)
+
+    kernel = igemm_kernels[igemm_current_kernel()];
+    packed_a = (int *)malloc(IGEMM_MC*IGEMM_KC*sizeof(int));
+    packed_b = (int *)malloc(igemm_round_up(n<IGEMM_NC? n: IGEMM_NC, IGEMM_NR)
+                             * IGEMM_KC*sizeof(int));
+    if (packed_a==NULL || packed_b==NULL)
     {
-        for (size_t i=0; i<ldc*m; i++)
-            c[i] *= beta;
+        perror("ERROR: Could not allocate packing buffers.");
+        free(packed_a);
+        free(packed_b);
         return;
     }
 
-    // Transpositions
-    if (a_transpose_p)
-    {
-        a_trans = (int *)calloc(m*k, sizeof(int));
-        for (size_t i=0; i<m; i++)
-            for (size_t j=0; j<k; j++)
-                a_trans[i*k+j] = a[j*lda+i];
-    }
-    if (b_transpose_p)
-    {
-        b_trans = (int *)calloc(n*k, sizeof(int));
-        for (size_t i=0; i<k; i++)
-            for (size_t j=0; j<n; j++)
-                b_trans[i*n+j] = b[j*ldb+i];
-    }
-    
-    // Matrix multiply
-    if (a_transpose_p && !b_transpose_p)
-    {
-        for (size_t i=0; i<m; ++i)
-            for (size_t j=0; j<n; ++j)
-                for (size_t l=0; l<k; ++l)
-                    c[i*ldc+j] += alpha * a_trans[i*k+l] * b[l*ldb+j] +\
-                                            beta * c[i*ldc+j];
-    }
-    else if (!a_transpose_p && b_transpose_p)
-    {
-        for (size_t i=0; i<m; ++i)
-            for (size_t j=0; j<n; ++j)
-                for (size_t l=0; l<k; ++l)
-                    c[i*ldc+j] += alpha * a[i*lda+l] * b_trans[l*n+j] +\
-                                            beta * c[i*ldc+j];
-    }
-    else if (a_transpose_p && b_transpose_p)
-    {
-        for (size_t i=0; i<m; ++i)
-            for (size_t j=0; j<n; ++j)
-                for (size_t l=0; l<k; ++l)
-                    c[i*ldc+j] += alpha * a_trans[i*k+l] * b_trans[l*n+j] +\
-                                            beta * c[i*ldc+j];
-    }
-    else
+    // C += (alpha op(A)) op(B), block by block
+    for (size_t jc=0; jc<n; jc+=IGEMM_NC)
     {
-        for (size_t i=0; i<m; ++i)
-            for (size_t j=0; j<n; ++j)
-                for (size_t l=0; l<k; ++l)
-                {
-                    c[i*ldc+j] += alpha * a[i*lda+l] * b[l*ldb+j] +\
-                                            beta * c[i*ldc+j];
-                }
+        size_t nc = n-jc<IGEMM_NC? n-jc: IGEMM_NC;
+
+        for (size_t pc=0; pc<k; pc+=IGEMM_KC)
+        {
+            size_t kc = k-pc<IGEMM_KC? k-pc: IGEMM_KC;
+
+            igemm_pack_b(b_transpose_p, b, ldb, pc, kc, jc, nc, packed_b);
+            for (size_t ic=0; ic<m; ic+=IGEMM_MC)
+            {
+                size_t mc = m-ic<IGEMM_MC? m-ic: IGEMM_MC;
+
+                igemm_pack_a(a_transpose_p, a, lda, alpha, ic, mc, pc, kc,
+                             packed_a);
+                for (size_t jr=0; jr<nc; jr+=IGEMM_NR)
+                    for (size_t ir=0; ir<mc; ir+=IGEMM_MR)
+                        kernel(kc, packed_a + ir*kc, packed_b + jr*kc,
+                               c + (ic+ir)*ldc + jc+jr, ldc,
+                               mc-ir<IGEMM_MR? mc-ir: IGEMM_MR,
+                               nc-jr<IGEMM_NR? nc-jr: IGEMM_NR);
+            }
+        }
     }
 
-    // Free transposed matrices
-    if (a_transpose_p)
-        free(a_trans);
-    if (b_transpose_p)
-        free(b_trans);
+    free(packed_a);
+    free(packed_b);
 }
 
 // Sparse BLAS-like function for gathering elements from a
 // sparse storage vector to a dense storage vector according
 // to supplied indices.
-void iusga(const unsigned int num_elem,
-           const int* y, const unsigned int incy,
+void iusga(const size_t num_elem,
+           const int* y, const size_t incy,
            int* x, const unsigned int* idxs)
 {
     if (x==NULL || y==NULL || idxs==NULL)
@@ -204,8 +432,8 @@ void iusga(const unsigned int num_elem,
 // Sparse BLAS-like function for gathering elements from a
 // sparse storage vector to a dense storage vector according
 // to supplied indices. Double precision arrays supported.
-void dusga(const unsigned int num_elem,
-           const double* y, const unsigned int incy,
+void dusga(const size_t num_elem,
+           const double* y, const size_t incy,
            double* x, const unsigned int* idxs)
 {
     if (x==NULL || y==NULL || idxs==NULL)
@@ -217,20 +445,396 @@ void dusga(const unsigned int num_elem,
         x[i] = y[idxs[i*incy]];
 }
 
+/************************************************************/
+/***********BLAS calls with 64-bit lengths*******************/
+/************************************************************/
+
+// Unless OpenBLAS is built with 64-bit integers (INTERFACE64),
+// its lengths are int, so anything past INT_MAX elements has to be
+// split into several calls. The chunk length is a power of two so
+// that chunks stay aligned.
+#ifdef OPENBLAS_USE64BITINT
+#define BLAS_CHUNK ((size_t)1 << 62)
+#else
+#define BLAS_CHUNK ((size_t)1 << 30)
+#endif
+
+static size_t blas_chunk(size_t remaining)
+{
+    return remaining < BLAS_CHUNK? remaining: BLAS_CHUNK;
+}
+
+// y := x (?copy)
+void dcopy_64(size_t num_elem, const double* x, size_t incx,
+              double* y, size_t incy)
+{
+    for (size_t i=0; i<num_elem; i+=BLAS_CHUNK)
+        cblas_dcopy(blas_chunk(num_elem-i), &x[i*incx], incx,
+                    &y[i*incy], incy);
+}
+
+// x := alpha x (?scal)
+void dscal_64(size_t num_elem, double alpha, double* x, size_t incx)
+{
+    for (size_t i=0; i<num_elem; i+=BLAS_CHUNK)
+        cblas_dscal(blas_chunk(num_elem-i), alpha, &x[i*incx], incx);
+}
+
+// y := alpha x + y (?axpy)
+void daxpy_64(size_t num_elem, double alpha, const double* x,
+              size_t incx, double* y, size_t incy)
+{
+    for (size_t i=0; i<num_elem; i+=BLAS_CHUNK)
+        cblas_daxpy(blas_chunk(num_elem-i), alpha, &x[i*incx], incx,
+                    &y[i*incy], incy);
+}
+
+// Single precision ?copy, ?scal and ?axpy
+void scopy_64(size_t num_elem, const float* x, size_t incx,
+              float* y, size_t incy)
+{
+    for (size_t i=0; i<num_elem; i+=BLAS_CHUNK)
+        cblas_scopy(blas_chunk(num_elem-i), &x[i*incx], incx,
+                    &y[i*incy], incy);
+}
+
+void sscal_64(size_t num_elem, float alpha, float* x, size_t incx)
+{
+    for (size_t i=0; i<num_elem; i+=BLAS_CHUNK)
+        cblas_sscal(blas_chunk(num_elem-i), alpha, &x[i*incx], incx);
+}
+
+void saxpy_64(size_t num_elem, float alpha, const float* x,
+              size_t incx, float* y, size_t incy)
+{
+    for (size_t i=0; i<num_elem; i+=BLAS_CHUNK)
+        cblas_saxpy(blas_chunk(num_elem-i), alpha, &x[i*incx], incx,
+                    &y[i*incy], incy);
+}
+
+// x^T y (?dot)
+double ddot_64(size_t num_elem, const double* x, size_t incx,
+               const double* y, size_t incy)
+{
+    double dot = 0.0;
+    for (size_t i=0; i<num_elem; i+=BLAS_CHUNK)
+        dot += cblas_ddot(blas_chunk(num_elem-i), &x[i*incx], incx,
+                          &y[i*incy], incy);
+    return dot;
+}
+
+// sum_i |x_i| (?asum)
+double dasum_64(size_t num_elem, const double* x, size_t incx)
+{
+    double sum = 0.0;
+    for (size_t i=0; i<num_elem; i+=BLAS_CHUNK)
+        sum += cblas_dasum(blas_chunk(num_elem-i), &x[i*incx], incx);
+    return sum;
+}
+
+// ||x||_2 (?nrm2)
+double dnrm2_64(size_t num_elem, const double* x, size_t incx)
+{
+    double sum_sq = 0.0;
+    if (num_elem<=BLAS_CHUNK)
+        return cblas_dnrm2(num_elem, x, incx);
+    for (size_t i=0; i<num_elem; i+=BLAS_CHUNK)
+    {
+        double norm = cblas_dnrm2(blas_chunk(num_elem-i), &x[i*incx], incx);
+        sum_sq += norm * norm;
+    }
+    return sqrt(sum_sq);
+}
+
+// y := alpha op(A) x + beta y (?gemv, row major)
+// Split over the rows of A. For the transpose, every chunk adds
+// its part of A^T x to y.
+void dgemv_64(CBLAS_TRANSPOSE trans, size_t m, size_t n,
+              double alpha, const double* a, size_t lda,
+              const double* x, size_t incx,
+              double beta, double* y, size_t incy)
+{
+    for (size_t i=0; i<m; i+=BLAS_CHUNK)
+    {
+        size_t rows = blas_chunk(m-i);
+        if (trans==CblasNoTrans)
+            cblas_dgemv(CblasRowMajor, trans, rows, n, alpha,
+                        &a[i*lda], lda, x, incx, beta, &y[i*incy], incy);
+        else
+            cblas_dgemv(CblasRowMajor, trans, rows, n, alpha,
+                        &a[i*lda], lda, &x[i*incx], incx,
+                        i==0? beta: 1.0, y, incy);
+    }
+}
+
+// C := alpha op(A) op(B) + beta C (?gemm, row major)
+// Split over the rows of C (m) and the inner dimension (k); the
+// chunks of k after the first accumulate into C.
+void dgemm_64(CBLAS_TRANSPOSE transa, CBLAS_TRANSPOSE transb,
+              size_t m, size_t n, size_t k,
+              double alpha, const double* a, size_t lda,
+              const double* b, size_t ldb,
+              double beta, double* c, size_t ldc)
+{
+    for (size_t i=0; i<m; i+=BLAS_CHUNK)
+        for (size_t p=0; p<k || p==0; p+=BLAS_CHUNK)
+        {
+            // Element (i, p) of op(A) and (p, 0) of op(B)
+            const double* a_ip = transa==CblasNoTrans? &a[i*lda+p]: &a[p*lda+i];
+            const double* b_p = transb==CblasNoTrans? &b[p*ldb]: &b[p];
+            cblas_dgemm(CblasRowMajor, transa, transb,
+                        blas_chunk(m-i), n, blas_chunk(k-p),
+                        alpha, a_ip, lda, b_p, ldb,
+                        p==0? beta: 1.0, &c[i*ldc], ldc);
+        }
+}
+
+// C := alpha op(A) op(B) + beta C (?gemm, row major, single
+// precision), split like dgemm_64
+void sgemm_64(CBLAS_TRANSPOSE transa, CBLAS_TRANSPOSE transb,
+              size_t m, size_t n, size_t k,
+              float alpha, const float* a, size_t lda,
+              const float* b, size_t ldb,
+              float beta, float* c, size_t ldc)
+{
+    for (size_t i=0; i<m; i+=BLAS_CHUNK)
+        for (size_t p=0; p<k || p==0; p+=BLAS_CHUNK)
+        {
+            const float* a_ip = transa==CblasNoTrans? &a[i*lda+p]: &a[p*lda+i];
+            const float* b_p = transb==CblasNoTrans? &b[p*ldb]: &b[p];
+            cblas_sgemm(CblasRowMajor, transa, transb,
+                        blas_chunk(m-i), n, blas_chunk(k-p),
+                        alpha, a_ip, lda, b_p, ldb,
+                        p==0? beta: 1.0f, &c[i*ldc], ldc);
+        }
+}
+
+// C := alpha A^T A + beta C (?syrk, row major, upper, transposed)
+// Split over the rows of A.
+void dsyrk_64(size_t n, size_t k, double alpha,
+              const double* a, size_t lda,
+              double beta, double* c, size_t ldc)
+{
+    for (size_t p=0; p<k || p==0; p+=BLAS_CHUNK)
+        cblas_dsyrk(CblasRowMajor, CblasUpper, CblasTrans, n,
+                    blas_chunk(k-p), alpha, &a[p*lda], lda,
+                    p==0? beta: 1.0, c, ldc);
+}
+
+// Rows ahead of the current one that are prefetched while gathering
+#define GATHER_PREFETCH_ROWS 8
+
+// Gathers with fewer elements than this are not split across threads
+#define GATHER_MT_MIN_ELEM (1 << 20)
+#define GATHER_MAX_THREADS 64
+
+// A range of rows to gather: dst[i] = src[idxs[i]] for i in [begin, end)
+typedef struct
+{
+    const char* src;
+    char* dst;
+    size_t src_stride, dst_stride;  // In bytes
+    size_t row_bytes;
+    const int* idxs;
+    size_t begin, end;
+} GatherTask;
+
+// Copy whole rows with memcpy, prefetching the source rows a few
+// indices ahead since they are scattered over memory
+static void gather_rows_range(const GatherTask* task)
+{
+    for (size_t i=task->begin; i<task->end; i++)
+    {
+        if (i+GATHER_PREFETCH_ROWS<task->end)
+        {
+            const char* ahead = task->src +
+                (size_t)task->idxs[i+GATHER_PREFETCH_ROWS]*task->src_stride;
+            for (size_t b=0; b<task->row_bytes; b+=64)
+                __builtin_prefetch(ahead+b, 0, 0);
+        }
+        memcpy(task->dst + i*task->dst_stride,
+               task->src + (size_t)task->idxs[i]*task->src_stride,
+               task->row_bytes);
+    }
+}
+
+static void* gather_rows_worker(void* arg)
+{
+    gather_rows_range((const GatherTask*)arg);
+    return NULL;
+}
+
+// Gather "n_rows" rows of "row_bytes" bytes each, optionally
+// splitting the rows over "n_threads" threads (including the
+// calling one)
+static void gather_rows(const char* src, size_t src_stride,
+                        char* dst, size_t dst_stride,
+                        size_t row_bytes, const int* idxs,
+                        size_t n_rows, unsigned int n_threads)
+{
+    GatherTask tasks[GATHER_MAX_THREADS];
+    pthread_t threads[GATHER_MAX_THREADS];
+    bool started[GATHER_MAX_THREADS];
+    size_t rows_per_thread;
+
+    if (n_threads<1)
+        n_threads = 1;
+    if (n_threads>GATHER_MAX_THREADS)
+        n_threads = GATHER_MAX_THREADS;
+    if (n_rows*row_bytes<GATHER_MT_MIN_ELEM*sizeof(double) || n_rows<n_threads)
+        n_threads = 1;
+
+    rows_per_thread = (n_rows + n_threads - 1) / n_threads;
+    for (unsigned int t=0; t<n_threads; t++)
+    {
+        tasks[t].src = src;
+        tasks[t].dst = dst;
+        tasks[t].src_stride = src_stride;
+        tasks[t].dst_stride = dst_stride;
+        tasks[t].row_bytes = row_bytes;
+        tasks[t].idxs = idxs;
+        tasks[t].begin = t*rows_per_thread < n_rows? t*rows_per_thread: n_rows;
+        tasks[t].end = (t+1)*rows_per_thread < n_rows? (t+1)*rows_per_thread: n_rows;
+        started[t] = false;
+    }
+
+    // The calling thread takes the first range
+    for (unsigned int t=1; t<n_threads; t++)
+        started[t] = pthread_create(&threads[t], NULL,
+                                    gather_rows_worker, &tasks[t])==0;
+    gather_rows_range(&tasks[0]);
+    for (unsigned int t=1; t<n_threads; t++)
+    {
+        if (started[t])
+            pthread_join(threads[t], NULL);
+        else
+            gather_rows_range(&tasks[t]);
+    }
+}
+
+// Random fills with fewer elements than this run on the calling
+// thread only
+#define FILL_MT_MIN_ELEM (1 << 20)
+
+// A range of rows to fill with uniform random numbers. Element
+// k = i*ncols + j takes words [2k, 2k+2) of the random stream for
+// double precision and word k for single precision, so the values
+// do not depend on how the rows are split between threads.
+typedef struct
+{
+    double* data;        // Exactly one of data and fdata is set
+    float* fdata;
+    size_t ncols, stride;
+    size_t begin, end;
+    unsigned int seed;
+} FillTask;
+
+static void* fill_uniform_rows(void* arg)
+{
+    const FillTask* task = (const FillTask*)arg;
+    RandomStream rng;
+
+    random_init(&rng, task->seed, 0);
+    random_seek(&rng, task->begin*task->ncols*(task->data!=NULL? 2: 1));
+    for (size_t i=task->begin; i<task->end; i++)
+        for (size_t j=0; j<task->ncols; j++)
+        {
+            if (task->data!=NULL)
+                task->data[i*task->stride+j] = random_uniform(&rng);
+            else
+                task->fdata[i*task->stride+j] = random_uniform_float(&rng);
+        }
+    return NULL;
+}
+
+// Fill the rows of a double (data) or float (fdata) matrix with
+// uniform numbers in [0, 1), splitting large matrices over all
+// online processors
+static void fill_uniform(double* data, float* fdata, size_t nrows,
+                         size_t ncols, size_t stride, unsigned int seed)
+{
+    FillTask tasks[GATHER_MAX_THREADS];
+    pthread_t threads[GATHER_MAX_THREADS];
+    bool started[GATHER_MAX_THREADS];
+    unsigned int n_threads = 1;
+    size_t rows_per_thread;
+
+    if (nrows*ncols>=FILL_MT_MIN_ELEM)
+        n_threads = (unsigned int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_threads<1)
+        n_threads = 1;
+    if (n_threads>GATHER_MAX_THREADS)
+        n_threads = GATHER_MAX_THREADS;
+    if (nrows<n_threads)
+        n_threads = 1;
+
+    rows_per_thread = (nrows + n_threads - 1) / n_threads;
+    for (unsigned int t=0; t<n_threads; t++)
+    {
+        tasks[t].data = data;
+        tasks[t].fdata = fdata;
+        tasks[t].ncols = ncols;
+        tasks[t].stride = stride;
+        tasks[t].seed = seed;
+        tasks[t].begin = t*rows_per_thread < nrows? t*rows_per_thread: nrows;
+        tasks[t].end = (t+1)*rows_per_thread < nrows? (t+1)*rows_per_thread: nrows;
+        started[t] = false;
+    }
+
+    // The calling thread takes the first range
+    for (unsigned int t=1; t<n_threads; t++)
+        started[t] = pthread_create(&threads[t], NULL,
+                                    fill_uniform_rows, &tasks[t])==0;
+    fill_uniform_rows(&tasks[0]);
+    for (unsigned int t=1; t<n_threads; t++)
+    {
+        if (started[t])
+            pthread_join(threads[t], NULL);
+        else
+            fill_uniform_rows(&tasks[t]);
+    }
+}
+
+// Check that all row indices lie in [0, n_rows)
+static bool row_indices_valid(const int* idxs, size_t n_idxs,
+                              size_t n_rows)
+{
+    for (size_t i=0; i<n_idxs; i++)
+        if (idxs[i]<0 || (size_t)idxs[i]>=n_rows)
+            return false;
+    return true;
+}
+
+// Column gathers take either a row vector of columns picked from
+// every row, or a column vector with one column per row
+static size_t column_index(const IntMatrix* indices, size_t row, size_t j)
+{
+    return (size_t)(indices->nrows==1? indices->data[j]: indices->data[row]);
+}
+
+static bool column_indices_valid(const IntMatrix* indices,
+                                 size_t n_rows, size_t n_cols)
+{
+    if (indices->nrows!=1 && (indices->ncols!=1 || indices->nrows!=n_rows))
+        return false;
+    return row_indices_valid(indices->data,
+                             indices->nrows*indices->ncols, n_cols);
+}
+
 /************************************************************************/
 /***************Functions for IntMatrix (integer data)******************/
 /************************************************************************/
 
 // Create a matrix
-IntMatrix intmat_create(int nrows, int ncols)
+IntMatrix intmat_create(size_t nrows, size_t ncols)
 {
     IntMatrix matrix;
-    matrix.nrows = (unsigned int)nrows; 
-    matrix.ncols = (unsigned int)ncols;
+    matrix.nrows = nrows; 
+    matrix.ncols = ncols;
 
-    if (nrows<=0 || ncols<=0)
+    if (nrows==0 || ncols==0)
     {
-        perror("ERROR: Number of rows/columns cannot be <= 0.");
+        perror("ERROR: Number of rows/columns cannot be zero.");
         matrix.data = NULL;
         return matrix;
     }
@@ -275,8 +879,11 @@ void intmat_fill_random(IntMatrix* mat,
                     int low, int high, bool replace, unsigned int seed)
 {
     int* temp_ints = NULL;
+    RandomStream rng;
+    // high - low may not fit in an int, e.g. for INT_MIN and INT_MAX
+    size_t range = (size_t)((int64_t)high - (int64_t)low);
 
-    srand(seed);
+    random_init(&rng, seed, 0);
 
     if (low>=high)
     {
@@ -290,11 +897,12 @@ void intmat_fill_random(IntMatrix* mat,
     {
         for (size_t i=0; i<mat->nrows; i++)
             for (size_t j=0; j<mat->ncols; j++)
-                mat->data[i*mat->ncols+j] = low + rand()%(high - low);
+                mat->data[i*mat->ncols+j] = (int)((int64_t)low
+                        + (int64_t)random_below(&rng, range));
         return;
     }
 
-    if (mat->nrows*mat->ncols > (size_t)(high-low))
+    if (mat->nrows*mat->ncols > range)
     {
         perror("ERROR: Too many numbers to generate without replacement.");
         intmat_destroy(mat);
@@ -303,14 +911,20 @@ void intmat_fill_random(IntMatrix* mat,
     
     // Random numbers without replacement
     // 1. Generate numbers from low to high (exclusive) and store in arr.
-    // 2. Shuffle arr (e.g. using Fisher-Yates).
+    // 2. Shuffle arr (Fisher-Yates).
     // 3. Select first nrows * ncols numbers.
-    temp_ints = (int *)calloc(high-low, sizeof(int));
-    for (int i=low; i<high; i++)
-        temp_ints[i-low] = i;
-    for (size_t i=high-low-1; i>0; i--)
+    temp_ints = (int *)calloc(range, sizeof(int));
+    if (temp_ints==NULL)
+    {
+        perror("ERROR: Could not allocate memory.");
+        intmat_destroy(mat);
+        return;
+    }
+    for (size_t i=0; i<range; i++)
+        temp_ints[i] = (int)((int64_t)low + (int64_t)i);
+    for (size_t i=range-1; i>0; i--)
     {
-        int idx = rand()%i;
+        size_t idx = random_below(&rng, i+1);
         int temp = temp_ints[idx];
         temp_ints[idx] = temp_ints[i];
         temp_ints[i] = temp;
@@ -354,7 +968,7 @@ IntMatrix intmat_range(int low,
 {
     IntMatrix out;
     bool err = false;
-    unsigned int n_elem;
+    size_t n_elem;
 
     if (high<=low)
     {
@@ -367,7 +981,7 @@ IntMatrix intmat_range(int low,
         err = true;
     }
 
-    n_elem = (high - low)/step;
+    n_elem = (size_t)((long long)high - low)/step;
     
     switch (dimension)
     {
@@ -389,8 +1003,8 @@ IntMatrix intmat_range(int low,
         return out;
     }
 
-    for (int i=low; i<high; i+=step)
-        out.data[(i-low)/step] = i;
+    for (size_t i=0; i<n_elem; i++)
+        out.data[i] = low + (int)(i*step);
 
     return out;
 }
@@ -422,19 +1036,52 @@ void intmat_add(IntMatrix* intmat_a, IntMatrix* intmat_b)
 // Subtraction is performed as A := A - B
 void intmat_sub(IntMatrix* intmat_a, IntMatrix* intmat_b)
 {
-    IntMatrix copy = intmat_copy(intmat_b);
-    intmat_scale(&copy, -1);
-    intmat_add(intmat_a, &copy);
-    intmat_destroy(&copy);
+    // Ensure that both vectors are of same length
+    if (intmat_a->nrows!=intmat_b->nrows || intmat_a->ncols!=intmat_b->ncols)
+    {
+        perror("ERROR: matrices A and B must be of same dimension.");
+        intmat_destroy(intmat_a);
+        return;
+    }
+
+    iaxpy(intmat_b->nrows * intmat_b->ncols, -1,
+          intmat_b->data, 1, intmat_a->data, 1);
 }
 
 // Add a scalar to a matrix
 void intmat_add_scalar(IntMatrix* mat, int scalar)
 {
-    IntMatrix temp = intmat_create(mat->nrows, mat->ncols);
-    intmat_fill(&temp, scalar);
-    intmat_add(mat, &temp);
-    intmat_destroy(&temp);
+    for (size_t i=0; i<mat->nrows*mat->ncols; i++)
+        mat->data[i] += scalar;
+}
+
+// A := A + sign * B, with vector B broadcast to the dimensions of A
+static void intmat_vec_axpy(IntMatrix* mat, int sign, IntMatrix* vec)
+{
+    if (vec->nrows>1 && vec->ncols>1)
+    {
+        perror("ERROR: Second argument must be a vector.");
+        intmat_destroy(mat);
+        return;
+    }
+    if ((vec->nrows==1 && vec->ncols!=mat->ncols)
+            || (vec->nrows!=1 && vec->nrows!=mat->nrows))
+    {
+        perror("ERROR: Vector length must match the matrix dimension.");
+        intmat_destroy(mat);
+        return;
+    }
+
+    for (size_t i=0; i<mat->nrows; i++)
+    {
+        int* a = &(mat->data[i*mat->ncols]);
+        if (vec->nrows==1)
+            for (size_t j=0; j<mat->ncols; j++)
+                a[j] += sign * vec->data[j];
+        else
+            for (size_t j=0; j<mat->ncols; j++)
+                a[j] += sign * vec->data[i];
+    }
 }
 
 // Multiply two matrices A and B. Matrices are multiplied
@@ -446,8 +1093,8 @@ IntMatrix intmat_mul(IntMatrix* intmat_a,
                IntMatrix* intmat_b,
                bool transpose_b)
 {
-    unsigned int lda, ldb;
-    unsigned int m, n, k, k_prime;
+    size_t lda, ldb;
+    size_t m, n, k, k_prime;
 
     IntMatrix result;
     int alpha = 1, beta = 0;
@@ -469,7 +1116,6 @@ IntMatrix intmat_mul(IntMatrix* intmat_a,
     }
     
     result = intmat_create(m, n);
-    intmat_fill(&result, 0);
 
     lda = transpose_a? m: k;
     ldb = transpose_b? k: n;
@@ -489,8 +1135,8 @@ void intmat_mul_inplace(IntMatrix* intmat_a,
                  bool transpose_b,
                  IntMatrix* result)
 {
-    unsigned int m, n, k, k_prime;
-    unsigned int lda, ldb;
+    size_t m, n, k, k_prime;
+    size_t lda, ldb;
     int alpha = 1, beta = 0;
 
     CBLAS_TRANSPOSE trans_a = transpose_a? CblasTrans : CblasNoTrans;
@@ -514,8 +1160,6 @@ void intmat_mul_inplace(IntMatrix* intmat_a,
         intmat_destroy(result);
         return;
     }
-    
-    intmat_fill(result, 0);
 
     lda = transpose_a? m: k;
     ldb = transpose_b? k: n;
@@ -529,10 +1173,10 @@ void intmat_mul_inplace(IntMatrix* intmat_a,
 
 // Repeat a vector along a given dimension
 IntMatrix intmat_repeat(IntMatrix* vec, 
-        unsigned int dimension, unsigned int repeats)
+        unsigned int dimension, size_t repeats)
 {
     IntMatrix repeated;
-    unsigned int nidx, idx_fac, inc;
+    size_t nidx, idx_fac, inc;
     bool err = false;
 
     // Check if vec is a vector
@@ -586,44 +1230,20 @@ IntMatrix intmat_repeat(IntMatrix* vec,
 
 // Add a vector to a matrix
 // Addition is done as: A := A + B
-// where vector B is repeated along the number
+// where vector B is broadcast along the number
 // of dimensions as required to match A's dimensions.
 void intmat_vec_add(IntMatrix* mat, IntMatrix* vec)
 {
-    IntMatrix repeated;
-    if (vec->nrows>1 && vec->ncols>1)
-    {
-        perror("ERROR: Second argument must be a vector.");
-        intmat_destroy(mat);
-        return;
-    }
-    if (vec->nrows==1)
-        repeated = intmat_repeat(vec, 0, mat->nrows);
-    else
-        repeated = intmat_repeat(vec, 1, mat->ncols);
-    intmat_add(mat, &repeated);
-    intmat_destroy(&repeated);
+    intmat_vec_axpy(mat, 1, vec);
 }
 
 // Subtract a vector from a matrix
 // Subtraction is done as: A := A - B
-// where vector B is repeated along the number
+// where vector B is broadcast along the number
 // of dimensions as required to match A's dimensions.
 void intmat_vec_sub(IntMatrix* mat, IntMatrix* vec)
 {
-    IntMatrix repeated;
-    if (vec->nrows>1 && vec->ncols>1)
-    {
-        perror("ERROR: Second argument must be a vector.");
-        intmat_destroy(mat);
-        return;
-    }
-    if (vec->nrows==1)
-        repeated = intmat_repeat(vec, 0, mat->nrows);
-    else
-        repeated = intmat_repeat(vec, 1, mat->ncols);
-    intmat_sub(mat, &repeated);
-    intmat_destroy(&repeated);
+    intmat_vec_axpy(mat, -1, vec);
 }
 
 // Gather rows/columns from "from" and store in
@@ -633,34 +1253,41 @@ void intmat_gather(IntMatrix* from,
                 IntMatrix* indices,
                 unsigned int dimension)
 {
-    IntMatrix idxs, idxs_repeated, ind_arg_cpy;
     switch (dimension)
     {
         case 0:
-            idxs = intmat_range(0, from->ncols, 1, 1);
-            idxs_repeated = intmat_repeat(&idxs, 0, 
-                                    indices->nrows);
-            ind_arg_cpy = intmat_copy(indices);
-            intmat_scale(&ind_arg_cpy, from->ncols); 
-            intmat_vec_add(&idxs_repeated, &ind_arg_cpy);
-            break;
+            // Whole rows are copied directly
+            if (to->nrows!=indices->nrows*indices->ncols
+                    || to->ncols!=from->ncols
+                    || !row_indices_valid(indices->data,
+                            indices->nrows*indices->ncols, from->nrows))
+            {
+                perror("ERROR: Invalid indices or destination dimensions for gather.");
+                return;
+            }
+            gather_rows((const char*)from->data, from->ncols*sizeof(int),
+                        (char*)to->data, to->ncols*sizeof(int),
+                        from->ncols*sizeof(int), indices->data,
+                        to->nrows, 1);
+            return;
         case 1:
-            idxs = intmat_range(0, from->nrows, 1, 0);
-            intmat_scale(&idxs, from->ncols);
-            idxs_repeated = intmat_repeat(&idxs, 1,
-                                indices->ncols);
-            intmat_vec_add(&idxs_repeated, indices);
-            break;
+            if (!column_indices_valid(indices, from->nrows, from->ncols)
+                    || to->nrows!=from->nrows
+                    || to->ncols!=(indices->nrows==1? indices->ncols: 1))
+            {
+                perror("ERROR: Invalid indices or destination dimensions for gather.");
+                return;
+            }
+            for (size_t i=0; i<to->nrows; i++)
+                for (size_t j=0; j<to->ncols; j++)
+                    to->data[i*to->ncols+j] = from->data[i*from->ncols
+                                    + column_index(indices, i, j)];
+            return;
         default:
             perror("Dimension must be either rows(0) or columns(1).");
             intmat_destroy(to);
             return;
     }
-    iusga(idxs_repeated.nrows*idxs_repeated.ncols, from->data,
-             1, to->data, (unsigned int*)idxs_repeated.data);
-    intmat_destroy(&ind_arg_cpy);
-    intmat_destroy(&idxs);
-    intmat_destroy(&idxs_repeated);
 }
 
 // Destroy a matrix
@@ -677,16 +1304,27 @@ void intmat_destroy(IntMatrix* matrix)
 /***************Functions for Matrix (double precision data)*************/
 /************************************************************************/
 
+// Arena bound to the calling thread, if any (see mat_arena_bind)
+static __thread MatArena* bound_arena = NULL;
+
 // Create a matrix
-Matrix mat_create(int nrows, int ncols)
+// If an arena is bound to the calling thread, the matrix is
+// drawn from it instead of the heap.
+Matrix mat_create(size_t nrows, size_t ncols)
 {
     Matrix matrix;
-    matrix.nrows = (unsigned int)nrows; 
-    matrix.ncols = (unsigned int)ncols;
 
-    if (nrows<=0 || ncols<=0)
+    if (bound_arena!=NULL)
+        return mat_arena_alloc(bound_arena, nrows, ncols);
+
+    matrix.nrows = nrows; 
+    matrix.ncols = ncols;
+    matrix.stride = matrix.ncols;
+    matrix.owner = true;
+
+    if (nrows==0 || ncols==0)
     {
-        perror("ERROR: Number of rows/columns cannot be <= 0.");
+        perror("ERROR: Number of rows/columns cannot be zero.");
         matrix.data = NULL;
         return matrix;
     }
@@ -708,7 +1346,7 @@ void mat_print(const Matrix* mat)
     for (size_t i=0; i<mat->nrows; i++)
     {
         for (size_t j=0; j<mat->ncols; j++)
-            printf("%.4f ", mat->data[i*mat->ncols+j]);
+            printf("%.4f ", mat->data[i*mat->stride+j]);
         printf("\n");
     }
 }
@@ -722,29 +1360,29 @@ void mat_fill(Matrix* mat, double value)
         return;
     for (size_t i=0; i<mat->nrows; i++)
         for (size_t j=0; j<mat->ncols; j++)
-            mat->data[i*mat->ncols+j] = value;
+            mat->data[i*mat->stride+j] = value;
 }
 
 // Fill a matrix with random numbers between 0.0 and 1.0 (half-open)
+// The values depend only on the seed and the position of each
+// element, also when large matrices are filled by several threads.
 void mat_fill_random(Matrix* mat, unsigned int seed)
 {
-    srand(seed);
-
-    for (size_t i=0; i<mat->nrows; i++)
-        for (size_t j=0; j<mat->ncols; j++)
-            mat->data[i*mat->ncols+j] = (double)rand()/(double)(RAND_MAX);
+    if (mat->data==NULL)
+        return;
+    fill_uniform(mat->data, NULL, mat->nrows, mat->ncols, mat->stride, seed);
 }
 
-// Fill a matrix with random numbers from a Gaussian distribution 
-// with mean "mean" and standard deviation "std"
+// Fill a matrix with random numbers from Gaussian distributions,
+// column j with mean "means[j]" and standard deviation "stds[j]"
 void mat_fill_random_gaussian(Matrix* mat,
                               Matrix* means,
                               Matrix* stds,
                               unsigned int seed)
 {
-    double x;
+    RandomStream rng;
 
-    srand(seed);
+    random_init(&rng, seed, 0);
 
     if (mat==NULL || means==NULL || stds==NULL)
     {
@@ -760,31 +1398,61 @@ void mat_fill_random_gaussian(Matrix* mat,
         return;
     }
 
+    for (size_t j=0; j<mat->ncols; j++)
+        if (stds->data[j]==0.0)
+        {
+            perror("ERROR: Standard deviation cannot be zero.");
+            mat_destroy(mat);
+            return;
+        }
+
+    // Standard normal samples, then scaled and shifted per column
     for (size_t i=0; i<mat->nrows; i++)
+    {
+        double* row = &(mat->data[i*mat->stride]);
+
+        random_normal_fill(&rng, row, mat->ncols);
         for (size_t j=0; j<mat->ncols; j++)
-        {
-            double mean = means->data[j];
-            double std = stds->data[j];
+            row[j] = means->data[j] + stds->data[j]*row[j];
+    }
+}
 
-            if (std==0.0)
-            {
-                perror("ERROR: Standard deviation cannot be zero.");
-                mat_destroy(mat);
-                return;
-            }
+// Whether the rows of a matrix are stored back to back
+bool mat_is_contiguous(const Matrix* mat)
+{
+    return mat->stride==mat->ncols || mat->nrows<=1;
+}
 
-            x = (double)rand()/(double)(RAND_MAX);
-            mat->data[i*mat->ncols+j] = exp(-0.5*((x-mean)/std)*((x-mean)/std))\
-                                        / (std * sqrt(2*M_PI));
-        }
+// View of the nrows x ncols block of "mat" starting at (row, col).
+// The view shares the data of "mat" (nothing is copied) and is
+// only valid as long as "mat" is.
+Matrix mat_view(Matrix* mat,
+                size_t row, size_t col,
+                size_t nrows, size_t ncols)
+{
+    Matrix view;
+    view.nrows = nrows;
+    view.ncols = ncols;
+    view.stride = mat->stride;
+    view.owner = false;
+    view.data = NULL;
+
+    if (mat->data==NULL || nrows==0 || ncols==0 ||
+            row+nrows>mat->nrows || col+ncols>mat->ncols)
+    {
+        perror("ERROR: View exceeds the dimensions of the matrix.");
+        return view;
+    }
+    view.data = &(mat->data[row*mat->stride+col]);
+    return view;
 }
 
 // Copy a matrix
+// The copy is always contiguous, also when copying a view.
 Matrix mat_copy(Matrix* mat)
 {
     Matrix copy = mat_create(mat->nrows, mat->ncols);
-    cblas_dcopy(mat->nrows*mat->ncols, mat->data,
-                1, copy.data, 1);
+    mat_copy_inplace(mat, &copy);
     return copy;
 }
 
@@ -798,8 +1466,15 @@ void mat_copy_inplace(Matrix* mat, Matrix* copy)
         mat_destroy(mat);
         return;
     }
-    cblas_dcopy(mat->nrows*mat->ncols, mat->data,
-                1, copy->data, 1);
+    if (mat_is_contiguous(mat) && mat_is_contiguous(copy))
+    {
+        dcopy_64(mat->nrows*mat->ncols, mat->data,
+                 1, copy->data, 1);
+        return;
+    }
+    for (size_t i=0; i<mat->nrows; i++)
+        cblas_dcopy(mat->ncols, &(mat->data[i*mat->stride]),
+                    1, &(copy->data[i*copy->stride]), 1);
 }
 
 // Sum of absolute values of matrix elements
@@ -809,7 +1484,10 @@ double mat_abs_sum(Matrix* mat)
         return 0.0;
 
     double sum = 0.0;
-    sum = cblas_dasum(mat->nrows*mat->ncols, mat->data, 1);
+    if (mat_is_contiguous(mat))
+        return dasum_64(mat->nrows*mat->ncols, mat->data, 1);
+    for (size_t i=0; i<mat->nrows; i++)
+        sum += cblas_dasum(mat->ncols, &(mat->data[i*mat->stride]), 1);
     return sum;
 }
 
@@ -822,8 +1500,18 @@ double mat_norm(Matrix* mat)
         perror("ERROR: Null pointer in argument matrix.");
         return 0.0;
     }
-    return cblas_dnrm2(mat->nrows*mat->ncols, 
+    if (mat_is_contiguous(mat))
+        return dnrm2_64(mat->nrows*mat->ncols, 
                         mat->data, 1);
+
+    double sum_sq = 0.0;
+    for (size_t i=0; i<mat->nrows; i++)
+    {
+        double row_norm = cblas_dnrm2(mat->ncols,
+                                      &(mat->data[i*mat->stride]), 1);
+        sum_sq += row_norm * row_norm;
+    }
+    return sqrt(sum_sq);
 }
 
 // Create a row (1)/column (0) vector (according to specified 
@@ -836,7 +1524,7 @@ Matrix mat_range(double low,
 {
     Matrix out;
     bool err = false;
-    unsigned int n_elem;
+    size_t n_elem;
 
     if (high<=low)
     {
@@ -849,7 +1537,7 @@ Matrix mat_range(double low,
         err = true;
     }
 
-    n_elem = (int)((high - low)/step);
+    n_elem = (size_t)((high - low)/step);
     
     switch (dimension)
     {
@@ -872,7 +1560,7 @@ Matrix mat_range(double low,
     }
 
     for (int i=low; i<high; i+=step)
-        out.data[(int)((i-low)/step)] = (double)i;
+        out.data[(size_t)((i-low)/step)] = (double)i;
 
     return out;
 }
@@ -880,17 +1568,133 @@ Matrix mat_range(double low,
 // Scale a matrix by a scalar
 void mat_scale(Matrix* mat, double fac)
 {
-    cblas_dscal(mat->nrows*mat->ncols, fac,
-                mat->data, 1);
+    if (mat_is_contiguous(mat))
+    {
+        dscal_64(mat->nrows*mat->ncols, fac,
+                 mat->data, 1);
+        return;
+    }
+    for (size_t i=0; i<mat->nrows; i++)
+        cblas_dscal(mat->ncols, fac, &(mat->data[i*mat->stride]), 1);
 }
 
 // Add a scalar to a matrix
 void mat_add_scalar(Matrix* mat, double scalar)
 {
-    Matrix temp = mat_create(mat->nrows, mat->ncols);
-    mat_fill(&temp, scalar);
-    mat_add(mat, &temp);
-    mat_destroy(&temp);
+    mat_scale_shift(mat, 1.0, scalar);
+}
+
+// Scale and shift a matrix in one pass, A := scale * A + shift
+void mat_scale_shift(Matrix* mat, double scale, double shift)
+{
+    for (size_t i=0; i<mat->nrows; i++)
+    {
+        double* a = &(mat->data[i*mat->stride]);
+        for (size_t j=0; j<mat->ncols; j++)
+            a[j] = scale * a[j] + shift;
+    }
+}
+
+// How the second operand of a broadcast operation is matched to
+// the elements of A
+typedef enum
+{
+    BROADCAST_NONE,     // Same dimensions as A
+    BROADCAST_ROW,      // Row vector, 1 x ncols
+    BROADCAST_COLUMN,   // Column vector, nrows x 1
+    BROADCAST_SCALAR,   // 1 x 1
+    BROADCAST_INVALID
+} Broadcast;
+
+static Broadcast broadcast_kind(const Matrix* mat, const Matrix* other)
+{
+    if (other->nrows==mat->nrows && other->ncols==mat->ncols)
+        return BROADCAST_NONE;
+    if (other->nrows==1 && other->ncols==1)
+        return BROADCAST_SCALAR;
+    if (other->nrows==1 && other->ncols==mat->ncols)
+        return BROADCAST_ROW;
+    if (other->ncols==1 && other->nrows==mat->nrows)
+        return BROADCAST_COLUMN;
+    return BROADCAST_INVALID;
+}
+
+// A := alpha * B + beta * A in place, where B has the dimensions of
+// A or is a row vector, a column vector or a 1 x 1 matrix repeated
+// to them. One pass over A with no temporaries; each row is an
+// independent loop over contiguous elements, which compilers
+// vectorize. Returns false if B cannot be broadcast to A.
+bool mat_axpby(Matrix* mat, double alpha, Matrix* other, double beta)
+{
+    Broadcast kind = broadcast_kind(mat, other);
+
+    if (kind==BROADCAST_INVALID)
+    {
+        perror("ERROR: Second operand must match or broadcast to the dimensions of the matrix.");
+        return false;
+    }
+    if (kind==BROADCAST_NONE && beta==1.0
+            && mat_is_contiguous(mat) && mat_is_contiguous(other))
+    {
+        daxpy_64(mat->nrows * mat->ncols, alpha, other->data, 1,
+                 mat->data, 1);
+        return true;
+    }
+
+    for (size_t i=0; i<mat->nrows; i++)
+    {
+        double* a = &(mat->data[i*mat->stride]);
+
+        if (kind==BROADCAST_NONE || kind==BROADCAST_ROW)
+        {
+            const double* b = kind==BROADCAST_ROW? other->data:
+                              &(other->data[i*other->stride]);
+            for (size_t j=0; j<mat->ncols; j++)
+                a[j] = alpha * b[j] + beta * a[j];
+        }
+        else
+        {
+            double b = alpha * (kind==BROADCAST_SCALAR? other->data[0]:
+                                other->data[i*other->stride]);
+            for (size_t j=0; j<mat->ncols; j++)
+                a[j] = b + beta * a[j];
+        }
+    }
+    return true;
+}
+
+// Elementwise product A := A .* B in place, with B broadcast as in
+// mat_axpby (e.g. a row vector of inverse standard deviations)
+bool mat_elem_mul(Matrix* mat, Matrix* other)
+{
+    Broadcast kind = broadcast_kind(mat, other);
+
+    if (kind==BROADCAST_INVALID)
+    {
+        perror("ERROR: Second operand must match or broadcast to the dimensions of the matrix.");
+        return false;
+    }
+
+    for (size_t i=0; i<mat->nrows; i++)
+    {
+        double* a = &(mat->data[i*mat->stride]);
+
+        if (kind==BROADCAST_NONE || kind==BROADCAST_ROW)
+        {
+            const double* b = kind==BROADCAST_ROW? other->data:
+                              &(other->data[i*other->stride]);
+            for (size_t j=0; j<mat->ncols; j++)
+                a[j] *= b[j];
+        }
+        else
+        {
+            double b = kind==BROADCAST_SCALAR? other->data[0]:
+                       other->data[i*other->stride];
+            for (size_t j=0; j<mat->ncols; j++)
+                a[j] *= b;
+        }
+    }
+    return true;
 }
 
 // Multiply two matrices A and B. Matrices are multiplied
@@ -902,8 +1706,7 @@ Matrix mat_mul(Matrix* mat_a,
                Matrix* mat_b,
                bool transpose_b)
 {
-    unsigned int lda, ldb;
-    unsigned int m, n, k, k_prime;
+    size_t m, n, k, k_prime;
 
     Matrix result;
     
@@ -926,14 +1729,10 @@ Matrix mat_mul(Matrix* mat_a,
     result = mat_create(m, n);
     mat_fill(&result, 0.0);
 
-    lda = transpose_a? m: k;
-    ldb = transpose_b? k: n;
-    
-    cblas_dgemm(CblasRowMajor, trans_a, trans_b,
-                m, n, k,
-                1.0, mat_a->data, lda,
-                mat_b->data, ldb, 0.0,
-                result.data, n);
+    dgemm_64(trans_a, trans_b, m, n, k,
+             1.0, mat_a->data, mat_a->stride,
+             mat_b->data, mat_b->stride, 0.0,
+             result.data, result.stride);
     return result;
 }
 
@@ -944,8 +1743,7 @@ void mat_mul_inplace(Matrix* mat_a,
                  bool transpose_b,
                  Matrix* result)
 {
-    unsigned int m, n, k, k_prime;
-    unsigned int lda, ldb;
+    size_t m, n, k, k_prime;
 
     CBLAS_TRANSPOSE trans_a = transpose_a? CblasTrans : CblasNoTrans;
     CBLAS_TRANSPOSE trans_b = transpose_b? CblasTrans : CblasNoTrans;
@@ -971,14 +1769,10 @@ void mat_mul_inplace(Matrix* mat_a,
     
     mat_fill(result, 0.0);
 
-    lda = transpose_a? m: k;
-    ldb = transpose_b? k: n;
-    
-    cblas_dgemm(CblasRowMajor, trans_a, trans_b,
-                m, n, k,
-                1.0, mat_a->data, lda,
-                mat_b->data, ldb, 0.0,
-                result->data, n);
+    dgemm_64(trans_a, trans_b, m, n, k,
+             1.0, mat_a->data, mat_a->stride,
+             mat_b->data, mat_b->stride, 0.0,
+             result->data, result->stride);
 }
 
 // Add two matrices
@@ -993,25 +1787,29 @@ void mat_add(Matrix* mat_a, Matrix* mat_b)
         return;
     }
 
-    cblas_daxpy(mat_b->nrows * mat_b->ncols, 1.0, 
-                mat_b->data, 1, mat_a->data, 1);
+    mat_axpby(mat_a, 1.0, mat_b, 1.0);
 }
 
 // Subtract two matrices
 // Subtraction is performed as A := A - B
 void mat_sub(Matrix* mat_a, Matrix* mat_b)
 {
-    Matrix copy = mat_copy(mat_b);
-    mat_scale(&copy, -1.0);
-    mat_add(mat_a, &copy);
-    mat_destroy(&copy);
+    // Ensure that both vectors are of same length
+    if (mat_a->nrows!=mat_b->nrows || mat_a->ncols!=mat_b->ncols)
+    {
+        perror("ERROR: matrices A and B must be of same dimension.");
+        mat_destroy(mat_a);
+        return;
+    }
+
+    mat_axpby(mat_a, -1.0, mat_b, 1.0);
 }
 
 // Repeat a vector along a given dimension
-Matrix mat_repeat(Matrix* vec, unsigned int dimension, unsigned int repeats)
+Matrix mat_repeat(Matrix* vec, unsigned int dimension, size_t repeats)
 {
     Matrix repeated;
-    unsigned int nidx, idx_fac, inc;
+    size_t nidx, idx_fac, inc, inc_vec;
     bool err = false;
 
     // Check if vec is a vector
@@ -1021,6 +1819,8 @@ Matrix mat_repeat(Matrix* vec, unsigned int dimension, unsigned int repeats)
         mat_destroy(&repeated);
         return repeated;
     }
+    // Consecutive elements of a column vector are a stride apart
+    inc_vec = vec->ncols==1? vec->stride: 1;
     
     switch (dimension)
     {
@@ -1058,51 +1858,41 @@ Matrix mat_repeat(Matrix* vec, unsigned int dimension, unsigned int repeats)
     }
     
     for (size_t i=0; i<repeats; i++)
-        cblas_dcopy(nidx, vec->data, 1, &(repeated.data[idx_fac*i]), inc);
+        dcopy_64(nidx, vec->data, inc_vec, &(repeated.data[idx_fac*i]), inc);
 
     return repeated;
 }
 
 // Add a vector to a matrix
 // Addition is done as: A := A + B
-// where vector B is repeated along the number
+// where vector B is broadcast along the number
 // of dimensions as required to match A's dimensions.
 void mat_vec_add(Matrix* mat, Matrix* vec)
 {
-    Matrix repeated;
     if (vec->nrows>1 && vec->ncols>1)
     {
         perror("ERROR: Second argument must be a vector.");
         mat_destroy(mat);
         return;
     }
-    if (vec->nrows==1)
-        repeated = mat_repeat(vec, 0, mat->nrows);
-    else
-        repeated = mat_repeat(vec, 1, mat->ncols);
-    mat_add(mat, &repeated);
-    mat_destroy(&repeated);
+    if (!mat_axpby(mat, 1.0, vec, 1.0))
+        mat_destroy(mat);
 }
 
 // Subtract a vector from a matrix
 // Subtraction is done as: A := A - B
-// where vector B is repeated along the number
+// where vector B is broadcast along the number
 // of dimensions as required to match A's dimensions.
 void mat_vec_sub(Matrix* mat, Matrix* vec)
 {
-    Matrix repeated;
     if (vec->nrows>1 && vec->ncols>1)
     {
         perror("ERROR: Second argument must be a vector.");
         mat_destroy(mat);
         return;
     }
-    if (vec->nrows==1)
-        repeated = mat_repeat(vec, 0, mat->nrows);
-    else
-        repeated = mat_repeat(vec, 1, mat->ncols);
-    mat_sub(mat, &repeated);
-    mat_destroy(&repeated);
+    if (!mat_axpby(mat, -1.0, vec, 1.0))
+        mat_destroy(mat);
 }
 
 // Gather rows/columns from "from" and store in
@@ -1112,35 +1902,129 @@ void mat_gather(Matrix* from,
                 IntMatrix* indices,
                 unsigned int dimension)
 {
-    IntMatrix idxs, idxs_repeated, ind_arg_cpy;
     switch (dimension)
     {
         case 0:
-            idxs = intmat_range(0, from->ncols, 1, 1);
-            idxs_repeated = intmat_repeat(&idxs, 0, 
-                                    indices->nrows);
-            ind_arg_cpy = intmat_copy(indices);
-            intmat_scale(&ind_arg_cpy, from->ncols); 
-            intmat_vec_add(&idxs_repeated, &ind_arg_cpy);
-            break;
+            mat_gather_rows(from, to, indices, 1);
+            return;
         case 1:
-            idxs = intmat_range(0, from->nrows, 1, 0);
-            intmat_scale(&idxs, from->ncols);
-            idxs_repeated = intmat_repeat(&idxs, 1,
-                                indices->ncols);
-            intmat_vec_add(&idxs_repeated, indices);
-            break;
+            if (!column_indices_valid(indices, from->nrows, from->ncols)
+                    || to->nrows!=from->nrows
+                    || to->ncols!=(indices->nrows==1? indices->ncols: 1))
+            {
+                perror("ERROR: Invalid indices or destination dimensions for gather.");
+                return;
+            }
+            for (size_t i=0; i<to->nrows; i++)
+                for (size_t j=0; j<to->ncols; j++)
+                    to->data[i*to->stride+j] = from->data[i*from->stride
+                                    + column_index(indices, i, j)];
+            return;
         default:
             perror("Dimension must be either rows(0) or columns(1).");
             mat_destroy(to);
             return;
     }
-    dusga(idxs_repeated.nrows*idxs_repeated.ncols, from->data,
-             1, to->data, (const unsigned int*)idxs_repeated.data);
+}
+
+// Gather the rows of "from" listed in "indices" into "to", copying
+// each row as a whole. Rows are split over "n_threads" threads for
+// large gathers (0 or 1 gathers on the calling thread only).
+void mat_gather_rows(Matrix* from,
+                     Matrix* to,
+                     IntMatrix* indices,
+                     unsigned int n_threads)
+{
+    if (from==NULL || to==NULL || indices==NULL)
+    {
+        perror("ERROR: Null pointer in argument matrices.");
+        return;
+    }
+    if (to->nrows!=indices->nrows*indices->ncols || to->ncols!=from->ncols)
+    {
+        perror("ERROR: Destination must have one row per index and as many columns as source.");
+        return;
+    }
+    if (!row_indices_valid(indices->data, to->nrows, from->nrows))
+    {
+        perror("ERROR: Row index out of range.");
+        return;
+    }
 
-    intmat_destroy(&ind_arg_cpy);
-    intmat_destroy(&idxs);
-    intmat_destroy(&idxs_repeated);
+    gather_rows((const char*)from->data, from->stride*sizeof(double),
+                (char*)to->data, to->stride*sizeof(double),
+                from->ncols*sizeof(double), indices->data,
+                to->nrows, n_threads);
+}
+
+// Cholesky factorization A = U^T U of a symmetric positive
+// definite matrix, in place. Only the upper triangle of A is read
+// and it is overwritten by the upper triangular factor U; the
+// strict lower triangle is left untouched. Returns false if A is
+// not positive definite, up to rounding error.
+bool mat_cholesky(Matrix* mat)
+{
+    size_t n, lda;
+    double* a;
+    double pivot;
+
+    if (mat==NULL || mat->data==NULL)
+    {
+        perror("ERROR: Null pointer in argument matrix.");
+        return false;
+    }
+    if (mat->nrows!=mat->ncols)
+    {
+        perror("ERROR: Cholesky factorization requires a square matrix.");
+        return false;
+    }
+
+    n = mat->nrows;
+    lda = mat->stride;
+    a = mat->data;
+    for (size_t i=0; i<n; i++)
+    {
+        // U[i][i] = sqrt(A[i][i] - sum_{k<i} U[k][i]^2). A pivot
+        // lost to rounding error means A is numerically singular.
+        pivot = a[i*lda+i] - cblas_ddot(i, &a[i], lda, &a[i], lda);
+        if (pivot<=(double)n*DBL_EPSILON*a[i*lda+i])
+        {
+            perror("ERROR: Matrix is not positive definite.");
+            return false;
+        }
+        a[i*lda+i] = sqrt(pivot);
+
+        // U[i][j] = (A[i][j] - sum_{k<i} U[k][i] U[k][j]) / U[i][i]
+        for (size_t j=i+1; j<n; j++)
+            a[i*lda+j] = (a[i*lda+j] - cblas_ddot(i, &a[i], lda, &a[j], lda))
+                            / a[i*lda+i];
+    }
+    return true;
+}
+
+// Solve A x = b given the Cholesky factor U of A (see
+// mat_cholesky). rhs holds b on entry and x on exit.
+void mat_cholesky_solve(Matrix* factor, Matrix* rhs)
+{
+    if (factor==NULL || rhs==NULL)
+    {
+        perror("ERROR: Null pointer in argument matrices.");
+        return;
+    }
+    if (factor->nrows!=factor->ncols || rhs->nrows!=factor->nrows
+            || rhs->ncols!=1)
+    {
+        perror("ERROR: Incorrect dimensions of factor or right hand side.");
+        return;
+    }
+
+    // U^T z = b, then U x = z
+    cblas_dtrsv(CblasRowMajor, CblasUpper, CblasTrans, CblasNonUnit,
+                factor->nrows, factor->data, factor->stride,
+                rhs->data, rhs->stride);
+    cblas_dtrsv(CblasRowMajor, CblasUpper, CblasNoTrans, CblasNonUnit,
+                factor->nrows, factor->data, factor->stride,
+                rhs->data, rhs->stride);
 }
 
 // Destroy a matrix
@@ -1148,7 +2032,513 @@ void mat_destroy(Matrix* matrix)
 {
     if (matrix==NULL)
         return;
-    if ((matrix->data)!=NULL)
+    if ((matrix->data)!=NULL && matrix->owner)
         free(matrix->data);
     matrix->data = NULL;
 }
+
+/************************************************************************/
+/***************Functions for FMatrix (single precision data)************/
+/************************************************************************/
+
+// Create a single precision matrix
+FMatrix fmat_create(size_t nrows, size_t ncols)
+{
+    FMatrix matrix;
+
+    matrix.nrows = nrows;
+    matrix.ncols = ncols;
+    matrix.stride = matrix.ncols;
+    matrix.owner = true;
+
+    if (nrows==0 || ncols==0)
+    {
+        perror("ERROR: Number of rows/columns cannot be zero.");
+        matrix.data = NULL;
+        return matrix;
+    }
+
+    matrix.data = (float *)calloc(matrix.nrows * matrix.ncols,
+                                  sizeof(float));
+
+    return matrix;
+}
+
+// Print a single precision matrix
+void fmat_print(const FMatrix* mat)
+{
+    if (mat==NULL)
+        return;
+    if (mat->data==NULL)
+        return;
+
+    for (size_t i=0; i<mat->nrows; i++)
+    {
+        for (size_t j=0; j<mat->ncols; j++)
+            printf("%.4f ", mat->data[i*mat->stride+j]);
+        printf("\n");
+    }
+}
+
+// Fill a single precision matrix with a single value
+void fmat_fill(FMatrix* mat, float value)
+{
+    if (mat==NULL)
+        return;
+    if (mat->data==NULL)
+        return;
+    for (size_t i=0; i<mat->nrows; i++)
+        for (size_t j=0; j<mat->ncols; j++)
+            mat->data[i*mat->stride+j] = value;
+}
+
+// Fill a single precision matrix with random numbers between
+// 0.0 and 1.0 (half-open)
+void fmat_fill_random(FMatrix* mat, unsigned int seed)
+{
+    if (mat->data==NULL)
+        return;
+    fill_uniform(NULL, mat->data, mat->nrows, mat->ncols, mat->stride, seed);
+}
+
+// Whether the rows of a single precision matrix are stored back to back
+bool fmat_is_contiguous(const FMatrix* mat)
+{
+    return mat->stride==mat->ncols || mat->nrows<=1;
+}
+
+// View of the nrows x ncols block of "mat" starting at (row, col)
+// (see mat_view)
+FMatrix fmat_view(FMatrix* mat,
+                  size_t row, size_t col,
+                  size_t nrows, size_t ncols)
+{
+    FMatrix view;
+    view.nrows = nrows;
+    view.ncols = ncols;
+    view.stride = mat->stride;
+    view.owner = false;
+    view.data = NULL;
+
+    if (mat->data==NULL || nrows==0 || ncols==0 ||
+            row+nrows>mat->nrows || col+ncols>mat->ncols)
+    {
+        perror("ERROR: View exceeds the dimensions of the matrix.");
+        return view;
+    }
+    view.data = &(mat->data[row*mat->stride+col]);
+    return view;
+}
+
+// Copy a single precision matrix
+FMatrix fmat_copy(FMatrix* mat)
+{
+    FMatrix copy = fmat_create(mat->nrows, mat->ncols);
+    fmat_copy_inplace(mat, &copy);
+    return copy;
+}
+
+// Copy a single precision matrix inplace
+void fmat_copy_inplace(FMatrix* mat, FMatrix* copy)
+{
+    if (mat->nrows!=copy->nrows || mat->ncols!=copy->ncols)
+    {
+        perror("ERROR: copy and original matrix must have same dimensions.");
+        return;
+    }
+    if (fmat_is_contiguous(mat) && fmat_is_contiguous(copy))
+    {
+        scopy_64(mat->nrows*mat->ncols, mat->data,
+                 1, copy->data, 1);
+        return;
+    }
+    for (size_t i=0; i<mat->nrows; i++)
+        cblas_scopy(mat->ncols, &(mat->data[i*mat->stride]),
+                    1, &(copy->data[i*copy->stride]), 1);
+}
+
+// Single precision copy of a double precision matrix
+FMatrix fmat_from_mat(Matrix* mat)
+{
+    FMatrix out = fmat_create(mat->nrows, mat->ncols);
+
+    if (out.data==NULL)
+        return out;
+    for (size_t i=0; i<mat->nrows; i++)
+        for (size_t j=0; j<mat->ncols; j++)
+            out.data[i*out.stride+j] = (float)mat->data[i*mat->stride+j];
+    return out;
+}
+
+// Double precision copy of a single precision matrix
+Matrix mat_from_fmat(FMatrix* mat)
+{
+    Matrix out = mat_create(mat->nrows, mat->ncols);
+
+    if (out.data==NULL)
+        return out;
+    for (size_t i=0; i<mat->nrows; i++)
+        for (size_t j=0; j<mat->ncols; j++)
+            out.data[i*out.stride+j] = (double)mat->data[i*mat->stride+j];
+    return out;
+}
+
+// Scale a single precision matrix by a scalar
+void fmat_scale(FMatrix* mat, float fac)
+{
+    if (fmat_is_contiguous(mat))
+    {
+        sscal_64(mat->nrows*mat->ncols, fac, mat->data, 1);
+        return;
+    }
+    for (size_t i=0; i<mat->nrows; i++)
+        cblas_sscal(mat->ncols, fac, &(mat->data[i*mat->stride]), 1);
+}
+
+// Euclidean norm of a single precision matrix, accumulated
+// in double precision
+double fmat_norm(FMatrix* mat)
+{
+    double sum_sq = 0.0;
+
+    if (mat==NULL)
+    {
+        perror("ERROR: Null pointer in argument matrix.");
+        return 0.0;
+    }
+    for (size_t i=0; i<mat->nrows; i++)
+        for (size_t j=0; j<mat->ncols; j++)
+        {
+            double val = mat->data[i*mat->stride+j];
+            sum_sq += val * val;
+        }
+    return sqrt(sum_sq);
+}
+
+// A := A + alpha B for single precision matrices
+static void fmat_axpy(FMatrix* mat_a, float alpha, FMatrix* mat_b)
+{
+    if (mat_a->nrows!=mat_b->nrows || mat_a->ncols!=mat_b->ncols)
+    {
+        perror("ERROR: matrices A and B must be of same dimension.");
+        return;
+    }
+
+    if (fmat_is_contiguous(mat_a) && fmat_is_contiguous(mat_b))
+    {
+        saxpy_64(mat_b->nrows * mat_b->ncols, alpha,
+                 mat_b->data, 1, mat_a->data, 1);
+        return;
+    }
+    for (size_t i=0; i<mat_a->nrows; i++)
+        cblas_saxpy(mat_b->ncols, alpha, &(mat_b->data[i*mat_b->stride]), 1,
+                    &(mat_a->data[i*mat_a->stride]), 1);
+}
+
+// Add two single precision matrices, A := A + B
+void fmat_add(FMatrix* mat_a, FMatrix* mat_b)
+{
+    fmat_axpy(mat_a, 1.0f, mat_b);
+}
+
+// Subtract two single precision matrices, A := A - B
+void fmat_sub(FMatrix* mat_a, FMatrix* mat_b)
+{
+    fmat_axpy(mat_a, -1.0f, mat_b);
+}
+
+// Multiply two single precision matrices A and B (see mat_mul)
+FMatrix fmat_mul(FMatrix* mat_a,
+                 bool transpose_a,
+                 FMatrix* mat_b,
+                 bool transpose_b)
+{
+    size_t m, n, k_prime;
+    FMatrix result;
+
+    m = transpose_a? mat_a->ncols: mat_a->nrows;
+    k_prime = transpose_b? mat_b->ncols: mat_b->nrows;
+    n = transpose_b? mat_b->nrows: mat_b->ncols;
+
+    if ((transpose_a? mat_a->nrows: mat_a->ncols)!=k_prime)
+    {
+        result.data = NULL;
+        perror("ERROR: Matrix dimensions must satisfy k = k' for multiplying m x k and k' x n matrices.");
+        return result;
+    }
+
+    result = fmat_create(m, n);
+    fmat_mul_inplace(mat_a, transpose_a, mat_b, transpose_b, &result);
+    return result;
+}
+
+// Multiply two single precision matrices and store result in place
+void fmat_mul_inplace(FMatrix* mat_a,
+                      bool transpose_a,
+                      FMatrix* mat_b,
+                      bool transpose_b,
+                      FMatrix* result)
+{
+    size_t m, n, k, k_prime;
+
+    CBLAS_TRANSPOSE trans_a = transpose_a? CblasTrans : CblasNoTrans;
+    CBLAS_TRANSPOSE trans_b = transpose_b? CblasTrans : CblasNoTrans;
+
+    m = transpose_a? mat_a->ncols: mat_a->nrows;
+    k = transpose_a? mat_a->nrows: mat_a->ncols;
+    k_prime = transpose_b? mat_b->ncols: mat_b->nrows;
+    n = transpose_b? mat_b->nrows: mat_b->ncols;
+
+    if (k!=k_prime)
+    {
+        perror("ERROR: Matrix dimensions must satisfy k = k' for multiplying m x k and k' x n matrices.");
+        fmat_destroy(result);
+        return;
+    }
+    if (result->nrows!=m || result->ncols!=n)
+    {
+        perror("ERROR: Incorrect dimensions of result matrix.");
+        fmat_destroy(result);
+        return;
+    }
+
+    sgemm_64(trans_a, trans_b, m, n, k,
+             1.0f, mat_a->data, mat_a->stride,
+             mat_b->data, mat_b->stride, 0.0f,
+             result->data, result->stride);
+}
+
+// Gather the rows of "from" listed in "indices" into "to"
+// (see mat_gather_rows)
+void fmat_gather_rows(FMatrix* from,
+                      FMatrix* to,
+                      IntMatrix* indices,
+                      unsigned int n_threads)
+{
+    if (from==NULL || to==NULL || indices==NULL)
+    {
+        perror("ERROR: Null pointer in argument matrices.");
+        return;
+    }
+    if (to->nrows!=indices->nrows*indices->ncols || to->ncols!=from->ncols)
+    {
+        perror("ERROR: Destination must have one row per index and as many columns as source.");
+        return;
+    }
+    if (!row_indices_valid(indices->data, to->nrows, from->nrows))
+    {
+        perror("ERROR: Row index out of range.");
+        return;
+    }
+
+    gather_rows((const char*)from->data, from->stride*sizeof(float),
+                (char*)to->data, to->stride*sizeof(float),
+                from->ncols*sizeof(float), indices->data,
+                to->nrows, n_threads);
+}
+
+// Gather the rows of a single precision matrix listed in
+// "indices" into a double precision matrix, widening each element.
+// Lets a solver keep X in single precision and do its arithmetic
+// on double precision minibatches.
+void mat_gather_rows_from_fmat(FMatrix* from,
+                               Matrix* to,
+                               IntMatrix* indices)
+{
+    if (from==NULL || to==NULL || indices==NULL)
+    {
+        perror("ERROR: Null pointer in argument matrices.");
+        return;
+    }
+    if (to->nrows!=indices->nrows*indices->ncols || to->ncols!=from->ncols)
+    {
+        perror("ERROR: Destination must have one row per index and as many columns as source.");
+        return;
+    }
+    if (!row_indices_valid(indices->data, to->nrows, from->nrows))
+    {
+        perror("ERROR: Row index out of range.");
+        return;
+    }
+
+    for (size_t i=0; i<to->nrows; i++)
+    {
+        const float* src;
+        double* dst = &(to->data[i*to->stride]);
+
+        if (i+GATHER_PREFETCH_ROWS<to->nrows)
+        {
+            const char* ahead = (const char*)&(from->data[
+                (size_t)indices->data[i+GATHER_PREFETCH_ROWS]*from->stride]);
+            for (size_t b=0; b<from->ncols*sizeof(float); b+=64)
+                __builtin_prefetch(ahead+b, 0, 0);
+        }
+        src = &(from->data[(size_t)indices->data[i]*from->stride]);
+        for (size_t j=0; j<to->ncols; j++)
+            dst[j] = (double)src[j];
+    }
+}
+
+// Destroy a single precision matrix
+void fmat_destroy(FMatrix* matrix)
+{
+    if (matrix==NULL)
+        return;
+    if ((matrix->data)!=NULL && matrix->owner)
+        free(matrix->data);
+    matrix->data = NULL;
+}
+
+/************************************************************************/
+/***************Functions for MatArena (temporary matrices)**************/
+/************************************************************************/
+
+// Allocation granularity in doubles (one 64 byte cache line)
+#define ARENA_ALIGN 8
+
+// Heap block for allocations that did not fit into the arena
+struct MatArenaBlock
+{
+    MatArenaBlock* next;
+    double* data;
+};
+
+// Round a number of doubles up to the allocation granularity
+static size_t arena_round(size_t n_elem)
+{
+    return (n_elem + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+}
+
+// Allocate "n_elem" doubles aligned to a cache line
+static double* arena_buffer(size_t n_elem)
+{
+    return (double *)aligned_alloc(ARENA_ALIGN*sizeof(double),
+                                   arena_round(n_elem)*sizeof(double));
+}
+
+// Create an arena with room for "capacity" doubles.
+// A capacity of zero is allowed; the arena then sizes
+// itself on the first reset.
+MatArena mat_arena_create(size_t capacity)
+{
+    MatArena arena;
+    arena.capacity = arena_round(capacity);
+    arena.offset = 0;
+    arena.used = 0;
+    arena.overflow = NULL;
+    arena.data = arena.capacity>0? arena_buffer(arena.capacity): NULL;
+    if (arena.capacity>0 && arena.data==NULL)
+    {
+        perror("ERROR: Could not allocate arena.");
+        arena.capacity = 0;
+    }
+    return arena;
+}
+
+// Draw a zero-filled matrix from an arena. The matrix does not
+// own its data and must not outlive the next mat_arena_reset.
+Matrix mat_arena_alloc(MatArena* arena, size_t nrows, size_t ncols)
+{
+    Matrix matrix;
+    size_t n_elem;
+    MatArenaBlock* block;
+
+    matrix.nrows = nrows;
+    matrix.ncols = ncols;
+    matrix.stride = matrix.ncols;
+    matrix.owner = false;
+    matrix.data = NULL;
+
+    if (arena==NULL)
+    {
+        perror("ERROR: Null pointer in argument arena.");
+        return matrix;
+    }
+    if (nrows==0 || ncols==0)
+    {
+        perror("ERROR: Number of rows/columns cannot be zero.");
+        return matrix;
+    }
+
+    n_elem = arena_round(nrows * ncols);
+    arena->used += n_elem;
+
+    if (arena->offset+n_elem<=arena->capacity)
+    {
+        matrix.data = &(arena->data[arena->offset]);
+        arena->offset += n_elem;
+    }
+    else
+    {
+        // Does not fit, keep it in an overflow block until the
+        // next reset
+        block = (MatArenaBlock *)malloc(sizeof(MatArenaBlock));
+        if (block!=NULL)
+        {
+            block->data = arena_buffer(n_elem);
+            if (block->data==NULL)
+                free(block);
+            else
+            {
+                block->next = arena->overflow;
+                arena->overflow = block;
+                matrix.data = block->data;
+            }
+        }
+    }
+    if (matrix.data==NULL)
+    {
+        perror("ERROR: Could not allocate matrix from arena.");
+        return matrix;
+    }
+
+    memset(matrix.data, 0, n_elem*sizeof(double));
+    return matrix;
+}
+
+// Route mat_create on the calling thread through "arena"
+// (NULL restores heap allocation). Returns the previously
+// bound arena so that bindings can be nested.
+MatArena* mat_arena_bind(MatArena* arena)
+{
+    MatArena* previous = bound_arena;
+    bound_arena = arena;
+    return previous;
+}
+
+// Release all matrices drawn from an arena. If the last cycle
+// overflowed, the arena is grown to hold all of it.
+void mat_arena_reset(MatArena* arena)
+{
+    MatArenaBlock* block;
+
+    if (arena==NULL)
+        return;
+
+    while (arena->overflow!=NULL)
+    {
+        block = arena->overflow;
+        arena->overflow = block->next;
+        free(block->data);
+        free(block);
+    }
+    if (arena->used>arena->capacity)
+    {
+        free(arena->data);
+        arena->data = arena_buffer(arena->used);
+        arena->capacity = arena->data!=NULL? arena->used: 0;
+    }
+    arena->offset = 0;
+    arena->used = 0;
+}
+
+// Destroy an arena and every matrix drawn from it
+void mat_arena_destroy(MatArena* arena)
+{
+    if (arena==NULL)
+        return;
+    mat_arena_reset(arena);
+    free(arena->data);
+    arena->data = NULL;
+    arena->capacity = 0;
+}
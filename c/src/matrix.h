@@ -4,24 +4,118 @@
 #define _MATRIX_H_
 
 #include <stdio.h>
+#include <stddef.h>
 #include <stdbool.h>
+#include <cblas.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 // Matrix for double precision data
+// Dimensions and element counts are size_t throughout, so matrices
+// may hold more than 2^32 elements.
+// Rows are stored "stride" elements apart (the BLAS leading
+// dimension), which is ncols for contiguous matrices and larger
+// for views into another matrix. Matrices that do not own their
+// data (views, matrices drawn from a MatArena) are not freed by
+// mat_destroy.
 typedef struct
 {
-    unsigned int nrows, ncols;
+    size_t nrows, ncols;
+    size_t stride;
     double *data;
+    bool owner;
 } Matrix;
 
-// Matrix for integer data
+// Matrix for single precision data
+// Same layout and ownership rules as Matrix, at half the bytes
+// per element.
+typedef struct
+{
+    size_t nrows, ncols;
+    size_t stride;
+    float *data;
+    bool owner;
+} FMatrix;
+
+// Matrix for integer data. Also holds row indices (minibatches,
+// gathers), which limits indexed matrices to INT_MAX rows.
 typedef struct
 {
-    unsigned int nrows, ncols;
+    size_t nrows, ncols;
     int *data;
 } IntMatrix;
 
+// Arena (bump) allocator for temporary double matrices.
+// Matrices drawn from an arena stay valid until the next
+// mat_arena_reset. Allocations that do not fit go to overflow
+// blocks; the next reset grows the arena to the high water mark,
+// so a loop that resets once per iteration stops allocating
+// after its first iteration.
+typedef struct MatArenaBlock MatArenaBlock;
+typedef struct
+{
+    size_t capacity, offset;  // In doubles
+    size_t used;              // Including overflow, since last reset
+    double* data;
+    MatArenaBlock* overflow;
+} MatArena;
+
+// Micro-kernels of igemm, in order of preference
+typedef enum
+{
+    IGEMM_AUTO,     // Fastest kernel the processor supports
+    IGEMM_GENERIC,  // Portable C
+    IGEMM_AVX2,
+    IGEMM_AVX512
+} IGemmKernel;
+
+// Integer matrix multiplication, C := alpha * op(A) op(B) + beta * C
+// (BLAS ?gemm conventions, row-major)
+void igemm(const CBLAS_TRANSPOSE transa, const CBLAS_TRANSPOSE transb,
+        const size_t m, const size_t n, const size_t k,
+        const int alpha, const int* a, const size_t lda,
+        const int* b, const size_t ldb,
+        const int beta, int* c, const size_t ldc);
+IGemmKernel igemm_set_kernel(IGemmKernel kernel);
+
+// BLAS calls taking 64-bit lengths, split into several calls
+// when the BLAS library only takes 32-bit ones
+void dcopy_64(size_t num_elem, const double* x, size_t incx,
+              double* y, size_t incy);
+void dscal_64(size_t num_elem, double alpha, double* x, size_t incx);
+void daxpy_64(size_t num_elem, double alpha, const double* x,
+              size_t incx, double* y, size_t incy);
+void scopy_64(size_t num_elem, const float* x, size_t incx,
+              float* y, size_t incy);
+void sscal_64(size_t num_elem, float alpha, float* x, size_t incx);
+void saxpy_64(size_t num_elem, float alpha, const float* x,
+              size_t incx, float* y, size_t incy);
+double ddot_64(size_t num_elem, const double* x, size_t incx,
+               const double* y, size_t incy);
+double dasum_64(size_t num_elem, const double* x, size_t incx);
+double dnrm2_64(size_t num_elem, const double* x, size_t incx);
+void dgemv_64(CBLAS_TRANSPOSE trans, size_t m, size_t n,
+              double alpha, const double* a, size_t lda,
+              const double* x, size_t incx,
+              double beta, double* y, size_t incy);
+void dgemm_64(CBLAS_TRANSPOSE transa, CBLAS_TRANSPOSE transb,
+              size_t m, size_t n, size_t k,
+              double alpha, const double* a, size_t lda,
+              const double* b, size_t ldb,
+              double beta, double* c, size_t ldc);
+void sgemm_64(CBLAS_TRANSPOSE transa, CBLAS_TRANSPOSE transb,
+              size_t m, size_t n, size_t k,
+              float alpha, const float* a, size_t lda,
+              const float* b, size_t ldb,
+              float beta, float* c, size_t ldc);
+void dsyrk_64(size_t n, size_t k, double alpha,
+              const double* a, size_t lda,
+              double beta, double* c, size_t ldc);
+
 // Functions for integer matrices
-IntMatrix intmat_create(int nrow, int ncol);
+IntMatrix intmat_create(size_t nrow, size_t ncol);
 IntMatrix intmat_copy(IntMatrix* mat);
 void intmat_copy_inplace(IntMatrix* mat, IntMatrix* copy);
 IntMatrix intmat_range(int low, int high, unsigned int step,
@@ -39,7 +133,7 @@ IntMatrix intmat_mul(IntMatrix* mat_a, bool transpose_a,
 void intmat_mul_inplace(IntMatrix* mat_a, bool transpose_a, IntMatrix* mat_b,
                      bool transpose_b, IntMatrix* result);
 IntMatrix intmat_repeat(IntMatrix* vec, unsigned int dimension, 
-                        unsigned int repeats);
+                        size_t repeats);
 void intmat_vec_add(IntMatrix* mat, IntMatrix* vec);
 void intmat_vec_sub(IntMatrix* mat, IntMatrix* vec);
 void intmat_gather(IntMatrix* from, IntMatrix* to, IntMatrix* indices,
@@ -48,7 +142,10 @@ void intmat_destroy(IntMatrix* matrix);
 
 
 // Functions for double matrices
-Matrix mat_create(int nrow, int ncol);
+Matrix mat_create(size_t nrow, size_t ncol);
+Matrix mat_view(Matrix* mat, size_t row, size_t col,
+                size_t nrows, size_t ncols);
+bool mat_is_contiguous(const Matrix* mat);
 Matrix mat_copy(Matrix* mat);
 void mat_copy_inplace(Matrix* mat, Matrix* copy);
 void mat_print(const Matrix* matrix);
@@ -62,17 +159,61 @@ void mat_scale(Matrix* mat, double fac);
 double mat_abs_sum(Matrix* mat);
 double mat_norm(Matrix* mat);
 void mat_add_scalar(Matrix* mat, double scalar);
+void mat_scale_shift(Matrix* mat, double scale, double shift);
+bool mat_axpby(Matrix* mat, double alpha, Matrix* other, double beta);
+bool mat_elem_mul(Matrix* mat, Matrix* other);
 void mat_add(Matrix* mat_a, Matrix* mat_b);
 void mat_sub(Matrix* mat_a, Matrix* mat_b);
 Matrix mat_mul(Matrix* mat_a, bool transpose_a, 
                Matrix* mat_b, bool transpose_b);
 void mat_mul_inplace(Matrix* mat_a, bool transpose_a, Matrix* mat_b,
                      bool transpose_b, Matrix* result);
-Matrix mat_repeat(Matrix* vec, unsigned int dimension, unsigned int repeats);
+Matrix mat_repeat(Matrix* vec, unsigned int dimension, size_t repeats);
 void mat_vec_add(Matrix* mat, Matrix* vec);
 void mat_vec_sub(Matrix* mat, Matrix* vec);
 void mat_gather(Matrix* from, Matrix* to, IntMatrix* indices,
                 unsigned int dimension);
+void mat_gather_rows(Matrix* from, Matrix* to, IntMatrix* indices,
+                     unsigned int n_threads);
+bool mat_cholesky(Matrix* mat);
+void mat_cholesky_solve(Matrix* factor, Matrix* rhs);
 void mat_destroy(Matrix* matrix);
 
+// Functions for single precision matrices
+FMatrix fmat_create(size_t nrow, size_t ncol);
+FMatrix fmat_view(FMatrix* mat, size_t row, size_t col,
+                  size_t nrows, size_t ncols);
+bool fmat_is_contiguous(const FMatrix* mat);
+FMatrix fmat_copy(FMatrix* mat);
+void fmat_copy_inplace(FMatrix* mat, FMatrix* copy);
+FMatrix fmat_from_mat(Matrix* mat);
+Matrix mat_from_fmat(FMatrix* mat);
+void fmat_print(const FMatrix* matrix);
+void fmat_fill(FMatrix* matrix, float value);
+void fmat_fill_random(FMatrix* matrix, unsigned int seed);
+void fmat_scale(FMatrix* mat, float fac);
+double fmat_norm(FMatrix* mat);
+void fmat_add(FMatrix* mat_a, FMatrix* mat_b);
+void fmat_sub(FMatrix* mat_a, FMatrix* mat_b);
+FMatrix fmat_mul(FMatrix* mat_a, bool transpose_a,
+                 FMatrix* mat_b, bool transpose_b);
+void fmat_mul_inplace(FMatrix* mat_a, bool transpose_a, FMatrix* mat_b,
+                      bool transpose_b, FMatrix* result);
+void fmat_gather_rows(FMatrix* from, FMatrix* to, IntMatrix* indices,
+                      unsigned int n_threads);
+void mat_gather_rows_from_fmat(FMatrix* from, Matrix* to,
+                               IntMatrix* indices);
+void fmat_destroy(FMatrix* matrix);
+
+// Functions for matrix arenas
+MatArena mat_arena_create(size_t capacity);
+Matrix mat_arena_alloc(MatArena* arena, size_t nrow, size_t ncol);
+MatArena* mat_arena_bind(MatArena* arena);
+void mat_arena_reset(MatArena* arena);
+void mat_arena_destroy(MatArena* arena);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // _MATRIX_H_
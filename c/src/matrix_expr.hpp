@@ -0,0 +1,493 @@
+// Expression templates over Matrix (C++ only, header-only)
+//
+// MatRef is a view of a C Matrix and Mat an owning one with RAII.
+// Arithmetic on them builds lightweight expression objects instead
+// of computing anything; the work happens when an expression is
+// assigned to a MatRef/Mat or reduced to a scalar:
+//
+//     r = X * theta - y;          // one dgemv into r, no temporaries
+//     g = t(X) * r;               // dgemv with X transposed
+//     loss = sum_sq(y - y_pred);  // one fused loop
+//
+// Elementwise chains (+, -, scalar arithmetic, hadamard, abs,
+// square) are evaluated in a single loop over the destination.
+// Matrix products (*) dispatch to dgemm/dgemv writing straight into
+// the destination. A product may appear alone, scaled, or as one
+// side of a + or - whose other side is elementwise; the destination
+// must not alias the operands of the product. Expressions hold views
+// of their operands, so they must be evaluated within the statement
+// that builds them.
+//
+// Dimension mismatches are reported with perror, as in matrix.h,
+// and the destination is left unchanged (reductions return 0).
+
+#ifndef _MATRIX_EXPR_HPP_
+#define _MATRIX_EXPR_HPP_
+
+#include <cstdio>
+#include <cmath>
+#include <cstddef>
+#include "matrix.h"
+
+namespace mx
+{
+
+// Base of all expressions (CRTP)
+template <typename E>
+struct Expr
+{
+    const E& self() const { return static_cast<const E&>(*this); }
+};
+
+/************************************************************/
+/*************************Leaves*****************************/
+/************************************************************/
+
+// Non-owning view of a Matrix. Copies of a MatRef refer to the same
+// elements; assigning an expression to it writes the elements.
+class MatRef : public Expr<MatRef>
+{
+public:
+    explicit MatRef(const Matrix& mat) : m_(mat) {}
+
+    size_t rows() const { return m_.nrows; }
+    size_t cols() const { return m_.ncols; }
+    bool conforms() const { return true; }
+    double operator()(size_t i, size_t j) const { return m_.data[i*m_.stride+j]; }
+    double& operator()(size_t i, size_t j) { return m_.data[i*m_.stride+j]; }
+    double* row_data(size_t i) const { return m_.data + i*m_.stride; }
+
+    // BLAS description as an operand of a product
+    const Matrix& matrix() const { return m_; }
+    CBLAS_TRANSPOSE trans() const { return CblasNoTrans; }
+    size_t vector_inc() const { return m_.ncols==1? m_.stride: 1; }
+
+    MatRef row(size_t i) const { return MatRef(mat_view(const_cast<Matrix*>(&m_), i, 0, 1, m_.ncols)); }
+
+    MatRef(const MatRef& other) = default;
+    MatRef& operator=(const MatRef& other) { return assign_from(other); }
+    template <typename E>
+    MatRef& operator=(const Expr<E>& e) { return assign_from(e.self()); }
+    template <typename E>
+    MatRef& operator+=(const Expr<E>& e) { return update_from(e.self(), 1.0); }
+    template <typename E>
+    MatRef& operator-=(const Expr<E>& e) { return update_from(e.self(), -1.0); }
+    MatRef& operator=(double s);
+    MatRef& operator+=(double s);
+    MatRef& operator-=(double s) { return *this += -s; }
+    MatRef& operator*=(double s);
+
+protected:
+    template <typename E> MatRef& assign_from(const E& e);
+    template <typename E> MatRef& update_from(const E& e, double sign);
+
+    Matrix m_;
+};
+
+// Owning matrix, freed when it goes out of scope. Drawn from the
+// bound MatArena if there is one (see mat_create).
+class Mat : public MatRef
+{
+public:
+    Mat(size_t nrows, size_t ncols) : MatRef(mat_create(nrows, ncols)) {}
+    template <typename E>
+    Mat(const Expr<E>& e) : MatRef(mat_create(e.self().rows(), e.self().cols()))
+    {
+        assign_from(e.self());
+    }
+    Mat(Mat&& other) : MatRef(other.m_) { other.m_.data = NULL; }
+    Mat(const Mat&) = delete;
+    ~Mat() { mat_destroy(&m_); }
+
+    using MatRef::operator=;
+    Mat& operator=(const Mat& other) { assign_from(other); return *this; }
+
+    // Hand the matrix over to C code, which must mat_destroy it
+    Matrix release() { Matrix mat = m_; m_.data = NULL; return mat; }
+};
+
+// Transpose of a view, t(a)
+class Transposed : public Expr<Transposed>
+{
+public:
+    explicit Transposed(const MatRef& base) : base_(base) {}
+
+    size_t rows() const { return base_.cols(); }
+    size_t cols() const { return base_.rows(); }
+    bool conforms() const { return true; }
+    double operator()(size_t i, size_t j) const { return base_(j, i); }
+
+    const Matrix& matrix() const { return base_.matrix(); }
+    CBLAS_TRANSPOSE trans() const { return CblasTrans; }
+    size_t vector_inc() const { return base_.rows()==1? 1: base_.matrix().stride; }
+
+private:
+    MatRef base_;
+};
+
+inline Transposed t(const MatRef& a) { return Transposed(a); }
+
+/************************************************************/
+/*******************Elementwise expressions******************/
+/************************************************************/
+
+struct AddOp { double operator()(double a, double b) const { return a + b; } };
+struct SubOp { double operator()(double a, double b) const { return a - b; } };
+struct MulOp { double operator()(double a, double b) const { return a * b; } };
+
+struct ScaleOp
+{
+    double s;
+    double operator()(double a) const { return s * a; }
+};
+struct ShiftOp
+{
+    double s;
+    double operator()(double a) const { return a + s; }
+};
+struct AbsOp { double operator()(double a) const { return std::fabs(a); } };
+struct SquareOp { double operator()(double a) const { return a * a; } };
+
+// Elementwise binary operation of two expressions of equal shape
+template <typename L, typename R, typename Op>
+class Binary : public Expr<Binary<L, R, Op> >
+{
+public:
+    Binary(const L& l, const R& r) : l_(l), r_(r) {}
+
+    size_t rows() const { return l_.rows(); }
+    size_t cols() const { return l_.cols(); }
+    bool conforms() const
+    {
+        return l_.conforms() && r_.conforms()
+               && l_.rows()==r_.rows() && l_.cols()==r_.cols();
+    }
+    double operator()(size_t i, size_t j) const { return Op()(l_(i, j), r_(i, j)); }
+
+    const L& left() const { return l_; }
+    const R& right() const { return r_; }
+
+private:
+    L l_;
+    R r_;
+};
+
+// Elementwise function of one expression
+template <typename E, typename F>
+class Unary : public Expr<Unary<E, F> >
+{
+public:
+    Unary(const E& e, F f) : e_(e), f_(f) {}
+
+    size_t rows() const { return e_.rows(); }
+    size_t cols() const { return e_.cols(); }
+    bool conforms() const { return e_.conforms(); }
+    double operator()(size_t i, size_t j) const { return f_(e_(i, j)); }
+
+private:
+    E e_;
+    F f_;
+};
+
+// Expressions are stored by value; an owning Mat is stored as a view
+template <typename E> struct Node { typedef E type; };
+template <> struct Node<Mat> { typedef MatRef type; };
+
+template <typename L, typename R>
+Binary<typename Node<L>::type, typename Node<R>::type, AddOp>
+operator+(const Expr<L>& l, const Expr<R>& r)
+{
+    return Binary<typename Node<L>::type, typename Node<R>::type, AddOp>(l.self(), r.self());
+}
+
+template <typename L, typename R>
+Binary<typename Node<L>::type, typename Node<R>::type, SubOp>
+operator-(const Expr<L>& l, const Expr<R>& r)
+{
+    return Binary<typename Node<L>::type, typename Node<R>::type, SubOp>(l.self(), r.self());
+}
+
+// Elementwise product (operator* is the matrix product)
+template <typename L, typename R>
+Binary<typename Node<L>::type, typename Node<R>::type, MulOp>
+hadamard(const Expr<L>& l, const Expr<R>& r)
+{
+    return Binary<typename Node<L>::type, typename Node<R>::type, MulOp>(l.self(), r.self());
+}
+
+template <typename E>
+Unary<typename Node<E>::type, ScaleOp> operator*(double s, const Expr<E>& e)
+{
+    ScaleOp op = {s};
+    return Unary<typename Node<E>::type, ScaleOp>(e.self(), op);
+}
+
+template <typename E>
+Unary<typename Node<E>::type, ScaleOp> operator*(const Expr<E>& e, double s)
+{
+    return s * e;
+}
+
+template <typename E>
+Unary<typename Node<E>::type, ScaleOp> operator-(const Expr<E>& e)
+{
+    return -1.0 * e;
+}
+
+template <typename E>
+Unary<typename Node<E>::type, ShiftOp> operator+(const Expr<E>& e, double s)
+{
+    ShiftOp op = {s};
+    return Unary<typename Node<E>::type, ShiftOp>(e.self(), op);
+}
+
+template <typename E>
+Unary<typename Node<E>::type, ShiftOp> operator-(const Expr<E>& e, double s)
+{
+    return e + (-s);
+}
+
+template <typename E>
+Unary<typename Node<E>::type, AbsOp> abs(const Expr<E>& e)
+{
+    return Unary<typename Node<E>::type, AbsOp>(e.self(), AbsOp());
+}
+
+template <typename E>
+Unary<typename Node<E>::type, SquareOp> square(const Expr<E>& e)
+{
+    return Unary<typename Node<E>::type, SquareOp>(e.self(), SquareOp());
+}
+
+/************************************************************/
+/**********************Matrix products***********************/
+/************************************************************/
+
+// alpha op(A) op(B) for views or transposed views A and B. Has no
+// element access: it is only evaluated by BLAS into a destination.
+template <typename A, typename B>
+class Product : public Expr<Product<A, B> >
+{
+public:
+    Product(const A& a, const B& b, double alpha) : a_(a), b_(b), alpha_(alpha) {}
+
+    size_t rows() const { return a_.rows(); }
+    size_t cols() const { return b_.cols(); }
+    bool conforms() const { return a_.cols()==b_.rows(); }
+
+    const A& a() const { return a_; }
+    const B& b() const { return b_; }
+    double alpha() const { return alpha_; }
+
+private:
+    A a_;
+    B b_;
+    double alpha_;
+};
+
+// Operands a product can take
+template <typename E> struct Leaf {};
+template <> struct Leaf<MatRef> { typedef MatRef type; };
+template <> struct Leaf<Mat> { typedef MatRef type; };
+template <> struct Leaf<Transposed> { typedef Transposed type; };
+
+template <typename A, typename B>
+Product<typename Leaf<A>::type, typename Leaf<B>::type>
+operator*(const A& a, const B& b)
+{
+    return Product<typename Leaf<A>::type, typename Leaf<B>::type>(a, b, 1.0);
+}
+
+template <typename A, typename B>
+Product<A, B> operator*(double s, const Product<A, B>& p)
+{
+    return Product<A, B>(p.a(), p.b(), s * p.alpha());
+}
+
+template <typename A, typename B>
+Product<A, B> operator-(const Product<A, B>& p)
+{
+    return -1.0 * p;
+}
+
+// dest := p + beta dest, by dgemv if the product is a matrix times
+// a vector and by dgemm otherwise
+template <typename A, typename B>
+void gemm_into(MatRef& dest, const Product<A, B>& p, double beta)
+{
+    const Matrix& a = p.a().matrix();
+    const Matrix& b = p.b().matrix();
+
+    if (dest.cols()==1)
+        dgemv_64(p.a().trans(), a.nrows, a.ncols, p.alpha(),
+                 a.data, a.stride, b.data, p.b().vector_inc(),
+                 beta, dest.row_data(0), dest.matrix().stride);
+    else
+        dgemm_64(p.a().trans(), p.b().trans(),
+                 p.rows(), p.cols(), p.a().cols(), p.alpha(),
+                 a.data, a.stride, b.data, b.stride,
+                 beta, dest.row_data(0), dest.matrix().stride);
+}
+
+/************************************************************/
+/************************Evaluation**************************/
+/************************************************************/
+
+template <typename E>
+bool check_shape(const MatRef& dest, const E& e)
+{
+    if (!e.conforms() || dest.rows()!=e.rows() || dest.cols()!=e.cols())
+    {
+        perror("ERROR: Matrix expression dimensions do not match.");
+        return false;
+    }
+    return true;
+}
+
+// dest := dest + sign * e, elementwise
+template <typename E>
+void add_elementwise(MatRef& dest, const E& e, double sign)
+{
+    for (size_t i=0; i<dest.rows(); i++)
+    {
+        double* d = dest.row_data(i);
+        for (size_t j=0; j<dest.cols(); j++)
+            d[j] += sign * e(i, j);
+    }
+}
+
+// dest := e, one loop over the destination
+template <typename E>
+void evaluate(MatRef& dest, const E& e)
+{
+    for (size_t i=0; i<dest.rows(); i++)
+    {
+        double* d = dest.row_data(i);
+        for (size_t j=0; j<dest.cols(); j++)
+            d[j] = e(i, j);
+    }
+}
+
+template <typename A, typename B>
+void evaluate(MatRef& dest, const Product<A, B>& p)
+{
+    gemm_into(dest, p, 0.0);
+}
+
+// e +- product: the elementwise side first, then the product is
+// accumulated by BLAS
+template <typename E, typename A, typename B>
+void evaluate(MatRef& dest, const Binary<E, Product<A, B>, AddOp>& e)
+{
+    evaluate(dest, e.left());
+    gemm_into(dest, e.right(), 1.0);
+}
+
+template <typename E, typename A, typename B>
+void evaluate(MatRef& dest, const Binary<E, Product<A, B>, SubOp>& e)
+{
+    evaluate(dest, e.left());
+    gemm_into(dest, -e.right(), 1.0);
+}
+
+template <typename E, typename A, typename B>
+void evaluate(MatRef& dest, const Binary<Product<A, B>, E, AddOp>& e)
+{
+    evaluate(dest, e.right());
+    gemm_into(dest, e.left(), 1.0);
+}
+
+template <typename E, typename A, typename B>
+void evaluate(MatRef& dest, const Binary<Product<A, B>, E, SubOp>& e)
+{
+    evaluate(dest, -e.right());
+    gemm_into(dest, e.left(), 1.0);
+}
+
+template <typename E>
+MatRef& MatRef::assign_from(const E& e)
+{
+    if (check_shape(*this, e))
+        evaluate(*this, e);
+    return *this;
+}
+
+template <typename E>
+void update(MatRef& dest, const E& e, double sign)
+{
+    add_elementwise(dest, e, sign);
+}
+
+template <typename A, typename B>
+void update(MatRef& dest, const Product<A, B>& p, double sign)
+{
+    gemm_into(dest, sign * p, 1.0);
+}
+
+template <typename E>
+MatRef& MatRef::update_from(const E& e, double sign)
+{
+    if (check_shape(*this, e))
+        update(*this, e, sign);
+    return *this;
+}
+
+inline MatRef& MatRef::operator=(double s)
+{
+    for (size_t i=0; i<rows(); i++)
+        for (size_t j=0; j<cols(); j++)
+            (*this)(i, j) = s;
+    return *this;
+}
+
+inline MatRef& MatRef::operator+=(double s)
+{
+    evaluate(*this, *this + s);
+    return *this;
+}
+
+inline MatRef& MatRef::operator*=(double s)
+{
+    evaluate(*this, s * *this);
+    return *this;
+}
+
+/************************************************************/
+/************************Reductions**************************/
+/************************************************************/
+
+// Sum of f(element) over an expression in row-major order
+template <typename E, typename F>
+double reduce(const Expr<E>& expr, F f)
+{
+    const E& e = expr.self();
+    double total = 0.0;
+
+    if (!e.conforms())
+    {
+        perror("ERROR: Matrix expression dimensions do not match.");
+        return 0.0;
+    }
+    for (size_t i=0; i<e.rows(); i++)
+        for (size_t j=0; j<e.cols(); j++)
+            total += f(e(i, j));
+    return total;
+}
+
+struct IdentityOp { double operator()(double a) const { return a; } };
+
+template <typename E>
+double sum(const Expr<E>& e) { return reduce(e, IdentityOp()); }
+
+template <typename E>
+double sum_sq(const Expr<E>& e) { return reduce(e, SquareOp()); }
+
+template <typename E>
+double sum_abs(const Expr<E>& e) { return reduce(e, AbsOp()); }
+
+template <typename L, typename R>
+double dot(const Expr<L>& l, const Expr<R>& r) { return sum(hadamard(l, r)); }
+
+} // namespace mx
+
+#endif // _MATRIX_EXPR_HPP_
@@ -0,0 +1,143 @@
+// Counter-based random number generation (Philox4x32-10)
+
+#include <stdint.h>
+#include <math.h>
+#include "random.h"
+
+// Pairs of normals produced per pass of random_normal_fill
+#define NORMAL_BLOCK 64
+
+// Multipliers and Weyl key increments of Philox4x32
+#define PHILOX_M0 0xD2511F53U
+#define PHILOX_M1 0xCD9E8D57U
+#define PHILOX_W0 0x9E3779B9U
+#define PHILOX_W1 0xBB67AE85U
+
+// The ten rounds of Philox4x32 (Salmon et al., "Parallel random
+// numbers: as easy as 1, 2, 3", SC 2011) applied to "counter"
+void philox4x32_10(const uint32_t counter[4], const uint32_t key[2],
+                   uint32_t out[4])
+{
+    uint32_t c0 = counter[0], c1 = counter[1];
+    uint32_t c2 = counter[2], c3 = counter[3];
+    uint32_t k0 = key[0], k1 = key[1];
+
+    for (int round=0; round<10; round++)
+    {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+
+        c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+// Compute the block holding the word at the current position
+static void refill(RandomStream* rng)
+{
+    uint64_t block = rng->position >> 2;
+    uint32_t counter[4];
+
+    counter[0] = (uint32_t)block;
+    counter[1] = (uint32_t)(block >> 32);
+    counter[2] = (uint32_t)rng->stream_id;
+    counter[3] = (uint32_t)(rng->stream_id >> 32);
+    philox4x32_10(counter, rng->key, rng->block);
+}
+
+// Start stream "stream_id" of the generator keyed by "seed"
+void random_init(RandomStream* rng, uint64_t seed, uint64_t stream_id)
+{
+    rng->key[0] = (uint32_t)seed;
+    rng->key[1] = (uint32_t)(seed >> 32);
+    rng->stream_id = stream_id;
+    random_seek(rng, 0);
+}
+
+// Move to word "position" of the stream
+void random_seek(RandomStream* rng, uint64_t position)
+{
+    rng->position = position;
+    refill(rng);
+}
+
+// Next 32 random bits
+uint32_t random_u32(RandomStream* rng)
+{
+    uint32_t word = rng->block[rng->position & 3];
+
+    if ((++rng->position & 3)==0)
+        refill(rng);
+    return word;
+}
+
+// Next 64 random bits (two words)
+uint64_t random_u64(RandomStream* rng)
+{
+    uint64_t low = random_u32(rng);
+    return low | ((uint64_t)random_u32(rng) << 32);
+}
+
+// Uniform double in [0, 1) with 53 random bits (two words)
+double random_uniform(RandomStream* rng)
+{
+    return (double)(random_u64(rng) >> 11) * 0x1.0p-53;
+}
+
+// Uniform float in [0, 1) with 24 random bits (one word)
+float random_uniform_float(RandomStream* rng)
+{
+    return (float)(random_u32(rng) >> 8) * 0x1.0p-24f;
+}
+
+// Random integer in [0, bound) for any 64-bit bound, by
+// multiply-shift reduction of 64 random bits (two words)
+uint64_t random_below(RandomStream* rng, uint64_t bound)
+{
+    return (uint64_t)(((unsigned __int128)random_u64(rng) * bound) >> 64);
+}
+
+// Fill "out" with "n_elem" standard normal numbers by the Box-Muller
+// transform. The uniforms of a block of pairs are drawn first and
+// then transformed in a loop without dependencies between
+// iterations, which compilers can vectorize. An odd last element
+// discards the second normal of its pair.
+void random_normal_fill(RandomStream* rng, double* out, size_t n_elem)
+{
+    double u1[NORMAL_BLOCK], u2[NORMAL_BLOCK];
+    double z1[NORMAL_BLOCK], z2[NORMAL_BLOCK];
+
+    for (size_t i=0; i<n_elem; i+=2*NORMAL_BLOCK)
+    {
+        size_t n = n_elem-i < 2*NORMAL_BLOCK? n_elem-i: 2*NORMAL_BLOCK;
+        size_t n_pairs = (n+1)/2;
+
+        // u1 in (0, 1] keeps the logarithm finite
+        for (size_t k=0; k<n_pairs; k++)
+        {
+            u1[k] = 1.0 - random_uniform(rng);
+            u2[k] = random_uniform(rng);
+        }
+        for (size_t k=0; k<n_pairs; k++)
+        {
+            double r = sqrt(-2.0 * log(u1[k]));
+            z1[k] = r * cos(2.0 * M_PI * u2[k]);
+            z2[k] = r * sin(2.0 * M_PI * u2[k]);
+        }
+        for (size_t k=0; k<n/2; k++)
+        {
+            out[i+2*k] = z1[k];
+            out[i+2*k+1] = z2[k];
+        }
+        if (n%2==1)
+            out[i+n-1] = z1[n_pairs-1];
+    }
+}
@@ -0,0 +1,43 @@
+// Counter-based random number generation (Philox4x32-10)
+
+#ifndef _RANDOM_H_
+#define _RANDOM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A stream of random 32-bit words. Word w of the stream is a pure
+// function of (seed, stream id, w): it is word w % 4 of the Philox
+// block with counter (w / 4, stream id) under the key given by the
+// seed. There is no hidden global state, so any number of streams
+// can be used from any threads, and random_seek jumps to any
+// position in O(1). Generating block i of a random matrix on one
+// thread or another gives bit-identical results.
+typedef struct
+{
+    uint32_t key[2];
+    uint64_t stream_id;
+    uint64_t position;   // Index of the next word
+    uint32_t block[4];   // Philox output holding the next word
+} RandomStream;
+
+void philox4x32_10(const uint32_t counter[4], const uint32_t key[2],
+                   uint32_t out[4]);
+void random_init(RandomStream* rng, uint64_t seed, uint64_t stream_id);
+void random_seek(RandomStream* rng, uint64_t position);
+uint32_t random_u32(RandomStream* rng);
+uint64_t random_u64(RandomStream* rng);
+double random_uniform(RandomStream* rng);
+float random_uniform_float(RandomStream* rng);
+uint64_t random_below(RandomStream* rng, uint64_t bound);
+void random_normal_fill(RandomStream* rng, double* out, size_t n_elem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _RANDOM_H_
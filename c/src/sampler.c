@@ -0,0 +1,170 @@
+// Minibatch samplers for stochastic gradient descent
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdbool.h>
+#include "matrix.h"
+#include "random.h"
+#include "sampler.h"
+
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+    while (b!=0)
+    {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Switch to the random stream of a new epoch and draw its row order.
+// Only SAMPLE_SHUFFLE touches all rows (once per epoch), the other
+// policies start a new epoch in O(1).
+static void sampler_start_epoch(BatchSampler* sampler)
+{
+    size_t n = sampler->n_samples;
+
+    random_init(&(sampler->rng), sampler->seed, sampler->epoch);
+    sampler->cursor = 0;
+
+    switch (sampler->policy)
+    {
+        case SAMPLE_SHUFFLE:
+            for (size_t i=n-1; i>0; i--)
+            {
+                size_t idx = random_below(&(sampler->rng), i+1);
+                int temp = sampler->perm.data[idx];
+                sampler->perm.data[idx] = sampler->perm.data[i];
+                sampler->perm.data[i] = temp;
+            }
+            break;
+        case SAMPLE_AFFINE:
+            // Any multiplier coprime to n makes i -> (a*i + b) mod n
+            // a bijection on [0, n).
+            do
+                sampler->mult = 1 + random_below(&(sampler->rng), n);
+            while (n>1 && gcd(sampler->mult, n)!=1);
+            sampler->offset = random_below(&(sampler->rng), n);
+            break;
+        default:
+            break;
+    }
+}
+
+// Initialize a sampler over rows 0..n_samples-1
+void sampler_init(BatchSampler* sampler,
+                  size_t n_samples,
+                  size_t batch_size,
+                  SamplingPolicy policy,
+                  unsigned int seed)
+{
+    sampler->policy = policy;
+    sampler->n_samples = n_samples;
+    sampler->batch_size = batch_size;
+    sampler->seed = seed;
+    sampler->epoch = 0;
+    sampler->cursor = 0;
+    sampler->mult = 1;
+    sampler->offset = 0;
+    sampler->perm.data = NULL;
+
+    if (batch_size==0 || batch_size>n_samples)
+    {
+        perror("ERROR: Batch size must be between 1 and number of samples.");
+        sampler->n_samples = 0;
+        return;
+    }
+
+    // Indices are handed out in an IntMatrix
+    if (n_samples>(size_t)INT_MAX)
+    {
+        perror("ERROR: Number of samples cannot exceed INT_MAX.");
+        sampler->n_samples = 0;
+        return;
+    }
+
+    if (policy==SAMPLE_SHUFFLE)
+    {
+        sampler->perm = intmat_create(n_samples, 1);
+        for (size_t i=0; i<n_samples; i++)
+            sampler->perm.data[i] = (int)i;
+    }
+    sampler_start_epoch(sampler);
+}
+
+// Fill idxs (batch_size x 1) with the row indices of the next minibatch
+void sampler_next(BatchSampler* sampler, IntMatrix* idxs)
+{
+    size_t n = sampler->n_samples;
+    size_t batch_size = sampler->batch_size;
+
+    if (n==0 || idxs->data==NULL || idxs->nrows*idxs->ncols!=batch_size)
+    {
+        perror("ERROR: Sampler is uninitialized or index matrix has wrong size.");
+        return;
+    }
+
+    if (sampler->policy==SAMPLE_REPLACEMENT)
+    {
+        for (size_t i=0; i<batch_size; i++)
+            idxs->data[i] = (int)random_below(&(sampler->rng), n);
+        return;
+    }
+
+    // Roll over to a new epoch when the remaining rows cannot
+    // fill a complete batch
+    if (sampler->cursor+batch_size>n)
+    {
+        sampler->epoch++;
+        sampler_start_epoch(sampler);
+    }
+
+    switch (sampler->policy)
+    {
+        case SAMPLE_SHUFFLE:
+            memcpy(idxs->data, &(sampler->perm.data[sampler->cursor]),
+                   batch_size*sizeof(int));
+            break;
+        case SAMPLE_AFFINE:
+            for (size_t i=0; i<batch_size; i++)
+                idxs->data[i] = (int)((sampler->mult*(sampler->cursor+i)
+                                       + sampler->offset) % n);
+            break;
+        default:
+            for (size_t i=0; i<batch_size; i++)
+                idxs->data[i] = (int)(sampler->cursor+i);
+            break;
+    }
+    sampler->cursor += batch_size;
+}
+
+// Destroy a sampler
+void sampler_destroy(BatchSampler* sampler)
+{
+    if (sampler==NULL)
+        return;
+    intmat_destroy(&(sampler->perm));
+}
+
+// Parse a sampling policy from its name
+// ("shuffle", "affine", "sequential" or "replacement").
+bool sampler_parse_policy(const char* name, SamplingPolicy* policy)
+{
+    if (name==NULL)
+        return false;
+    if (strcmp(name, "shuffle")==0)
+        *policy = SAMPLE_SHUFFLE;
+    else if (strcmp(name, "affine")==0)
+        *policy = SAMPLE_AFFINE;
+    else if (strcmp(name, "sequential")==0)
+        *policy = SAMPLE_SEQUENTIAL;
+    else if (strcmp(name, "replacement")==0)
+        *policy = SAMPLE_REPLACEMENT;
+    else
+        return false;
+    return true;
+}
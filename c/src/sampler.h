@@ -0,0 +1,55 @@
+// Minibatch samplers for stochastic gradient descent
+
+#ifndef _SAMPLER_H_
+#define _SAMPLER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+#include "random.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Policies for drawing minibatch row indices
+typedef enum
+{
+    SAMPLE_SHUFFLE,     // Fisher-Yates shuffle of all rows once per epoch
+    SAMPLE_AFFINE,      // Random affine permutation i -> (a*i + b) mod M per epoch
+    SAMPLE_SEQUENTIAL,  // Consecutive rows in dataset order
+    SAMPLE_REPLACEMENT  // Independent draws with replacement
+} SamplingPolicy;
+
+// Iterator handing out minibatches of row indices. An epoch ends
+// when fewer than batch_size unseen rows remain; the next epoch is
+// drawn from random stream "epoch" of the seed so that every epoch
+// visits the rows in a different order. Row indices are stored in
+// an IntMatrix, so at most INT_MAX rows can be sampled.
+typedef struct
+{
+    SamplingPolicy policy;
+    size_t n_samples, batch_size;
+    size_t cursor;
+    unsigned int epoch;
+    unsigned int seed;
+    RandomStream rng;       // Stream of the current epoch
+    uint64_t mult, offset;  // Affine permutation coefficients
+    IntMatrix perm;         // Row permutation (SAMPLE_SHUFFLE only)
+} BatchSampler;
+
+void sampler_init(BatchSampler* sampler,
+                  size_t n_samples,
+                  size_t batch_size,
+                  SamplingPolicy policy,
+                  unsigned int seed);
+void sampler_next(BatchSampler* sampler, IntMatrix* idxs);
+void sampler_destroy(BatchSampler* sampler);
+bool sampler_parse_policy(const char* name, SamplingPolicy* policy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SAMPLER_H_
@@ -3,24 +3,203 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <cblas.h>
+#if defined(SGD_PROFILE) && defined(__GNUC__) && defined(__x86_64__)
+#include <x86intrin.h>
+#endif
 #include "matrix.h"
 #include "losses.h"
 #include "stats.h"
+#include "sampler.h"
+#include "stream.h"
+#include "sparse.h"
 #include "sgd.h"
 
 // Iteration interval at which loss is recorded
 const unsigned int LOSS_INTERVAL = 100;
 
+// Upper bound on the worker threads of the parallel solvers
+#define SGD_MAX_THREADS 64
+
+// State shared by the Hogwild workers. theta is read and written by
+// all workers without locks.
+typedef struct
+{
+    Matrix* theta;
+    const LossFunctions* loss_fns;
+    const Centering* centering;
+    SamplingPolicy policy;
+    unsigned int batch_size;
+    double learning_rate;
+    double tol;
+    unsigned int n_iter;
+    unsigned int next_iter;       // Iterations claimed so far
+    bool converged;
+    unsigned int converged_iter;
+    double* losses;               // Written by thread 0 only
+} HogwildShared;
+
+// A Hogwild worker and its disjoint shard of the rows
+typedef struct
+{
+    HogwildShared* shared;
+    Matrix x, y;
+    unsigned int seed;
+    unsigned int tid;
+} HogwildTask;
+
+// State shared by the synchronous data-parallel workers. Worker 0
+// draws the batch indices and updates theta between iterations.
+typedef struct
+{
+    Matrix* x;
+    Matrix* y;
+    const Centering* centering;   // Implicit centering of x and y
+    Matrix* theta;
+    IntMatrix* idxs;          // Global minibatch
+    unsigned int n_threads;
+    bool stop;
+    pthread_mutex_t start_lock;   // Held while the team is set up
+    pthread_barrier_t barrier;
+} SyncShared;
+
+// A synchronous worker: its slice of the minibatch and its partial
+// sums, reduced into the buffers of worker 0
+typedef struct
+{
+    SyncShared* shared;
+    unsigned int id;
+    size_t first, rows;       // Slice of the minibatch
+    Matrix x_local, y_local, y_pred;  // y_pred holds the residual
+    Matrix partial;           // Partial X^T r (n_features x 1)
+    double partial_loss;      // Partial r^T r
+} SyncTask;
+
+/************************************************************/
+/*************************Profiling**************************/
+/************************************************************/
+
+// Phase timing, compiled in only with SGD_PROFILE defined. A solver
+// calls PROFILE_START() before its loop, PROFILE_MARK() where a
+// phase begins and PROFILE_LAP(phase) where it ends (which also
+// marks the next one), and PROFILE_STOP(&result.profile) after the
+// loop. Without SGD_PROFILE the macros expand to nothing.
+#ifdef SGD_PROFILE
+
+// Time stamp counter where available, with the tick rate measured
+// against the monotonic clock over the whole run; a lap costs a few
+// nanoseconds. Nanoseconds of the monotonic clock otherwise.
+static uint64_t profile_ticks(void)
+{
+#if defined(__GNUC__) && defined(__x86_64__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static double profile_clock_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Profiler of the solver running on this thread
+typedef struct
+{
+    bool active;
+    uint64_t mark, start_ticks;
+    double start_seconds;
+    uint64_t ticks[PROFILE_N_PHASES];
+    unsigned long long calls[PROFILE_N_PHASES];
+} Profiler;
+
+static __thread Profiler profiler;
+
+static void profiler_start(void)
+{
+    memset(&profiler, 0, sizeof(profiler));
+    profiler.active = true;
+    profiler.start_seconds = profile_clock_seconds();
+    profiler.start_ticks = profiler.mark = profile_ticks();
+}
+
+static inline void profiler_mark(void)
+{
+    if (profiler.active)
+        profiler.mark = profile_ticks();
+}
+
+static inline void profiler_lap(ProfilePhase phase)
+{
+    uint64_t now;
+
+    if (!profiler.active)
+        return;
+    now = profile_ticks();
+    profiler.ticks[phase] += now - profiler.mark;
+    profiler.calls[phase]++;
+    profiler.mark = now;
+}
+
+static void profiler_stop(SGDProfile* profile)
+{
+    double seconds = profile_clock_seconds() - profiler.start_seconds;
+    uint64_t ticks = profile_ticks() - profiler.start_ticks;
+    double seconds_per_tick = ticks>0? seconds / (double)ticks: 0.0;
+
+    profile->enabled = true;
+    profile->total_seconds = seconds;
+    for (int p=0; p<PROFILE_N_PHASES; p++)
+    {
+        profile->seconds[p] = (double)profiler.ticks[p] * seconds_per_tick;
+        profile->calls[p] = profiler.calls[p];
+    }
+    profiler.active = false;
+}
+
+#define PROFILE_START() profiler_start()
+#define PROFILE_MARK() profiler_mark()
+#define PROFILE_LAP(phase) profiler_lap(phase)
+#define PROFILE_STOP(profile) profiler_stop(profile)
+
+#else
+
+#define PROFILE_START() ((void)0)
+#define PROFILE_MARK() ((void)0)
+#define PROFILE_LAP(phase) ((void)0)
+#define PROFILE_STOP(profile) ((void)0)
+
+#endif // SGD_PROFILE
+
+// Name of a profiled phase
+const char* sgd_profile_phase_name(ProfilePhase phase)
+{
+    static const char* names[PROFILE_N_PHASES] = {
+        "sample", "gather", "forward", "loss", "backward"};
+
+    return phase<PROFILE_N_PHASES? names[phase]: "unknown";
+}
+
 // Initialize SGDResult object
 void init_sgdresult(SGDResult* result,
                     unsigned int n_iter,
-                    unsigned int n_features,
+                    size_t n_features,
                     unsigned int seed)
 {
     result->converged = false;
     result->n_iter = n_iter;
     result->bias = 0.0;
     result->losses = (double *)calloc(n_iter, sizeof(double));
+    memset(&(result->profile), 0, sizeof(result->profile));
     result->theta_sol = mat_create(n_features, 1);
     mat_fill_random(&(result->theta_sol), seed);
 }
@@ -40,24 +219,92 @@ void forward(Matrix* x, Matrix* theta, Matrix* y_pred)
     mat_mul_inplace(x, false, theta, false, y_pred);
 }
 
-// Backward method, theta := theta - 2 * eta / N * grad(x, y, theta)
-void backward(Matrix* x, Matrix* y, 
-              Matrix* theta, double eta,
-              grad_fn_type grad_fn)
+// Backward method, theta := theta - 2 * eta / N * grad
+void backward(Matrix* theta, Matrix* grad,
+              double eta, size_t n_samples)
 {
-    Matrix grad = grad_fn(x, y, theta);
-    mat_scale(&grad, 2.0 * eta /(double)(y->nrows));
-    mat_sub(theta, &grad);
+    cblas_daxpy(theta->nrows*theta->ncols,
+                -2.0 * eta / (double)n_samples,
+                grad->data, 1, theta->data, 1);
+}
 
-    mat_destroy(&grad);
+// Create the solver's arena and bind it, returning the arena it
+// replaces. The arena is the loss functions' workspace. It is also
+// bound so that plain mat_create calls inside them draw from it, and
+// with a reset per iteration, iterations after the first do not touch
+// the heap.
+static MatArena* solver_arena_begin(MatArena* arena)
+{
+    *arena = mat_arena_create(0);
+    return mat_arena_bind(arena);
+}
+
+// Restore the arena bound before solver_arena_begin and free "arena"
+static void solver_arena_end(MatArena* arena, MatArena* previous)
+{
+    mat_arena_bind(previous);
+    mat_arena_destroy(arena);
+}
+
+// Means a solver centers x and y with, and the Centering that
+// points at them. It must not be copied once initialized.
+typedef struct
+{
+    Matrix x_mean;
+    Matrix y_mean;
+    Centering centering;
+} DataMeans;
+
+// Take ownership of "x_mean" (1 x n_features), find the mean of y
+// and return the Centering of x and y
+static const Centering* data_means_init(DataMeans* means,
+                                        Matrix x_mean, Matrix* y)
+{
+    means->x_mean = x_mean;
+    means->y_mean = stats_mean(y, 0);
+    means->centering.x_mean = &(means->x_mean);
+    means->centering.y_mean = means->y_mean.data[0];
+    return &(means->centering);
+}
+
+// Free the means of a DataMeans
+static void data_means_destroy(DataMeans* means)
+{
+    mat_destroy(&(means->x_mean));
+    mat_destroy(&(means->y_mean));
+}
+
+// Loss at theta and its gradient (written into grad) for x and y
+// centered implicitly by "centering". Uses the fused callback if the
+// loss provides one, otherwise forward, loss_fn and grad_fn (y_pred
+// receives the predictions, shifted so that y - y_pred is the
+// centered residual).
+static double loss_and_gradient(const LossFunctions* loss,
+                                Matrix* x, Matrix* y,
+                                const Centering* centering, Matrix* theta,
+                                Matrix* y_pred, Matrix* grad,
+                                MatArena* workspace)
+{
+    double loss_val;
+
+    if (loss->loss_grad_fn!=NULL)
+        return loss->loss_grad_fn(x, y, centering, theta, grad,
+                                  workspace, loss->ctx);
+
+    forward(x, theta, y_pred);
+    if (centering!=NULL)
+        mat_add_scalar(y_pred, centering_offset(centering, theta));
+    PROFILE_LAP(PROFILE_FORWARD);
+    loss_val = loss->loss_fn(y, y_pred, workspace, loss->ctx);
+    loss->grad_fn(x, y, centering, theta, grad, workspace, loss->ctx);
+    return loss_val;
 }
 
 // Gradient descent
 SGDResult gradient_descent(
             Matrix* x, Matrix* y,
             double learning_rate,
-            loss_fn_type loss_fn,
-            grad_fn_type grad_fn,
+            const LossFunctions* loss_fns,
             unsigned int n_iter,
             double tol,
             unsigned int seed)
@@ -69,30 +316,33 @@ SGDResult gradient_descent(
     // Initialize result object
     init_sgdresult(&result, n_iter, x->ncols, seed);
 
-    Matrix x_copy = mat_copy(x);
-    Matrix y_copy = mat_copy(y);
-    Matrix x_offset_theta_prod;
-    Matrix bias_full;
+    MatArena arena;
+    MatArena* previous_arena;
+    Matrix grad = mat_create(x->ncols, 1);
     
     // y_pred for storing predictions
     Matrix y_pred = mat_create(y->nrows, y->ncols);
     mat_fill(&y_pred, 0.0);
     
     // Find the mean of x and y to center them and remove bias
-    Matrix x_offset = stats_mean(x, 0);
-    Matrix y_offset = stats_mean(y, 0);
+    DataMeans means;
+    const Centering* centering = data_means_init(&means, stats_mean(x, 0), y);
+
+    previous_arena = solver_arena_begin(&arena);
 
-    // Center x and y matrix to reduce problem from 
-    // y = x theta + b to y = x theta
-    mat_vec_sub(&x_copy, &x_offset);
-    mat_vec_sub(&y_copy, &y_offset);
+    PROFILE_START();
 
     // Gradient descent algorithm
     for (i=0; i<n_iter; i++)
     {
-        // Update loss
-        forward(&x_copy, &(result.theta_sol), &y_pred);
-        loss = loss_fn(&y_copy, &y_pred);
+        mat_arena_reset(&arena);
+        PROFILE_MARK();
+
+        // Update loss and gradient
+        loss = loss_and_gradient(loss_fns, x, y, centering,
+                                 &(result.theta_sol), &y_pred,
+                                 &grad, &arena);
+        PROFILE_LAP(PROFILE_LOSS);
         
         // Check convergence
         if (loss < tol)
@@ -105,33 +355,29 @@ SGDResult gradient_descent(
         if ((i+1)%LOSS_INTERVAL == 0)
         {
             printf("It. %u, loss = %.4f\n", i+1, loss);
-            result.losses[i] = loss;
+            result.losses[i/LOSS_INTERVAL] = loss;
         }
         
         // Update theta
-        backward(&x_copy, &y_copy, 
-                 &(result.theta_sol), learning_rate, grad_fn);
+        PROFILE_MARK();
+        backward(&(result.theta_sol), &grad, learning_rate, y->nrows);
+        PROFILE_LAP(PROFILE_BACKWARD);
     }
 
+    PROFILE_STOP(&(result.profile));
+    solver_arena_end(&arena, previous_arena);
+
     if (result.converged)
         printf("Converged in %u iterations.\n", i+1);
 
     // Calculate predicted bias
-    // bias = y_offset - x_offset theta
-    x_offset_theta_prod = mat_mul(&x_offset, false, 
-                                &(result.theta_sol), false);
-    mat_sub(&y_offset, &x_offset_theta_prod);
-    bias_full = stats_mean(&y_offset, 2);
-    result.bias = bias_full.data[0];
+    // bias = y_mean - x_mean theta
+    result.bias = centering_offset(centering, &(result.theta_sol));
     
     // Destroy local matrices
-    mat_destroy(&x_copy);
-    mat_destroy(&y_copy);
-    mat_destroy(&x_offset);
-    mat_destroy(&y_offset);
-    mat_destroy(&x_offset_theta_prod);
+    data_means_destroy(&means);
     mat_destroy(&y_pred);
-    mat_destroy(&bias_full);
+    mat_destroy(&grad);
 
     // Truncate loss array
     if (i>LOSS_INTERVAL)
@@ -144,10 +390,10 @@ SGDResult gradient_descent(
 // Stochastic gradient descent
 SGDResult stochastic_gradient_descent(
             Matrix* x, Matrix* y,
-            unsigned int batch_size, 
+            unsigned int batch_size,
+            SamplingPolicy policy,
             double learning_rate,
-            loss_fn_type loss_fn,
-            grad_fn_type grad_fn,
+            const LossFunctions* loss_fns,
             unsigned int n_iter,
             double tol,
             unsigned int seed)
@@ -156,43 +402,66 @@ SGDResult stochastic_gradient_descent(
     unsigned int i = 0;
     double loss = 0.0;
     IntMatrix idxs = intmat_create(batch_size, 1);
+    BatchSampler sampler;
 
     // Initialize result object
     init_sgdresult(&result, n_iter, x->ncols, seed);
 
-    Matrix x_copy = mat_copy(x);
-    Matrix y_copy = mat_copy(y);
     Matrix x_batch = mat_create(batch_size, x->ncols);
     Matrix y_batch = mat_create(batch_size, y->ncols);
-    Matrix x_offset_theta_prod;
-    Matrix bias_full;
+    Matrix x_view, y_view;
+    Matrix* x_in = policy==SAMPLE_SEQUENTIAL? &x_view: &x_batch;
+    Matrix* y_in = policy==SAMPLE_SEQUENTIAL? &y_view: &y_batch;
+    MatArena arena;
+    MatArena* previous_arena;
+    Matrix grad = mat_create(x->ncols, 1);
     
     // y_pred for storing predictions
     Matrix y_pred = mat_create(batch_size, y->ncols);
     mat_fill(&y_pred, 0.0);
     
     // Find the mean of x and y to center them and remove bias
-    Matrix x_offset = stats_mean(x, 0);
-    Matrix y_offset = stats_mean(y, 0);
+    DataMeans means;
+    const Centering* centering = data_means_init(&means, stats_mean(x, 0), y);
+
+    // Shuffles once per epoch, so drawing a batch costs O(batch_size)
+    sampler_init(&sampler, y->nrows, batch_size, policy, seed);
+    if (sampler.n_samples==0)
+        n_iter = 0;
+
+    previous_arena = solver_arena_begin(&arena);
 
-    // Center x and y matrix to reduce problem from 
-    // y = x theta + b to y = x theta
-    mat_vec_sub(&x_copy, &x_offset);
-    mat_vec_sub(&y_copy, &y_offset);
+    PROFILE_START();
 
     // Minibatch Stochastic Gradient descent algorithm
     for (i=0; i<n_iter; i++)
     {
+        mat_arena_reset(&arena);
+        PROFILE_MARK();
+
         // Generate batch idxs
-        intmat_fill_random(&idxs, 0, y->nrows, false, seed);
+        sampler_next(&sampler, &idxs);
+        PROFILE_LAP(PROFILE_SAMPLE);
 
-        // Gather batch elements
-        mat_gather(&x_copy, &x_batch, &idxs, 0);
-        mat_gather(&y_copy, &y_batch, &idxs, 0);
+        // Gather batch elements. Sequential batches are consecutive
+        // rows and are viewed in place instead of copied.
+        if (policy==SAMPLE_SEQUENTIAL)
+        {
+            x_view = mat_view(x, idxs.data[0], 0, batch_size, x->ncols);
+            y_view = mat_view(y, idxs.data[0], 0, batch_size, y->ncols);
+        }
+        else
+        {
+            mat_gather(x, &x_batch, &idxs, 0);
+            mat_gather(y, &y_batch, &idxs, 0);
+        }
+        PROFILE_LAP(PROFILE_GATHER);
 
-        // Update loss
-        forward(&x_batch, &(result.theta_sol), &y_pred);
-        loss = loss_fn(&y_batch, &y_pred);
+        // Update loss and gradient
+        loss = loss_and_gradient(loss_fns, x_in, y_in, centering,
+                                 &(result.theta_sol), &y_pred,
+                                 &grad, &arena);
+        PROFILE_LAP(PROFILE_LOSS);
         
         // Check convergence
         if (loss < tol)
@@ -205,36 +474,33 @@ SGDResult stochastic_gradient_descent(
         if ((i+1)%LOSS_INTERVAL == 0)
         {
             printf("It. %u, loss = %.4f\n", i+1, loss);
-            result.losses[i] = loss;
+            result.losses[i/LOSS_INTERVAL] = loss;
         }
         
         // Update theta
-        backward(&x_batch, &y_batch, 
-                 &(result.theta_sol), learning_rate, grad_fn);
+        PROFILE_MARK();
+        backward(&(result.theta_sol), &grad, learning_rate, batch_size);
+        PROFILE_LAP(PROFILE_BACKWARD);
     }
 
+    PROFILE_STOP(&(result.profile));
+    solver_arena_end(&arena, previous_arena);
+
     if (result.converged)
         printf("Converged in %u iterations.\n", i+1);
 
     // Calculate predicted bias
-    // bias = y_offset - x_offset theta
-    x_offset_theta_prod = mat_mul(&x_offset, false, 
-                                &(result.theta_sol), false);
-    mat_sub(&y_offset, &x_offset_theta_prod);
-    bias_full = stats_mean(&y_offset, 2);
-    result.bias = bias_full.data[0];
+    // bias = y_mean - x_mean theta
+    result.bias = centering_offset(centering, &(result.theta_sol));
     
     // Destroy local matrices
-    mat_destroy(&x_copy);
-    mat_destroy(&y_copy);
-    mat_destroy(&x_offset);
-    mat_destroy(&y_offset);
+    data_means_destroy(&means);
     mat_destroy(&x_batch);
     mat_destroy(&y_batch);
-    mat_destroy(&x_offset_theta_prod);
     mat_destroy(&y_pred);
-    mat_destroy(&bias_full);
+    mat_destroy(&grad);
     intmat_destroy(&idxs);
+    sampler_destroy(&sampler);
 
     // Truncate loss array
     if (i>LOSS_INTERVAL)
@@ -243,3 +509,1016 @@ SGDResult stochastic_gradient_descent(
 
     return result;
 }
+
+// Column means of a single precision matrix, accumulated in
+// double precision (1 x ncols)
+static Matrix fmat_column_means(FMatrix* x)
+{
+    Matrix mean = mat_create(1, x->ncols);
+
+    for (size_t i=0; i<x->nrows; i++)
+        for (size_t j=0; j<x->ncols; j++)
+            mean.data[j] += (double)x->data[i*x->stride+j];
+    mat_scale(&mean, 1.0/(double)x->nrows);
+    return mean;
+}
+
+// Mixed precision minibatch stochastic gradient descent.
+// X is stored in single precision, which halves the bytes read per
+// sample. Each minibatch is widened to double precision as it is
+// gathered and centered there, so theta, the gradient and the loss
+// are computed in double precision and X is never copied as a whole.
+// The products run in double BLAS, not sgemm/sgemv: the loss
+// callbacks take double matrices, and widening costs no more than
+// the gather itself.
+SGDResult stochastic_gradient_descent_mixed(
+            FMatrix* x, Matrix* y,
+            unsigned int batch_size,
+            SamplingPolicy policy,
+            double learning_rate,
+            const LossFunctions* loss_fns,
+            unsigned int n_iter,
+            double tol,
+            unsigned int seed)
+{
+    SGDResult result;
+    unsigned int i = 0;
+    double loss = 0.0;
+    IntMatrix idxs = intmat_create(batch_size, 1);
+    BatchSampler sampler;
+
+    // Initialize result object
+    init_sgdresult(&result, n_iter, x->ncols, seed);
+
+    Matrix x_batch = mat_create(batch_size, x->ncols);
+    Matrix y_batch = mat_create(batch_size, y->ncols);
+    MatArena arena;
+    MatArena* previous_arena;
+    Matrix grad = mat_create(x->ncols, 1);
+
+    // y_pred for storing predictions
+    Matrix y_pred = mat_create(batch_size, y->ncols);
+    mat_fill(&y_pred, 0.0);
+
+    // Find the mean of x and y, batches are centered implicitly by
+    // the loss
+    DataMeans means;
+    const Centering* centering = data_means_init(&means,
+                                                 fmat_column_means(x), y);
+
+    sampler_init(&sampler, y->nrows, batch_size, policy, seed);
+    if (sampler.n_samples==0)
+        n_iter = 0;
+
+    previous_arena = solver_arena_begin(&arena);
+
+    PROFILE_START();
+
+    // Minibatch Stochastic Gradient descent algorithm
+    for (i=0; i<n_iter; i++)
+    {
+        mat_arena_reset(&arena);
+        PROFILE_MARK();
+
+        // Generate batch idxs
+        sampler_next(&sampler, &idxs);
+        PROFILE_LAP(PROFILE_SAMPLE);
+
+        // Gather and widen batch elements
+        mat_gather_rows_from_fmat(x, &x_batch, &idxs);
+        mat_gather(y, &y_batch, &idxs, 0);
+        PROFILE_LAP(PROFILE_GATHER);
+
+        // Update loss and gradient
+        loss = loss_and_gradient(loss_fns, &x_batch, &y_batch, centering,
+                                 &(result.theta_sol), &y_pred,
+                                 &grad, &arena);
+        PROFILE_LAP(PROFILE_LOSS);
+
+        // Check convergence
+        if (loss < tol)
+        {
+            result.converged = true;
+            break;
+        }
+
+        // Print loss
+        if ((i+1)%LOSS_INTERVAL == 0)
+        {
+            printf("It. %u, loss = %.4f\n", i+1, loss);
+            result.losses[i/LOSS_INTERVAL] = loss;
+        }
+
+        // Update theta
+        PROFILE_MARK();
+        backward(&(result.theta_sol), &grad, learning_rate, batch_size);
+        PROFILE_LAP(PROFILE_BACKWARD);
+    }
+
+    PROFILE_STOP(&(result.profile));
+    solver_arena_end(&arena, previous_arena);
+
+    if (result.converged)
+        printf("Converged in %u iterations.\n", i+1);
+
+    // Calculate predicted bias
+    // bias = y_mean - x_mean theta
+    result.bias = centering_offset(centering, &(result.theta_sol));
+
+    // Destroy local matrices
+    data_means_destroy(&means);
+    mat_destroy(&x_batch);
+    mat_destroy(&y_batch);
+    mat_destroy(&y_pred);
+    mat_destroy(&grad);
+    intmat_destroy(&idxs);
+    sampler_destroy(&sampler);
+
+    // Truncate loss array
+    if (i>LOSS_INTERVAL)
+        result.losses = (double *)realloc(result.losses,
+                        ((i+1)/LOSS_INTERVAL) * sizeof(double));
+
+    return result;
+}
+
+// Hogwild worker: draw minibatches from the shard and apply the
+// updates to the shared theta with relaxed atomic loads and stores.
+// Relaxed atomics rule out torn values only; an update made by
+// another thread between the load and the store of an element is
+// lost, which is the trade-off Hogwild makes for not locking.
+static void* hogwild_worker(void* arg)
+{
+    HogwildTask* task = (HogwildTask*)arg;
+    HogwildShared* shared = task->shared;
+    double* theta_shared = shared->theta->data;
+    size_t n = shared->theta->nrows;
+    unsigned int batch_size = shared->batch_size;
+    double step = -2.0 * shared->learning_rate / (double)batch_size;
+    IntMatrix idxs = intmat_create(batch_size, 1);
+    Matrix x_batch = mat_create(batch_size, task->x.ncols);
+    Matrix y_batch = mat_create(batch_size, 1);
+    Matrix y_pred = mat_create(batch_size, 1);
+    Matrix grad = mat_create(n, 1);
+    Matrix theta = mat_create(n, 1);
+    BatchSampler sampler;
+    MatArena arena;
+    MatArena* previous_arena;
+    unsigned int i;
+
+    sampler_init(&sampler, task->x.nrows, batch_size, shared->policy, task->seed);
+
+    // Every thread binds its own arena
+    previous_arena = solver_arena_begin(&arena);
+
+    // Every iteration index is claimed by exactly one thread
+    while (sampler.n_samples>0
+            && (i = __atomic_fetch_add(&(shared->next_iter), 1, __ATOMIC_RELAXED))
+                    < shared->n_iter
+            && !__atomic_load_n(&(shared->converged), __ATOMIC_RELAXED))
+    {
+        double loss;
+
+        mat_arena_reset(&arena);
+        PROFILE_MARK();
+
+        // Gather batch elements
+        sampler_next(&sampler, &idxs);
+        PROFILE_LAP(PROFILE_SAMPLE);
+        mat_gather(&(task->x), &x_batch, &idxs, 0);
+        mat_gather(&(task->y), &y_batch, &idxs, 0);
+
+        // Snapshot of theta, other threads keep updating it
+        for (size_t j=0; j<n; j++)
+            __atomic_load(&theta_shared[j], &(theta.data[j]), __ATOMIC_RELAXED);
+        PROFILE_LAP(PROFILE_GATHER);
+
+        // Update loss and gradient
+        loss = loss_and_gradient(shared->loss_fns, &x_batch, &y_batch,
+                                 shared->centering, &theta, &y_pred,
+                                 &grad, &arena);
+        PROFILE_LAP(PROFILE_LOSS);
+
+        // Check convergence
+        if (loss < shared->tol)
+        {
+            __atomic_store_n(&(shared->converged_iter), i, __ATOMIC_RELAXED);
+            __atomic_store_n(&(shared->converged), true, __ATOMIC_RELAXED);
+            break;
+        }
+
+        // Print loss. Thread 0 alone records the history, slot k
+        // holds the last loss it saw among the k-th LOSS_INTERVAL
+        // iterations.
+        if ((i+1)%LOSS_INTERVAL == 0)
+            printf("It. %u, loss = %.4f\n", i+1, loss);
+        if (task->tid==0)
+            shared->losses[i/LOSS_INTERVAL] = loss;
+
+        // Update theta without locking
+        PROFILE_MARK();
+        for (size_t j=0; j<n; j++)
+        {
+            double value;
+            __atomic_load(&theta_shared[j], &value, __ATOMIC_RELAXED);
+            value += step * grad.data[j];
+            __atomic_store(&theta_shared[j], &value, __ATOMIC_RELAXED);
+        }
+        PROFILE_LAP(PROFILE_BACKWARD);
+    }
+
+    solver_arena_end(&arena, previous_arena);
+    mat_destroy(&x_batch);
+    mat_destroy(&y_batch);
+    mat_destroy(&y_pred);
+    mat_destroy(&grad);
+    mat_destroy(&theta);
+    intmat_destroy(&idxs);
+    sampler_destroy(&sampler);
+    return NULL;
+}
+
+// Number of worker threads to use, 0 asks for all online processors
+static unsigned int resolve_threads(unsigned int n_threads)
+{
+    if (n_threads==0)
+        n_threads = (unsigned int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_threads<1)
+        n_threads = 1;
+    if (n_threads>SGD_MAX_THREADS)
+        n_threads = SGD_MAX_THREADS;
+    return n_threads;
+}
+
+// Hogwild parallel minibatch stochastic gradient descent.
+// The rows are split into one disjoint shard per thread, and each
+// thread draws minibatches from its shard with its own sampler and
+// updates the shared theta without locks (see hogwild_worker).
+// "n_iter" counts the updates of all threads together, so the
+// result is comparable to stochastic_gradient_descent with the same
+// arguments. The calling thread runs the first worker.
+SGDResult parallel_sgd_hogwild(
+            Matrix* x, Matrix* y,
+            unsigned int batch_size,
+            SamplingPolicy policy,
+            double learning_rate,
+            const LossFunctions* loss_fns,
+            unsigned int n_iter,
+            double tol,
+            unsigned int seed,
+            unsigned int n_threads)
+{
+    SGDResult result;
+    unsigned int i;
+    HogwildShared shared;
+    HogwildTask tasks[SGD_MAX_THREADS];
+    pthread_t threads[SGD_MAX_THREADS];
+    bool started[SGD_MAX_THREADS];
+    size_t rows_per_thread;
+
+    // Initialize result object
+    init_sgdresult(&result, n_iter, x->ncols, seed);
+
+
+    // Find the mean of x and y to center them and remove bias
+    DataMeans means;
+    const Centering* centering = data_means_init(&means, stats_mean(x, 0), y);
+
+    // Every shard must hold at least one batch
+    n_threads = resolve_threads(n_threads);
+    if (batch_size>0 && y->nrows/batch_size<n_threads)
+        n_threads = y->nrows/batch_size>0? (unsigned int)(y->nrows/batch_size): 1;
+    rows_per_thread = y->nrows / n_threads;
+
+    shared.theta = &(result.theta_sol);
+    shared.loss_fns = loss_fns;
+    shared.centering = centering;
+    shared.policy = policy;
+    shared.batch_size = batch_size;
+    shared.learning_rate = learning_rate;
+    shared.tol = tol;
+    shared.n_iter = n_iter;
+    shared.next_iter = 0;
+    shared.converged = false;
+    shared.converged_iter = 0;
+    shared.losses = result.losses;
+
+    for (unsigned int t=0; t<n_threads; t++)
+    {
+        size_t first = t*rows_per_thread;
+        size_t rows = t+1<n_threads? rows_per_thread: y->nrows-first;
+
+        tasks[t].shared = &shared;
+        tasks[t].x = mat_view(x, first, 0, rows, x->ncols);
+        tasks[t].y = mat_view(y, first, 0, rows, 1);
+        tasks[t].seed = seed + t;
+        tasks[t].tid = t;
+    }
+
+    for (unsigned int t=1; t<n_threads; t++)
+        started[t] = pthread_create(&threads[t], NULL, hogwild_worker, &tasks[t])==0;
+
+    // The profile is that of the first worker, on this thread
+    PROFILE_START();
+    hogwild_worker(&tasks[0]);
+    PROFILE_STOP(&(result.profile));
+    for (unsigned int t=1; t<n_threads; t++)
+    {
+        if (started[t])
+            pthread_join(threads[t], NULL);
+        else
+            hogwild_worker(&tasks[t]);
+    }
+
+    result.converged = shared.converged;
+    i = shared.converged? shared.converged_iter: n_iter;
+    if (result.converged)
+        printf("Converged in %u iterations.\n", i+1);
+
+    // Calculate predicted bias
+    // bias = y_mean - x_mean theta
+    result.bias = centering_offset(centering, &(result.theta_sol));
+
+    // Destroy local matrices
+    data_means_destroy(&means);
+
+    // Truncate loss array
+    if (i>LOSS_INTERVAL)
+        result.losses = (double *)realloc(result.losses,
+                        ((i+1)/LOSS_INTERVAL) * sizeof(double));
+
+    return result;
+}
+
+// Partial sums of the L2 loss and gradient over the worker's slice
+// of the minibatch, then the tree reduction: at level s, worker t
+// adds the buffers of worker t + s if t is a multiple of 2s. The
+// order of the additions is fixed, so results do not depend on
+// thread scheduling. A barrier separates the levels.
+static void sync_gradient(SyncTask* task, SyncTask* tasks)
+{
+    SyncShared* shared = task->shared;
+    size_t n = shared->theta->nrows;
+    IntMatrix idxs;
+
+    idxs.nrows = task->rows;
+    idxs.ncols = 1;
+    idxs.data = &(shared->idxs->data[task->first]);
+    mat_gather(shared->x, &(task->x_local), &idxs, 0);
+    mat_gather(shared->y, &(task->y_local), &idxs, 0);
+    PROFILE_LAP(PROFILE_GATHER);
+
+    // Centered residual r (in y_pred) and partial gradient of the
+    // slice, the loss is turned back into the sum r^T r. The gradient
+    // is linear in the rows, so the partials add up to the gradient
+    // of the batch.
+    task->partial_loss = (double)task->rows
+            * l2_loss_gradient_centered(&(task->x_local), &(task->y_local),
+                               shared->centering, shared->theta,
+                               &(task->y_pred), &(task->partial));
+
+    for (unsigned int s=1; s<shared->n_threads; s*=2)
+    {
+        pthread_barrier_wait(&(shared->barrier));
+        if (task->id%(2*s)==0 && task->id+s<shared->n_threads)
+        {
+            SyncTask* other = &tasks[task->id+s];
+            cblas_daxpy(n, 1.0, other->partial.data, 1, task->partial.data, 1);
+            task->partial_loss += other->partial_loss;
+        }
+    }
+    PROFILE_LAP(PROFILE_LOSS);
+}
+
+// Persistent worker: one gradient per iteration until worker 0
+// stops the loop
+static void* sync_worker(void* arg)
+{
+    SyncTask* task = (SyncTask*)arg;
+    SyncTask* tasks = task - task->id;
+    SyncShared* shared = task->shared;
+
+    // Wait until the team size, the slices and the barrier are known
+    pthread_mutex_lock(&(shared->start_lock));
+    pthread_mutex_unlock(&(shared->start_lock));
+
+    for (;;)
+    {
+        // Batch indices and theta are ready
+        pthread_barrier_wait(&(shared->barrier));
+        if (shared->stop)
+            break;
+        sync_gradient(task, tasks);
+    }
+    return NULL;
+}
+
+// Synchronous data-parallel minibatch stochastic gradient descent on
+// the L2 loss. Every global minibatch is split into one slice per
+// thread; each thread computes the partial X^T r of its slice in its
+// own buffer, the buffers are combined by a tree reduction, and a
+// single backward step updates theta. The threads persist across
+// iterations and meet at a barrier, and the calling thread is
+// worker 0. Results are deterministic for a given number of threads.
+// OpenBLAS is limited to one thread meanwhile so that its threads
+// do not compete with the workers.
+SGDResult parallel_sgd_sync(
+            Matrix* x, Matrix* y,
+            unsigned int batch_size,
+            SamplingPolicy policy,
+            double learning_rate,
+            unsigned int n_iter,
+            double tol,
+            unsigned int seed,
+            unsigned int n_threads)
+{
+    SGDResult result;
+    unsigned int i = 0;
+    double loss = 0.0;
+    size_t n = x->ncols;
+    int blas_threads = openblas_get_num_threads();
+    IntMatrix idxs = intmat_create(batch_size, 1);
+    BatchSampler sampler;
+    SyncShared shared;
+    SyncTask tasks[SGD_MAX_THREADS];
+    pthread_t threads[SGD_MAX_THREADS];
+    unsigned int n_started = 1;
+
+    // Initialize result object
+    init_sgdresult(&result, n_iter, n, seed);
+
+
+    // Find the mean of x and y to center them and remove bias
+    DataMeans means;
+    const Centering* centering = data_means_init(&means, stats_mean(x, 0), y);
+
+    sampler_init(&sampler, y->nrows, batch_size, policy, seed);
+    if (sampler.n_samples==0)
+        n_iter = 0;
+
+    // Every thread gets at least one row of the batch
+    n_threads = resolve_threads(n_threads);
+    if (batch_size>0 && batch_size<n_threads)
+        n_threads = batch_size;
+
+    shared.x = x;
+    shared.y = y;
+    shared.centering = centering;
+    shared.theta = &(result.theta_sol);
+    shared.idxs = &idxs;
+    shared.stop = false;
+    pthread_mutex_init(&(shared.start_lock), NULL);
+
+    // Workers that fail to start shrink the team. The workers wait
+    // for the start lock, so the slices are set up once the size of
+    // the team is known.
+    openblas_set_num_threads(1);
+    pthread_mutex_lock(&(shared.start_lock));
+    for (unsigned int t=1; t<n_threads; t++, n_started++)
+    {
+        tasks[t].shared = &shared;
+        tasks[t].id = t;
+        if (pthread_create(&threads[t], NULL, sync_worker, &tasks[t])!=0)
+            break;
+    }
+    n_threads = shared.n_threads = n_started;
+    for (unsigned int t=0; t<n_threads; t++)
+    {
+        SyncTask* task = &tasks[t];
+
+        task->shared = &shared;
+        task->id = t;
+        task->first = t*(size_t)batch_size/n_threads;
+        task->rows = (t+1)*(size_t)batch_size/n_threads - task->first;
+        task->x_local = mat_create(task->rows, n);
+        task->y_local = mat_create(task->rows, 1);
+        task->y_pred = mat_create(task->rows, 1);
+        task->partial = mat_create(n, 1);
+        task->partial_loss = 0.0;
+    }
+    pthread_barrier_init(&(shared.barrier), NULL, n_threads);
+    pthread_mutex_unlock(&(shared.start_lock));
+
+    // The profile is that of worker 0, on this thread
+    PROFILE_START();
+
+    // Minibatch Stochastic Gradient descent algorithm
+    for (i=0; i<n_iter; i++)
+    {
+        // Generate batch idxs, then let the workers start
+        PROFILE_MARK();
+        sampler_next(&sampler, &idxs);
+        PROFILE_LAP(PROFILE_SAMPLE);
+        pthread_barrier_wait(&(shared.barrier));
+        PROFILE_MARK();
+        sync_gradient(&tasks[0], tasks);
+        loss = tasks[0].partial_loss / (double)batch_size;
+
+        // Check convergence
+        if (loss < tol)
+        {
+            result.converged = true;
+            break;
+        }
+
+        // Print loss
+        if ((i+1)%LOSS_INTERVAL == 0)
+        {
+            printf("It. %u, loss = %.4f\n", i+1, loss);
+            result.losses[i/LOSS_INTERVAL] = loss;
+        }
+
+        // Update theta
+        PROFILE_MARK();
+        backward(&(result.theta_sol), &(tasks[0].partial),
+                 learning_rate, batch_size);
+        PROFILE_LAP(PROFILE_BACKWARD);
+    }
+
+    PROFILE_STOP(&(result.profile));
+
+    // Release the workers
+    shared.stop = true;
+    pthread_barrier_wait(&(shared.barrier));
+    for (unsigned int t=1; t<n_threads; t++)
+        pthread_join(threads[t], NULL);
+    pthread_barrier_destroy(&(shared.barrier));
+    pthread_mutex_destroy(&(shared.start_lock));
+    openblas_set_num_threads(blas_threads);
+
+    if (result.converged)
+        printf("Converged in %u iterations.\n", i+1);
+
+    // Calculate predicted bias
+    // bias = y_mean - x_mean theta
+    result.bias = centering_offset(centering, &(result.theta_sol));
+
+    // Destroy local matrices
+    for (unsigned int t=0; t<n_threads; t++)
+    {
+        mat_destroy(&(tasks[t].x_local));
+        mat_destroy(&(tasks[t].y_local));
+        mat_destroy(&(tasks[t].y_pred));
+        mat_destroy(&(tasks[t].partial));
+    }
+    data_means_destroy(&means);
+    intmat_destroy(&idxs);
+    sampler_destroy(&sampler);
+
+    // Truncate loss array
+    if (i>LOSS_INTERVAL)
+        result.losses = (double *)realloc(result.losses,
+                        ((i+1)/LOSS_INTERVAL) * sizeof(double));
+
+    return result;
+}
+
+// Out-of-core minibatch stochastic gradient descent. Chunks of the
+// stream are read by a background thread while the previous chunk
+// is trained on, so at most two chunks are in memory and the reads
+// overlap with the updates. Chunks are visited in a different order
+// every epoch (in file order for SAMPLE_SEQUENTIAL), and each chunk
+// is passed over once with minibatches drawn from its rows by
+// "policy". Batches are centered implicitly with the means of the
+// stream.
+SGDResult stochastic_gradient_descent_stream(
+            DataStream* stream,
+            unsigned int batch_size,
+            SamplingPolicy policy,
+            double learning_rate,
+            const LossFunctions* loss_fns,
+            unsigned int n_iter,
+            double tol,
+            unsigned int seed)
+{
+    SGDResult result;
+    unsigned int i = 0;
+    unsigned int n_chunks = 0;
+    double loss = 0.0;
+    size_t n_features = stream->n_features;
+    IntMatrix idxs = intmat_create(batch_size, 1);
+    IntMatrix idxs_in;
+    BatchSampler sampler;
+    ChunkReader reader;
+    bool reading;
+
+    // Initialize result object
+    init_sgdresult(&result, n_iter, n_features, seed);
+
+    Matrix x_batch = mat_create(batch_size, n_features);
+    Matrix y_batch = mat_create(batch_size, 1);
+    Matrix y_pred = mat_create(batch_size, 1);
+    Matrix grad = mat_create(n_features, 1);
+    Centering centering = {&(stream->feature_means), stream->y_mean};
+    Matrix x_chunk, y_chunk, x_in, y_in, y_pred_in;
+    MatArena arena;
+    MatArena* previous_arena;
+
+    reading = idxs.data!=NULL && chunk_reader_start(&reader, stream, policy, seed);
+    if (!reading)
+        n_iter = 0;
+
+    previous_arena = solver_arena_begin(&arena);
+
+    // Waiting for the next chunk is not a phase
+    PROFILE_START();
+
+    while (i<n_iter && !result.converged
+            && chunk_reader_next(&reader, &x_chunk, &y_chunk))
+    {
+        // Chunks shorter than a batch are trained on as one batch
+        size_t rows = x_chunk.nrows<batch_size? x_chunk.nrows: batch_size;
+        size_t steps = x_chunk.nrows / rows;
+
+        x_in = mat_view(&x_batch, 0, 0, rows, n_features);
+        y_in = mat_view(&y_batch, 0, 0, rows, 1);
+        y_pred_in = mat_view(&y_pred, 0, 0, rows, 1);
+        idxs_in.nrows = rows;
+        idxs_in.ncols = 1;
+        idxs_in.data = idxs.data;
+        sampler_init(&sampler, x_chunk.nrows, rows, policy, seed + n_chunks++);
+
+        // Minibatch Stochastic Gradient descent over the chunk
+        for (size_t step=0; step<steps && i<n_iter; step++)
+        {
+            mat_arena_reset(&arena);
+            PROFILE_MARK();
+
+            // Gather the batch from the chunk
+            sampler_next(&sampler, &idxs_in);
+            PROFILE_LAP(PROFILE_SAMPLE);
+            mat_gather(&x_chunk, &x_in, &idxs_in, 0);
+            mat_gather(&y_chunk, &y_in, &idxs_in, 0);
+            PROFILE_LAP(PROFILE_GATHER);
+
+            // Update loss and gradient
+            loss = loss_and_gradient(loss_fns, &x_in, &y_in, &centering,
+                                     &(result.theta_sol), &y_pred_in,
+                                     &grad, &arena);
+            PROFILE_LAP(PROFILE_LOSS);
+
+            // Check convergence
+            if (loss < tol)
+            {
+                result.converged = true;
+                break;
+            }
+
+            // Print loss
+            if ((i+1)%LOSS_INTERVAL == 0)
+            {
+                printf("It. %u, loss = %.4f\n", i+1, loss);
+                result.losses[i/LOSS_INTERVAL] = loss;
+            }
+
+            // Update theta
+            PROFILE_MARK();
+            backward(&(result.theta_sol), &grad, learning_rate, rows);
+            PROFILE_LAP(PROFILE_BACKWARD);
+            i++;
+        }
+
+        sampler_destroy(&sampler);
+        chunk_reader_release(&reader);
+    }
+
+    PROFILE_STOP(&(result.profile));
+    solver_arena_end(&arena, previous_arena);
+    if (reading)
+        chunk_reader_stop(&reader);
+
+    if (result.converged)
+        printf("Converged in %u iterations.\n", i+1);
+
+    // Calculate predicted bias
+    // bias = y_mean - x_mean theta
+    result.bias = centering_offset(&centering, &(result.theta_sol));
+
+    // Destroy local matrices
+    mat_destroy(&x_batch);
+    mat_destroy(&y_batch);
+    mat_destroy(&y_pred);
+    mat_destroy(&grad);
+    intmat_destroy(&idxs);
+
+    // Truncate loss array
+    if (i>LOSS_INTERVAL)
+        result.losses = (double *)realloc(result.losses,
+                        ((i+1)/LOSS_INTERVAL) * sizeof(double));
+
+    return result;
+}
+
+// Minibatch stochastic gradient descent on the L2 loss for sparse X,
+// centered implicitly like the dense solvers (see Centering) so that
+// the zeros of X are never filled in. The centered gradient
+//     grad = X_b^T r - x_mean^T sum(r)
+// has a dense term, so theta is kept as phi + a x_mean: X_b^T r is
+// scattered into phi and sum(r) goes into the scalar a. Tracking
+// x_mean phi as phi changes, a step costs O(batch_size + nnz of the
+// batch) and never O(n_features):
+//     r    = X_b phi + a X_b x_mean - y_b + y_mean - x_mean theta
+//     phi := phi - 2 * eta / B * X_b^T r
+//     a   := a + 2 * eta / B * sum(r)
+// The solve stops early, not converged, if a batch cannot be gathered.
+SGDResult stochastic_gradient_descent_sparse(
+            CSRMatrix* x, Matrix* y,
+            unsigned int batch_size,
+            SamplingPolicy policy,
+            double learning_rate,
+            unsigned int n_iter,
+            double tol,
+            unsigned int seed)
+{
+    SGDResult result;
+    unsigned int i = 0;
+    double loss = 0.0;
+    IntMatrix idxs = intmat_create(batch_size, 1);
+    BatchSampler sampler;
+    size_t n = x->ncols;
+
+    // Initialize result object
+    init_sgdresult(&result, n_iter, n, seed);
+
+    CSRMatrix x_batch = csr_create(batch_size, n, 0);
+    Matrix y_batch = mat_create(batch_size, 1);
+    Matrix residual = mat_create(batch_size, 1);
+    Matrix x_batch_mean = mat_create(batch_size, 1);
+
+    // Means of the columns of X (implicit zeros included) and of y
+    DataMeans means;
+    const Centering* centering = data_means_init(&means, csr_col_mean(x), y);
+
+    // x_mean as a column for csr_matvec, sharing its data
+    Matrix x_mean_col = means.x_mean;
+    x_mean_col.nrows = n;
+    x_mean_col.ncols = 1;
+    x_mean_col.stride = 1;
+    x_mean_col.owner = false;
+
+    // theta = phi + a x_mean, starting from zero so that features
+    // never seen in a batch do not contribute to predictions
+    Matrix* phi = &(result.theta_sol);
+    double a = 0.0, mean_phi = 0.0;
+    double mean_sq = ddot_64(n, means.x_mean.data, 1, means.x_mean.data, 1);
+    mat_fill(phi, 0.0);
+
+    sampler_init(&sampler, y->nrows, batch_size, policy, seed);
+    if (sampler.n_samples==0 || x_batch.row_ptr==NULL || x->nrows!=y->nrows)
+        n_iter = 0;
+
+    PROFILE_START();
+
+    // Minibatch Stochastic Gradient descent algorithm
+    for (i=0; i<n_iter; i++)
+    {
+        double step = -2.0 * learning_rate / (double)batch_size;
+        double offset = centering->y_mean - mean_phi - a*mean_sq;
+        double residual_sum = 0.0, residual_mean = 0.0;
+
+        PROFILE_MARK();
+
+        // Gather batch elements
+        sampler_next(&sampler, &idxs);
+        PROFILE_LAP(PROFILE_SAMPLE);
+        if (!csr_gather_rows(x, &x_batch, &idxs))
+            break;
+        mat_gather(y, &y_batch, &idxs, 0);
+        PROFILE_LAP(PROFILE_GATHER);
+
+        // Residual and loss
+        csr_matvec(&x_batch, phi, &residual);
+        csr_matvec(&x_batch, &x_mean_col, &x_batch_mean);
+        PROFILE_LAP(PROFILE_FORWARD);
+        loss = 0.0;
+        for (size_t k=0; k<batch_size; k++)
+        {
+            double r = residual.data[k] + a*x_batch_mean.data[k]
+                       - y_batch.data[k] + offset;
+            residual.data[k] = r;
+            residual_sum += r;
+            residual_mean += r * x_batch_mean.data[k];
+            loss += r * r;
+        }
+        loss /= (double)batch_size;
+        PROFILE_LAP(PROFILE_LOSS);
+
+        // Check convergence
+        if (loss < tol)
+        {
+            result.converged = true;
+            break;
+        }
+
+        // Print loss
+        if ((i+1)%LOSS_INTERVAL == 0)
+        {
+            printf("It. %u, loss = %.4f\n", i+1, loss);
+            result.losses[i/LOSS_INTERVAL] = loss;
+        }
+
+        // Update phi (touching only the columns of the batch), its
+        // product with x_mean, and the coefficient of x_mean
+        PROFILE_MARK();
+        csr_matvec_trans(&x_batch, step, &residual, phi);
+        mean_phi += step * residual_mean;
+        a -= step * residual_sum;
+        PROFILE_LAP(PROFILE_BACKWARD);
+    }
+
+    PROFILE_STOP(&(result.profile));
+
+    if (result.converged)
+        printf("Converged in %u iterations.\n", i+1);
+
+    // theta = phi + a x_mean, and the bias of the centered problem
+    // bias = y_mean - x_mean theta
+    daxpy_64(n, a, means.x_mean.data, 1, phi->data, phi->stride);
+    result.bias = centering_offset(centering, &(result.theta_sol));
+
+    // Destroy local matrices
+    csr_destroy(&x_batch);
+    mat_destroy(&y_batch);
+    mat_destroy(&residual);
+    mat_destroy(&x_batch_mean);
+    data_means_destroy(&means);
+    intmat_destroy(&idxs);
+    sampler_destroy(&sampler);
+
+    // Truncate loss array
+    if (i>LOSS_INTERVAL)
+        result.losses = (double *)realloc(result.losses,
+                        ((i+1)/LOSS_INTERVAL) * sizeof(double));
+
+    return result;
+}
+
+// Normal equations of the centered problem, computed without
+// materializing the centered x:
+//     gram = (X - 1 mu^T)^T (X - 1 mu^T) = X^T X - M mu mu^T
+//     xty  = (X - 1 mu^T)^T (y - y_mean) = X^T y - M mu y_mean
+// Only the upper triangle of gram is filled. Returns the centered
+// sum of squares (y - y_mean)^T (y - y_mean).
+static double centered_normal_equations(Matrix* x, Matrix* y,
+                                        Matrix* x_offset, double y_offset,
+                                        Matrix* gram, Matrix* xty)
+{
+    size_t m = x->nrows, n = x->ncols;
+    double yty;
+
+    // gram = X^T X (symmetric rank-k update)
+    dsyrk_64(n, m, 1.0, x->data, x->stride, 0.0, gram->data, n);
+    cblas_dsyr(CblasRowMajor, CblasUpper, n, -(double)m,
+               x_offset->data, 1, gram->data, n);
+
+    // xty = X^T y
+    dgemv_64(CblasTrans, m, n, 1.0, x->data, x->stride,
+             y->data, y->stride, 0.0, xty->data, 1);
+    cblas_daxpy(n, -(double)m * y_offset, x_offset->data, 1, xty->data, 1);
+
+    yty = ddot_64(m, y->data, y->stride, y->data, y->stride);
+    return yty - (double)m * y_offset * y_offset;
+}
+
+// Gradient descent on the L2 loss using the Gram matrix.
+// G = X^T X and b = X^T y are formed once, after which each
+// iteration costs O(N^2) independent of the number of samples:
+//     loss = (theta^T G theta - 2 theta^T b + y^T y) / M
+//     grad = G theta - b
+SGDResult gradient_descent_gram(
+            Matrix* x, Matrix* y,
+            double learning_rate,
+            unsigned int n_iter,
+            double tol,
+            unsigned int seed)
+{
+    SGDResult result;
+    unsigned int i = 0;
+    size_t n = x->ncols;
+    double loss = 0.0, yty;
+
+    // Initialize result object
+    init_sgdresult(&result, n_iter, n, seed);
+
+    Matrix gram = mat_create(n, n);
+    Matrix xty = mat_create(n, 1);
+    Matrix grad = mat_create(n, 1);
+    Matrix* theta = &(result.theta_sol);
+
+    // Find the mean of x and y, the centering is folded into
+    // the normal equations
+    DataMeans means;
+    const Centering* centering = data_means_init(&means, stats_mean(x, 0), y);
+
+    yty = centered_normal_equations(x, y, &(means.x_mean), centering->y_mean,
+                                    &gram, &xty);
+
+    PROFILE_START();
+
+    // Gradient descent algorithm
+    for (i=0; i<n_iter; i++)
+    {
+        PROFILE_MARK();
+
+        // grad = G theta
+        cblas_dsymv(CblasRowMajor, CblasUpper, n, 1.0, gram.data, n,
+                    theta->data, 1, 0.0, grad.data, 1);
+
+        // Update loss
+        loss = (cblas_ddot(n, theta->data, 1, grad.data, 1)
+                - 2.0 * cblas_ddot(n, theta->data, 1, xty.data, 1)
+                + yty) / (double)y->nrows;
+        PROFILE_LAP(PROFILE_LOSS);
+
+        // Check convergence
+        if (loss < tol)
+        {
+            result.converged = true;
+            break;
+        }
+    
+        // Print loss
+        if ((i+1)%LOSS_INTERVAL == 0)
+        {
+            printf("It. %u, loss = %.4f\n", i+1, loss);
+            result.losses[i/LOSS_INTERVAL] = loss;
+        }
+
+        // Update theta with grad = G theta - b
+        PROFILE_MARK();
+        cblas_daxpy(n, -1.0, xty.data, 1, grad.data, 1);
+        backward(theta, &grad, learning_rate, y->nrows);
+        PROFILE_LAP(PROFILE_BACKWARD);
+    }
+
+    PROFILE_STOP(&(result.profile));
+
+    if (result.converged)
+        printf("Converged in %u iterations.\n", i+1);
+
+    // Calculate predicted bias
+    // bias = y_mean - x_mean theta
+    result.bias = centering_offset(centering, theta);
+
+    // Destroy local matrices
+    mat_destroy(&gram);
+    mat_destroy(&xty);
+    mat_destroy(&grad);
+    data_means_destroy(&means);
+
+    // Truncate loss array
+    if (i>LOSS_INTERVAL)
+        result.losses = (double *)realloc(result.losses, 
+                        ((i+1)/LOSS_INTERVAL) * sizeof(double));
+
+    return result;
+}
+
+// Closed-form least squares via the normal equations
+//     (X^T X + ridge I) theta = X^T y
+// solved with a Cholesky factorization. The intercept is not
+// penalized. The result has no iterations or loss history.
+SGDResult normal_equation_solve(Matrix* x, Matrix* y, double ridge)
+{
+    SGDResult result;
+    size_t n = x->ncols;
+
+    // Initialize result object
+    init_sgdresult(&result, 0, n, 0);
+
+    Matrix gram = mat_create(n, n);
+
+    // Find the mean of x and y, the centering is folded into
+    // the normal equations
+    DataMeans means;
+    const Centering* centering = data_means_init(&means, stats_mean(x, 0), y);
+
+    // theta_sol holds X^T y and is overwritten by the solution
+    centered_normal_equations(x, y, &(means.x_mean), centering->y_mean,
+                              &gram, &(result.theta_sol));
+    for (size_t i=0; i<n; i++)
+        gram.data[i*n+i] += ridge;
+
+    if (mat_cholesky(&gram))
+    {
+        mat_cholesky_solve(&gram, &(result.theta_sol));
+        result.converged = true;
+    }
+    else
+    {
+        // theta_sol still holds X^T y, which is no solution
+        perror("ERROR: X^T X is singular, try a positive ridge term.");
+        mat_fill(&(result.theta_sol), 0.0);
+    }
+
+    // Calculate predicted bias
+    // bias = y_mean - x_mean theta
+    if (result.converged)
+        result.bias = centering_offset(centering, &(result.theta_sol));
+
+    // Destroy local matrices
+    mat_destroy(&gram);
+    data_means_destroy(&means);
+
+    return result;
+}
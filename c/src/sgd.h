@@ -5,10 +5,40 @@
 
 #include <stdbool.h>
 #include "matrix.h"
+#include "sampler.h"
+#include "losses.h"
+#include "stream.h"
+#include "sparse.h"
 
-// Loss functions and gradient functions
-typedef double (*loss_fn_type)(Matrix*, Matrix*);
-typedef Matrix (*grad_fn_type)(Matrix*, Matrix*, Matrix*);
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Phases of a solver iteration timed by the profiler
+typedef enum
+{
+    PROFILE_SAMPLE,     // Drawing the minibatch indices
+    PROFILE_GATHER,     // Copying the minibatch rows
+    PROFILE_FORWARD,    // Predictions, when not fused into the loss
+    PROFILE_LOSS,       // Loss and gradient (with the reduction for sync)
+    PROFILE_BACKWARD,   // Update of theta
+    PROFILE_N_PHASES
+} ProfilePhase;
+
+// Time per phase of a solver run, accumulated over all iterations.
+// Every iterative solver fills it in; phases a solver does not
+// have are left at zero calls (the fused L2 loss, for one, computes
+// its predictions inside the loss phase). The parallel solvers
+// report the phases of the worker on the calling thread only. Only
+// filled in when built with SGD_PROFILE defined; otherwise "enabled"
+// is false and the solvers are not instrumented.
+typedef struct
+{
+    bool enabled;
+    double total_seconds;                   // Whole iteration loop
+    double seconds[PROFILE_N_PHASES];
+    unsigned long long calls[PROFILE_N_PHASES];
+} SGDProfile;
 
 // Result struct for stochastic gradient descent
 typedef struct
@@ -18,33 +48,95 @@ typedef struct
     unsigned int n_iter;
     double* losses;
     Matrix theta_sol;
+    SGDProfile profile;
 } SGDResult;
 
 void init_sgdresult(SGDResult* result,
                     unsigned int n_iter,
-                    unsigned int n_features,
+                    size_t n_features,
                     unsigned int seed);
 void destroy_sgdresult(SGDResult* result);
+const char* sgd_profile_phase_name(ProfilePhase phase);
 void forward(Matrix* x, Matrix* theta, Matrix* y_pred);
-void backward(Matrix* x, Matrix* y, 
-              Matrix* theta, double eta,
-              grad_fn_type grad_fn);
+void backward(Matrix* theta, Matrix* grad,
+              double eta, size_t n_samples);
 SGDResult gradient_descent(
             Matrix* x, Matrix* y,
             double learning_rate,
-            loss_fn_type loss_fn,
-            grad_fn_type grad_fn,
+            const LossFunctions* loss_fns,
+            unsigned int n_iter,
+            double tol,
+            unsigned int seed);
+SGDResult gradient_descent_gram(
+            Matrix* x, Matrix* y,
+            double learning_rate,
             unsigned int n_iter,
             double tol,
             unsigned int seed);
 SGDResult stochastic_gradient_descent(
             Matrix* x, Matrix* y,
             unsigned int batch_size,
-            double learning_rate, 
-            loss_fn_type loss_fn,
-            grad_fn_type grad_fn,
+            SamplingPolicy policy,
+            double learning_rate,
+            const LossFunctions* loss_fns,
             unsigned int n_iter,
             double tol,
             unsigned int seed);
+// stochastic_gradient_descent_mixed reads X in single precision but
+// widens every minibatch to double, so the loss callbacks and their
+// BLAS products run in double precision.
+SGDResult stochastic_gradient_descent_mixed(
+            FMatrix* x, Matrix* y,
+            unsigned int batch_size,
+            SamplingPolicy policy,
+            double learning_rate,
+            const LossFunctions* loss_fns,
+            unsigned int n_iter,
+            double tol,
+            unsigned int seed);
+SGDResult parallel_sgd_hogwild(
+            Matrix* x, Matrix* y,
+            unsigned int batch_size,
+            SamplingPolicy policy,
+            double learning_rate,
+            const LossFunctions* loss_fns,
+            unsigned int n_iter,
+            double tol,
+            unsigned int seed,
+            unsigned int n_threads);
+// parallel_sgd_sync only minimizes the L2 loss: its threads reduce
+// the partial gradients X^T r of their slices, which a LossFunctions
+// table does not expose. Use parallel_sgd_hogwild for other losses.
+SGDResult parallel_sgd_sync(
+            Matrix* x, Matrix* y,
+            unsigned int batch_size,
+            SamplingPolicy policy,
+            double learning_rate,
+            unsigned int n_iter,
+            double tol,
+            unsigned int seed,
+            unsigned int n_threads);
+SGDResult stochastic_gradient_descent_stream(
+            DataStream* stream,
+            unsigned int batch_size,
+            SamplingPolicy policy,
+            double learning_rate,
+            const LossFunctions* loss_fns,
+            unsigned int n_iter,
+            double tol,
+            unsigned int seed);
+SGDResult stochastic_gradient_descent_sparse(
+            CSRMatrix* x, Matrix* y,
+            unsigned int batch_size,
+            SamplingPolicy policy,
+            double learning_rate,
+            unsigned int n_iter,
+            double tol,
+            unsigned int seed);
+SGDResult normal_equation_solve(Matrix* x, Matrix* y, double ridge);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif // _SGD_H_
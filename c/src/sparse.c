@@ -0,0 +1,222 @@
+// Sparse matrices in compressed sparse row (CSR) format
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matrix.h"
+#include "sparse.h"
+
+// Create an empty matrix (no nonzeros) with room for "capacity"
+// nonzeros
+CSRMatrix csr_create(size_t nrows, size_t ncols, size_t capacity)
+{
+    CSRMatrix mat;
+
+    mat.nrows = nrows;
+    mat.ncols = ncols;
+    mat.nnz = 0;
+    mat.capacity = capacity;
+    mat.col_idx = NULL;
+    mat.values = NULL;
+
+    if (nrows==0 || ncols==0)
+    {
+        perror("ERROR: Number of rows/columns cannot be zero.");
+        mat.row_ptr = NULL;
+        return mat;
+    }
+
+    mat.row_ptr = (size_t *)calloc(nrows+1, sizeof(size_t));
+    if (capacity>0)
+    {
+        mat.col_idx = (unsigned int *)malloc(capacity*sizeof(unsigned int));
+        mat.values = (double *)malloc(capacity*sizeof(double));
+    }
+    return mat;
+}
+
+// Make room for "capacity" nonzeros, keeping the existing ones.
+// On failure the matrix keeps its arrays and capacity.
+static bool csr_reserve(CSRMatrix* mat, size_t capacity)
+{
+    unsigned int* col_idx;
+    double* values;
+
+    if (capacity<=mat->capacity)
+        return true;
+    col_idx = (unsigned int *)realloc(mat->col_idx,
+                                      capacity*sizeof(unsigned int));
+    if (col_idx==NULL)
+        return false;
+    mat->col_idx = col_idx;
+    values = (double *)realloc(mat->values, capacity*sizeof(double));
+    if (values==NULL)
+        return false;
+    mat->values = values;
+    mat->capacity = capacity;
+    return true;
+}
+
+// Compress the nonzero elements of a dense matrix
+CSRMatrix csr_from_dense(Matrix* mat)
+{
+    CSRMatrix csr;
+    size_t nnz = 0;
+
+    for (size_t i=0; i<mat->nrows; i++)
+        for (size_t j=0; j<mat->ncols; j++)
+            nnz += mat->data[i*mat->stride+j]!=0.0;
+
+    csr = csr_create(mat->nrows, mat->ncols, nnz);
+    if (csr.row_ptr==NULL)
+        return csr;
+
+    for (size_t i=0; i<mat->nrows; i++)
+    {
+        for (size_t j=0; j<mat->ncols; j++)
+        {
+            double value = mat->data[i*mat->stride+j];
+            if (value==0.0)
+                continue;
+            csr.col_idx[csr.nnz] = (unsigned int)j;
+            csr.values[csr.nnz] = value;
+            csr.nnz++;
+        }
+        csr.row_ptr[i+1] = csr.nnz;
+    }
+    return csr;
+}
+
+// Expand to a dense matrix
+Matrix csr_to_dense(CSRMatrix* mat)
+{
+    Matrix dense = mat_create(mat->nrows, mat->ncols);
+
+    if (dense.data==NULL)
+        return dense;
+    mat_fill(&dense, 0.0);
+    for (size_t i=0; i<mat->nrows; i++)
+        for (size_t k=mat->row_ptr[i]; k<mat->row_ptr[i+1]; k++)
+            dense.data[i*dense.stride+mat->col_idx[k]] = mat->values[k];
+    return dense;
+}
+
+// Mean of every column, 1 x ncols like stats_mean(mat, 0).
+// Costs O(nnz + ncols).
+Matrix csr_col_mean(CSRMatrix* mat)
+{
+    Matrix mean = mat_create(1, mat->ncols);
+
+    if (mean.data==NULL)
+        return mean;
+    mat_fill(&mean, 0.0);
+    for (size_t k=0; k<mat->nnz; k++)
+        mean.data[mat->col_idx[k]] += mat->values[k];
+    for (size_t j=0; j<mat->ncols; j++)
+        mean.data[j] /= (double)mat->nrows;
+    return mean;
+}
+
+// Sparse matrix times dense vector, y = A x
+// x is ncols x 1 and y is nrows x 1. Costs O(nnz).
+void csr_matvec(CSRMatrix* mat, Matrix* x, Matrix* y)
+{
+    if (x->nrows!=mat->ncols || y->nrows!=mat->nrows
+            || x->ncols!=1 || y->ncols!=1)
+    {
+        perror("ERROR: Dimension mismatch in sparse matrix-vector product.");
+        return;
+    }
+
+    for (size_t i=0; i<mat->nrows; i++)
+    {
+        double sum = 0.0;
+        for (size_t k=mat->row_ptr[i]; k<mat->row_ptr[i+1]; k++)
+            sum += mat->values[k] * x->data[mat->col_idx[k]*x->stride];
+        y->data[i*y->stride] = sum;
+    }
+}
+
+// Transposed product accumulated into y, y := y + alpha A^T x
+// x is nrows x 1 and y is ncols x 1. Only the elements of y in
+// columns holding nonzeros are touched, so the cost is O(nnz) and
+// not O(ncols): a gradient can be scattered straight into theta.
+void csr_matvec_trans(CSRMatrix* mat, double alpha, Matrix* x, Matrix* y)
+{
+    if (x->nrows!=mat->nrows || y->nrows!=mat->ncols
+            || x->ncols!=1 || y->ncols!=1)
+    {
+        perror("ERROR: Dimension mismatch in sparse matrix-vector product.");
+        return;
+    }
+
+    for (size_t i=0; i<mat->nrows; i++)
+    {
+        double scale = alpha * x->data[i*x->stride];
+        if (scale==0.0)
+            continue;
+        for (size_t k=mat->row_ptr[i]; k<mat->row_ptr[i+1]; k++)
+            y->data[mat->col_idx[k]*y->stride] += scale * mat->values[k];
+    }
+}
+
+// Gather the rows of "from" listed in "indices" into "to", which
+// must have one row per index and as many columns as "from". The
+// arrays of "to" grow as needed and are reused otherwise. Returns
+// false, leaving "to" unchanged, if an index is out of bounds or the
+// arrays cannot grow.
+bool csr_gather_rows(CSRMatrix* from, CSRMatrix* to, IntMatrix* indices)
+{
+    size_t n_idx = indices->nrows*indices->ncols;
+    size_t nnz = 0;
+
+    if (to->nrows!=n_idx || to->ncols!=from->ncols)
+    {
+        perror("ERROR: Destination must have one row per index and as many columns as source.");
+        return false;
+    }
+    for (size_t i=0; i<n_idx; i++)
+    {
+        if (indices->data[i]<0 || (size_t)indices->data[i]>=from->nrows)
+        {
+            perror("ERROR: Row index out of bounds in gather.");
+            return false;
+        }
+        nnz += from->row_ptr[indices->data[i]+1]
+               - from->row_ptr[indices->data[i]];
+    }
+    if (!csr_reserve(to, nnz))
+    {
+        perror("ERROR: Could not allocate memory for the gathered rows.");
+        return false;
+    }
+
+    to->nnz = 0;
+    for (size_t i=0; i<n_idx; i++)
+    {
+        size_t begin = from->row_ptr[indices->data[i]];
+        size_t count = from->row_ptr[indices->data[i]+1] - begin;
+
+        memcpy(to->col_idx+to->nnz, from->col_idx+begin,
+               count*sizeof(unsigned int));
+        memcpy(to->values+to->nnz, from->values+begin,
+               count*sizeof(double));
+        to->nnz += count;
+        to->row_ptr[i+1] = to->nnz;
+    }
+    return true;
+}
+
+// Destroy a sparse matrix
+void csr_destroy(CSRMatrix* mat)
+{
+    if (mat==NULL)
+        return;
+    free(mat->row_ptr);
+    free(mat->col_idx);
+    free(mat->values);
+    mat->row_ptr = NULL;
+    mat->col_idx = NULL;
+    mat->values = NULL;
+    mat->nnz = mat->capacity = 0;
+}
@@ -0,0 +1,42 @@
+// Sparse matrices in compressed sparse row (CSR) format
+
+#ifndef _SPARSE_H_
+#define _SPARSE_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "matrix.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// CSR matrix for double precision data. The nonzeros of row i are
+// values[row_ptr[i] .. row_ptr[i+1]) in columns
+// col_idx[row_ptr[i] .. row_ptr[i+1]), with columns ascending
+// within a row. "capacity" is the number of nonzeros the arrays can
+// hold, so a matrix can be refilled (e.g. by csr_gather_rows)
+// without reallocating.
+typedef struct
+{
+    size_t nrows, ncols;
+    size_t nnz, capacity;
+    size_t* row_ptr;        // nrows + 1 entries
+    unsigned int* col_idx;
+    double* values;
+} CSRMatrix;
+
+CSRMatrix csr_create(size_t nrows, size_t ncols, size_t capacity);
+CSRMatrix csr_from_dense(Matrix* mat);
+Matrix csr_to_dense(CSRMatrix* mat);
+Matrix csr_col_mean(CSRMatrix* mat);
+void csr_matvec(CSRMatrix* mat, Matrix* x, Matrix* y);
+void csr_matvec_trans(CSRMatrix* mat, double alpha, Matrix* x, Matrix* y);
+bool csr_gather_rows(CSRMatrix* from, CSRMatrix* to, IntMatrix* indices);
+void csr_destroy(CSRMatrix* mat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SPARSE_H_
@@ -1,52 +1,57 @@
 // Miscellaneous statistical functions.
+//
+// Written with the expression templates of matrix_expr.hpp: the
+// error sums are single fused passes over the inputs.
 
+#include <stdio.h>
 #include <stdlib.h>
 #include "matrix.h"
+#include "matrix_expr.hpp"
 #include "stats.h"
 
+using mx::Mat;
+using mx::MatRef;
+
 // Mean of a two-dimensional matrix along
 // the specified dimension - 0 is columns and 1 is rows.
 // Any other number specified gives the mean across all dimensions.
 Matrix stats_mean(Matrix* mat, unsigned int dimension)
 {
-    Matrix mean;
-    
+    MatRef x(*mat);
+
     // Reduce along rows
     if (dimension==0)
     {
-        mean = mat_create(1, mat->ncols);
-        mat_fill(&mean, 0.0);
+        Mat mean(1, mat->ncols);
 
-        for (size_t i=0; i<mat->nrows*mat->ncols; ++i)
-            mean.data[i%mat->ncols] += mat->data[i];
-        mat_scale(&mean, 1.0/(double)mat->nrows);
+        mean = 0.0;
+        for (size_t i=0; i<mat->nrows; ++i)
+            mean += x.row(i);
+        mean *= 1.0/(double)mat->nrows;
+        return mean.release();
     }
     // Reduce along columns
     else if (dimension==1)
     {
-        mean = mat_create(mat->nrows, 1);
-        mat_fill(&mean, 0.0);
+        Mat mean(mat->nrows, 1);
 
-        for (size_t i=0; i<mat->nrows*mat->ncols; ++i)
-            mean.data[i%mat->nrows] += mat->data[i];
-        mat_scale(&mean, 1.0/(double)mat->ncols);
+        for (size_t i=0; i<mat->nrows; ++i)
+            mean(i, 0) = mx::sum(x.row(i));
+        mean *= 1.0/(double)mat->ncols;
+        return mean.release();
     }
     // Reduce along all axes
     else
     {
-        mean = mat_create(1, 1);
-        mat_fill(&mean, 0.0);
+        Mat mean(1, 1);
 
-        for (size_t i=0; i<mat->nrows*mat->ncols; ++i)
-            mean.data[0] += mat->data[i];
-        mean.data[0] /= (double)(mat->nrows*mat->ncols);
+        mean(0, 0) = mx::sum(x) / (double)(mat->nrows*mat->ncols);
+        return mean.release();
     }
-
-    return mean;
 }
 
 // Mean absolute error.
-// MAE = \sum_i (y_true_i - y_pred_i)
+// MAE = \sum_i |y_true_i - y_pred_i| / N
 double stats_mae(Matrix* y_true, Matrix* y_pred)
 {
     if (y_true==NULL || y_pred==NULL)
@@ -60,14 +65,8 @@ double stats_mae(Matrix* y_true, Matrix* y_pred)
         perror("ERROR: Arrays do not match expected dimensions.");
         return 0.0;
     }
-    
-    double mae = 0.0;
-    Matrix diff = mat_copy(y_true);
-    
-    mat_sub(&diff, y_pred);
-    mae = mat_abs_sum(&diff);
 
-    mat_destroy(&diff);
+    double mae = mx::sum_abs(MatRef(*y_true) - MatRef(*y_pred));
 
     return mae / (y_true->nrows*y_true->ncols);
 }
@@ -75,7 +74,7 @@ double stats_mae(Matrix* y_true, Matrix* y_pred)
 // Coefficient of determination
 // R^2 = 1 - SS_{res}/SS_{tot}
 // where SS_{res} = \sum_i (y_true_i - y_pred_i)^2
-//       SS_{tot} = \sum_i (y_true_i - y_mean)
+//       SS_{tot} = \sum_i (y_true_i - y_mean)^2
 double stats_r2(Matrix* y_true, Matrix* y_pred)
 {
     if (y_true==NULL || y_pred==NULL)
@@ -89,25 +88,11 @@ double stats_r2(Matrix* y_true, Matrix* y_pred)
         perror("ERROR: Arrays do not match expected dimensions.");
         return 0.0;
     }
-    
-    double ss_res, ss_tot;
-    Matrix y_mean, diff, ss_tot_vec;
-   
-    diff = mat_copy(y_true);
-    mat_sub(&diff, y_pred);
-    ss_res = mat_norm(&diff);
-    ss_res = ss_res*ss_res;
 
-    y_mean = stats_mean(y_true, 0);
-    ss_tot_vec = mat_copy(y_true);
-    mat_add_scalar(&ss_tot_vec, -1 * y_mean.data[0]);
-    ss_tot = mat_norm(&ss_tot_vec);
-    ss_tot = ss_tot * ss_tot;
-
-    mat_destroy(&y_mean);
-    mat_destroy(&diff);
-    mat_destroy(&ss_tot_vec);
+    MatRef y(*y_true);
+    double y_mean = mx::sum(y) / (double)y_true->nrows;
+    double ss_res = mx::sum_sq(y - MatRef(*y_pred));
+    double ss_tot = mx::sum_sq(y - y_mean);
 
     return 1.0 - ss_res/ss_tot;
 }
-
@@ -5,8 +5,16 @@
 
 #include "matrix.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 Matrix stats_mean(Matrix* mat, unsigned int dimension);
 double stats_mae(Matrix* y_true, Matrix* y_pred);
 double stats_r2(Matrix* y_true, Matrix* y_pred);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif // _STATS_H_
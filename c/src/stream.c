@@ -0,0 +1,379 @@
+// Out-of-core streaming of training data in fixed-size chunks
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "matrix.h"
+#include "sampler.h"
+#include "dataset.h"
+#include "csv.h"
+#include "stream.h"
+
+// Read exactly "size" bytes at "offset", retrying short reads
+static bool pread_all(int fd, void* buffer, size_t size, size_t offset)
+{
+    char* p = (char*)buffer;
+
+    while (size>0)
+    {
+        ssize_t n = pread(fd, p, size, (off_t)offset);
+        if (n<=0)
+            return false;
+        p += n;
+        size -= (size_t)n;
+        offset += (size_t)n;
+    }
+    return true;
+}
+
+// Widen "n_elem" floats stored at the start of "data" to doubles in
+// place. Runs backwards: double i ends past float i, so every float
+// is read before the doubles after it overwrite it.
+static void widen_in_place(double* data, size_t n_elem)
+{
+    const char* bytes = (const char*)data;
+
+    for (size_t i=n_elem; i-->0;)
+    {
+        float value;
+        memcpy(&value, bytes + i*sizeof(float), sizeof(float));
+        data[i] = (double)value;
+    }
+}
+
+// Open a binary dataset file; the statistics come from its header
+static bool open_dataset(DataStream* stream, const char* path)
+{
+    DatasetHeader header;
+    struct stat file_stat;
+    size_t n_features;
+
+    stream->fd = open(path, O_RDONLY);
+    if (stream->fd<0 || fstat(stream->fd, &file_stat)!=0
+            || !pread_all(stream->fd, &header, sizeof(header), 0)
+            || !dataset_header_valid(&header, (size_t)file_stat.st_size))
+    {
+        perror("ERROR: Could not open dataset file or not a valid dataset.");
+        return false;
+    }
+
+    n_features = header.n_features;
+    stream->format = STREAM_DATASET;
+    stream->dtype = (DatasetDType)header.dtype;
+    stream->n_samples = header.n_samples;
+    stream->n_features = n_features;
+    stream->x_offset = header.x_offset;
+    stream->y_offset = header.y_offset;
+
+    // Means follow the header, the mean of y follows the stds
+    stream->feature_means = mat_create(1, n_features);
+    return pread_all(stream->fd, stream->feature_means.data,
+                     n_features*sizeof(double), sizeof(header))
+        && pread_all(stream->fd, &(stream->y_mean), sizeof(double),
+                     sizeof(header) + 2*n_features*sizeof(double));
+}
+
+// Index a CSV file and find its means with one pass over the chunks
+static bool open_csv(DataStream* stream, const char* path,
+                     const CSVOptions* csv_options)
+{
+    Matrix x_buffer, y_buffer;
+    bool ok = true;
+
+    if (!csv_index(path, csv_options, stream->chunk_rows, &(stream->index)))
+        return false;
+    stream->fd = open(path, O_RDONLY);
+    if (stream->fd<0)
+    {
+        perror("ERROR: Could not open CSV file.");
+        return false;
+    }
+
+    stream->format = STREAM_CSV;
+    stream->dtype = DATASET_F64;
+    stream->n_samples = stream->index.n_rows;
+    stream->n_features = stream->index.n_cols - 1;
+    for (size_t k=0; k<stream->index.n_chunks; k++)
+    {
+        size_t size = stream->index.chunk_offsets[k+1]
+                      - stream->index.chunk_offsets[k];
+        if (size>stream->text_size)
+            stream->text_size = size;
+    }
+    stream->text = (char *)malloc(stream->text_size);
+    stream->n_chunks = stream->index.n_chunks;
+
+    stream->feature_means = mat_create(1, stream->n_features);
+    x_buffer = mat_create(stream_chunk_size(stream, 0), stream->n_features);
+    y_buffer = mat_create(stream_chunk_size(stream, 0), 1);
+    for (size_t k=0; ok && k<stream->n_chunks; k++)
+    {
+        size_t rows = stream_chunk_size(stream, k);
+        Matrix x = mat_view(&x_buffer, 0, 0, rows, stream->n_features);
+        Matrix y = mat_view(&y_buffer, 0, 0, rows, 1);
+
+        ok = stream_read_chunk(stream, k, &x, &y);
+        for (size_t i=0; ok && i<rows; i++)
+        {
+            for (size_t j=0; j<stream->n_features; j++)
+                stream->feature_means.data[j] += x.data[i*x.stride+j];
+            stream->y_mean += y.data[i];
+        }
+    }
+    mat_scale(&(stream->feature_means), 1.0/(double)stream->n_samples);
+    stream->y_mean /= (double)stream->n_samples;
+
+    mat_destroy(&x_buffer);
+    mat_destroy(&y_buffer);
+    return ok;
+}
+
+// Open "path" for reading in chunks of "chunk_rows" rows. The file
+// is a binary dataset if "csv_options" is NULL and a CSV file
+// otherwise.
+bool stream_open(DataStream* stream, const char* path, size_t chunk_rows,
+                 const CSVOptions* csv_options)
+{
+    bool ok;
+
+    memset(stream, 0, sizeof(DataStream));
+    stream->fd = -1;
+    if (path==NULL || chunk_rows==0)
+    {
+        perror("ERROR: Invalid path or number of rows per chunk.");
+        return false;
+    }
+    stream->chunk_rows = chunk_rows;
+
+    ok = csv_options!=NULL? open_csv(stream, path, csv_options)
+                          : open_dataset(stream, path);
+    if (!ok)
+    {
+        stream_close(stream);
+        return false;
+    }
+    stream->n_chunks = (stream->n_samples + chunk_rows - 1) / chunk_rows;
+    return true;
+}
+
+// Number of rows in chunk "chunk"
+size_t stream_chunk_size(DataStream* stream, size_t chunk)
+{
+    size_t first = chunk*stream->chunk_rows;
+
+    if (first>=stream->n_samples)
+        return 0;
+    return stream->n_samples-first < stream->chunk_rows?
+           stream->n_samples-first: stream->chunk_rows;
+}
+
+// Read chunk "chunk" into x (rows x n_features) and y (rows x 1),
+// which must be contiguous and have exactly the rows of the chunk.
+// Not thread safe: a stream is read by one thread at a time.
+bool stream_read_chunk(DataStream* stream, size_t chunk, Matrix* x, Matrix* y)
+{
+    size_t rows = stream_chunk_size(stream, chunk);
+    size_t n_features = stream->n_features;
+    size_t elem, first, begin, size;
+
+    if (rows==0 || x->nrows!=rows || x->ncols!=n_features
+            || x->stride!=n_features || y->nrows!=rows || y->stride!=1)
+    {
+        perror("ERROR: Chunk does not exist or matrices do not match its size.");
+        return false;
+    }
+
+    if (stream->format==STREAM_CSV)
+    {
+        begin = stream->index.chunk_offsets[chunk];
+        size = stream->index.chunk_offsets[chunk+1] - begin;
+        if (!pread_all(stream->fd, stream->text, size, begin))
+        {
+            perror("ERROR: Could not read CSV file.");
+            return false;
+        }
+        return csv_parse_rows(stream->text, stream->text + size,
+                              stream->index.delimiter, stream->index.n_cols,
+                              stream->index.target, x, y, 0);
+    }
+
+    // Single precision values are read into the front of the buffers
+    // and widened there
+    elem = stream->dtype==DATASET_F32? sizeof(float): sizeof(double);
+    first = chunk*stream->chunk_rows;
+    if (!pread_all(stream->fd, x->data, rows*n_features*elem,
+                   stream->x_offset + first*n_features*elem)
+            || !pread_all(stream->fd, y->data, rows*elem,
+                          stream->y_offset + first*elem))
+    {
+        perror("ERROR: Could not read dataset file.");
+        return false;
+    }
+    if (stream->dtype==DATASET_F32)
+    {
+        widen_in_place(x->data, rows*n_features);
+        widen_in_place(y->data, rows);
+    }
+    return true;
+}
+
+// Close the file and free the buffers of a stream
+void stream_close(DataStream* stream)
+{
+    if (stream==NULL)
+        return;
+    if (stream->fd>=0)
+        close(stream->fd);
+    csv_index_destroy(&(stream->index));
+    free(stream->text);
+    mat_destroy(&(stream->feature_means));
+    memset(stream, 0, sizeof(DataStream));
+    stream->fd = -1;
+}
+
+// Reader thread: fill the buffers in turn, waiting while the next
+// one is still in use
+static void* reader_main(void* arg)
+{
+    ChunkReader* reader = (ChunkReader*)arg;
+    DataStream* stream = reader->stream;
+    unsigned int slot = 0;
+    IntMatrix chunk;
+    int k;
+
+    chunk.nrows = chunk.ncols = 1;
+    chunk.data = &k;
+    for (;;)
+    {
+        size_t rows;
+        Matrix x, y;
+        bool ok;
+
+        pthread_mutex_lock(&(reader->lock));
+        while (reader->full[slot] && !reader->stop)
+            pthread_cond_wait(&(reader->cond), &(reader->lock));
+        if (reader->stop)
+        {
+            pthread_mutex_unlock(&(reader->lock));
+            break;
+        }
+        pthread_mutex_unlock(&(reader->lock));
+
+        // The read runs unlocked, overlapping with training on the
+        // other buffer
+        sampler_next(&(reader->order), &chunk);
+        rows = stream_chunk_size(stream, (size_t)k);
+        x = mat_view(&(reader->x[slot]), 0, 0, rows, stream->n_features);
+        y = mat_view(&(reader->y[slot]), 0, 0, rows, 1);
+        ok = stream_read_chunk(stream, (size_t)k, &x, &y);
+
+        pthread_mutex_lock(&(reader->lock));
+        reader->rows[slot] = rows;
+        reader->full[slot] = ok;
+        reader->failed = !ok;
+        pthread_cond_broadcast(&(reader->cond));
+        pthread_mutex_unlock(&(reader->lock));
+        if (!ok)
+            break;
+        slot ^= 1;
+    }
+    return NULL;
+}
+
+// Start reading chunks of "stream" in the background. Chunks are
+// shuffled every epoch unless "policy" is SAMPLE_SEQUENTIAL.
+bool chunk_reader_start(ChunkReader* reader, DataStream* stream,
+                        SamplingPolicy policy, unsigned int seed)
+{
+    size_t rows = stream_chunk_size(stream, 0);
+
+    memset(reader, 0, sizeof(ChunkReader));
+    if (rows==0)
+    {
+        perror("ERROR: Stream has no rows.");
+        return false;
+    }
+
+    reader->stream = stream;
+    sampler_init(&(reader->order), stream->n_chunks, 1,
+                 policy==SAMPLE_SEQUENTIAL? SAMPLE_SEQUENTIAL: SAMPLE_SHUFFLE,
+                 seed);
+    for (int s=0; s<2; s++)
+    {
+        reader->x[s] = mat_create(rows, stream->n_features);
+        reader->y[s] = mat_create(rows, 1);
+    }
+    pthread_mutex_init(&(reader->lock), NULL);
+    pthread_cond_init(&(reader->cond), NULL);
+
+    if (pthread_create(&(reader->thread), NULL, reader_main, reader)!=0)
+    {
+        perror("ERROR: Could not start chunk reader thread.");
+        pthread_mutex_destroy(&(reader->lock));
+        pthread_cond_destroy(&(reader->cond));
+        for (int s=0; s<2; s++)
+        {
+            mat_destroy(&(reader->x[s]));
+            mat_destroy(&(reader->y[s]));
+        }
+        sampler_destroy(&(reader->order));
+        return false;
+    }
+    return true;
+}
+
+// Wait for the next chunk and view it in x and y. The views stay
+// valid until chunk_reader_release. Returns false if reading failed.
+bool chunk_reader_next(ChunkReader* reader, Matrix* x, Matrix* y)
+{
+    unsigned int slot = reader->current;
+    bool ok;
+
+    pthread_mutex_lock(&(reader->lock));
+    while (!reader->full[slot] && !reader->failed)
+        pthread_cond_wait(&(reader->cond), &(reader->lock));
+    ok = reader->full[slot];
+    pthread_mutex_unlock(&(reader->lock));
+
+    if (ok)
+    {
+        *x = mat_view(&(reader->x[slot]), 0, 0, reader->rows[slot],
+                      reader->x[slot].ncols);
+        *y = mat_view(&(reader->y[slot]), 0, 0, reader->rows[slot], 1);
+    }
+    return ok;
+}
+
+// Hand the current chunk back to the reader for refilling
+void chunk_reader_release(ChunkReader* reader)
+{
+    pthread_mutex_lock(&(reader->lock));
+    reader->full[reader->current] = false;
+    pthread_cond_broadcast(&(reader->cond));
+    pthread_mutex_unlock(&(reader->lock));
+    reader->current ^= 1;
+}
+
+// Stop the reader thread and free its buffers
+void chunk_reader_stop(ChunkReader* reader)
+{
+    pthread_mutex_lock(&(reader->lock));
+    reader->stop = true;
+    pthread_cond_broadcast(&(reader->cond));
+    pthread_mutex_unlock(&(reader->lock));
+    pthread_join(reader->thread, NULL);
+
+    pthread_mutex_destroy(&(reader->lock));
+    pthread_cond_destroy(&(reader->cond));
+    for (int s=0; s<2; s++)
+    {
+        mat_destroy(&(reader->x[s]));
+        mat_destroy(&(reader->y[s]));
+    }
+    sampler_destroy(&(reader->order));
+}
@@ -0,0 +1,76 @@
+// Out-of-core streaming of training data in fixed-size chunks
+
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+#include <stdbool.h>
+#include <pthread.h>
+#include "matrix.h"
+#include "sampler.h"
+#include "dataset.h"
+#include "csv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    STREAM_DATASET,  // Binary dataset file (see dataset.h)
+    STREAM_CSV       // CSV file, indexed by csv_index
+} StreamFormat;
+
+// A data file read in chunks of chunk_rows rows (the last chunk may
+// be shorter). Only the feature means and the mean of y are kept in
+// memory; they come from the dataset header, or from one sequential
+// pass over a CSV file.
+typedef struct
+{
+    StreamFormat format;
+    int fd;
+    DatasetDType dtype;
+    size_t n_samples, n_features;
+    size_t chunk_rows, n_chunks;
+    size_t x_offset, y_offset;  // Byte offsets of X and y (datasets)
+    CSVIndex index;             // Chunk offsets (CSV files)
+    char* text;                 // Buffer for the bytes of a CSV chunk
+    size_t text_size;
+    Matrix feature_means;       // 1 x n_features
+    double y_mean;
+} DataStream;
+
+// Background reader filling two chunk buffers in turn, so that the
+// next chunk is read while the current one is trained on. Chunks are
+// visited in an order drawn by a BatchSampler with one chunk per
+// batch: shuffled every epoch, or in file order for
+// SAMPLE_SEQUENTIAL.
+typedef struct
+{
+    DataStream* stream;
+    BatchSampler order;
+    Matrix x[2], y[2];        // Chunk buffers, chunk_rows rows each
+    size_t rows[2];           // Rows held by each buffer
+    bool full[2];
+    bool stop, failed;
+    unsigned int current;     // Buffer handed out by chunk_reader_next
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} ChunkReader;
+
+bool stream_open(DataStream* stream, const char* path, size_t chunk_rows,
+                 const CSVOptions* csv_options);
+size_t stream_chunk_size(DataStream* stream, size_t chunk);
+bool stream_read_chunk(DataStream* stream, size_t chunk, Matrix* x, Matrix* y);
+void stream_close(DataStream* stream);
+bool chunk_reader_start(ChunkReader* reader, DataStream* stream,
+                        SamplingPolicy policy, unsigned int seed);
+bool chunk_reader_next(ChunkReader* reader, Matrix* x, Matrix* y);
+void chunk_reader_release(ChunkReader* reader);
+void chunk_reader_stop(ChunkReader* reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _STREAM_H_
@@ -0,0 +1,124 @@
+// Tests for module csv.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <catch2/catch_all.hpp>
+#include "../src/matrix.h"
+#include "../src/csv.h"
+
+// Write "contents" to a new temporary file whose path is left in "path"
+static void write_file(char* path, const char* contents)
+{
+    int fd = mkstemp(path);
+    FILE* file = fdopen(fd, "w");
+    fputs(contents, file);
+    fclose(file);
+}
+
+TEST_CASE("Parsing numbers.", "[csv]")
+{
+    const char* numbers[] = {"0", "-3", "+2.5", "3.14159", "-0.000123",
+                             "1e-5", "6.02214076E23", "12345678901234567890",
+                             "0.1", "4.9406564584124654e-324", "  7.25"};
+    const char* next;
+
+    for (size_t i=0; i<sizeof(numbers)/sizeof(numbers[0]); i++)
+    {
+        const char* end = numbers[i] + strlen(numbers[i]);
+        REQUIRE(csv_parse_double(numbers[i], end, &next)==strtod(numbers[i], NULL));
+        REQUIRE(next==end);
+    }
+
+    SECTION("Parsing stops at delimiters.")
+    {
+        const char* field = "1.5,2";
+        REQUIRE(csv_parse_double(field, field+5, &next)==1.5);
+        REQUIRE(*next==',');
+    }
+
+    SECTION("Fields without a number are reported.")
+    {
+        const char* field = "x1,2";
+        csv_parse_double(field, field+4, &next);
+        REQUIRE(next==field);
+    }
+}
+
+TEST_CASE("Loading CSV files.", "[csv]")
+{
+    char path[] = "/tmp/test_csv_XXXXXX";
+    CSVOptions options = csv_default_options();
+    CSVStats stats;
+    Matrix x, y;
+
+    SECTION("Header is skipped and the last column is the target.")
+    {
+        write_file(path, "a,b,target\n1,2,3\n4.5,-5,6e1\r\n\n7,8,9");
+        REQUIRE(csv_load(path, &options, &x, &y, &stats));
+
+        REQUIRE(x.nrows==3);
+        REQUIRE(x.ncols==2);
+        REQUIRE(stats.n_rows==3);
+        REQUIRE(stats.n_cols==3);
+        REQUIRE(x.data[2]==4.5);
+        REQUIRE(x.data[3]==-5.0);
+        REQUIRE(y.data[1]==60.0);
+        REQUIRE(y.data[2]==9.0);
+
+        mat_destroy(&x);
+        mat_destroy(&y);
+    }
+
+    SECTION("Choosing the target column.")
+    {
+        write_file(path, "1;2;3\n4;5;6\n");
+        options.delimiter = ';';
+        options.target_column = 0;
+        REQUIRE(csv_load(path, &options, &x, &y, NULL));
+
+        REQUIRE(y.data[0]==1.0);
+        REQUIRE(y.data[1]==4.0);
+        REQUIRE(x.data[0]==2.0);
+        REQUIRE(x.data[3]==6.0);
+
+        mat_destroy(&x);
+        mat_destroy(&y);
+    }
+
+    SECTION("Rows with missing fields are rejected.")
+    {
+        write_file(path, "1,2,3\n4,5\n");
+        REQUIRE(!csv_load(path, &options, &x, &y, NULL));
+        REQUIRE(x.data==NULL);
+    }
+
+    SECTION("Parsing on several threads.")
+    {
+        size_t n_rows = 60000;
+        int fd = mkstemp(path);
+        FILE* file = fdopen(fd, "w");
+
+        fprintf(file, "x1,x2,x3,y\n");
+        for (size_t i=0; i<n_rows; i++)
+            fprintf(file, "%zu,%.6f,-%zu.25,%zu\n", i, i*0.001, i%97, 2*i);
+        fclose(file);
+
+        options.n_threads = 4;
+        REQUIRE(csv_load(path, &options, &x, &y, &stats));
+        REQUIRE(stats.bytes>(1 << 20));
+        REQUIRE(x.nrows==n_rows);
+        for (size_t i=0; i<n_rows; i++)
+        {
+            REQUIRE(x.data[i*3]==(double)i);
+            REQUIRE(x.data[i*3+2]==-((double)(i%97)+0.25));
+            REQUIRE(y.data[i]==2.0*i);
+        }
+
+        mat_destroy(&x);
+        mat_destroy(&y);
+    }
+
+    remove(path);
+}
@@ -0,0 +1,138 @@
+// Tests for module dataset.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <catch2/catch_all.hpp>
+#include "../src/matrix.h"
+#include "../src/stats.h"
+#include "../src/dataset.h"
+
+TEST_CASE("Binary dataset files.", "[dataset]")
+{
+    unsigned int seed = 5150;
+    char path[] = "/tmp/test_dataset_XXXXXX";
+    int fd = mkstemp(path);
+    Matrix x = mat_create(37, 5);
+    Matrix y = mat_create(37, 1);
+    Dataset dataset;
+
+    mat_fill_random(&x, seed);
+    mat_scale(&x, 20.0);
+    mat_fill_random(&y, seed+1);
+    mat_add_scalar(&y, -4.0);
+    REQUIRE(fd>=0);
+
+    SECTION("Double precision round trip.")
+    {
+        REQUIRE(dataset_save(path, &x, &y, DATASET_F64));
+        REQUIRE(dataset_open(&dataset, path));
+
+        REQUIRE(dataset.dtype==DATASET_F64);
+        REQUIRE(dataset.n_samples==37);
+        REQUIRE(dataset.n_features==5);
+        REQUIRE(!dataset.x.owner);
+        REQUIRE(((size_t)dataset.x.data % DATASET_ALIGN)==0);
+        for (size_t i=0; i<x.nrows*x.ncols; i++)
+            REQUIRE(dataset.x.data[i]==x.data[i]);
+        for (size_t i=0; i<y.nrows; i++)
+            REQUIRE(dataset.y.data[i]==y.data[i]);
+        dataset_close(&dataset);
+    }
+
+    SECTION("Single precision round trip.")
+    {
+        REQUIRE(dataset_save(path, &x, &y, DATASET_F32));
+        REQUIRE(dataset_open(&dataset, path));
+
+        REQUIRE(dataset.dtype==DATASET_F32);
+        REQUIRE(dataset.x.data==NULL);
+        for (size_t i=0; i<x.nrows*x.ncols; i++)
+            REQUIRE(dataset.x_f.data[i]==(float)x.data[i]);
+        for (size_t i=0; i<y.nrows; i++)
+            REQUIRE(dataset.y_f.data[i]==(float)y.data[i]);
+        dataset_close(&dataset);
+    }
+
+    SECTION("Streaming writer and stored statistics.")
+    {
+        DatasetWriter writer;
+        Matrix first = mat_view(&x, 0, 0, 20, 5);
+        Matrix second = mat_view(&x, 20, 0, 17, 5);
+        Matrix y_first = mat_view(&y, 0, 0, 20, 1);
+        Matrix y_second = mat_view(&y, 20, 0, 17, 1);
+        Matrix means = stats_mean(&x, 0);
+        Matrix y_mean = stats_mean(&y, 0);
+
+        REQUIRE(dataset_writer_open(&writer, path, 5, DATASET_F64));
+        REQUIRE(dataset_writer_append(&writer, &first, &y_first));
+        REQUIRE(dataset_writer_append(&writer, &second, &y_second));
+        REQUIRE(dataset_writer_close(&writer));
+        REQUIRE(dataset_open(&dataset, path));
+
+        REQUIRE(dataset.n_samples==37);
+        for (size_t i=0; i<x.nrows*x.ncols; i++)
+            REQUIRE(dataset.x.data[i]==x.data[i]);
+        for (size_t j=0; j<5; j++)
+        {
+            double var = 0.0;
+            for (size_t i=0; i<x.nrows; i++)
+                var += (x.data[i*5+j]-means.data[j])*(x.data[i*5+j]-means.data[j]);
+            REQUIRE(dataset.feature_means.data[j]==Catch::Approx(means.data[j]));
+            REQUIRE(dataset.feature_stds.data[j]==Catch::Approx(sqrt(var/37.0)));
+        }
+        REQUIRE(dataset.y_mean==Catch::Approx(y_mean.data[0]));
+
+        dataset_close(&dataset);
+        mat_destroy(&means);
+        mat_destroy(&y_mean);
+    }
+
+    SECTION("Files that are not datasets are rejected.")
+    {
+        FILE* file = fopen(path, "wb");
+        fprintf(file, "x1,x2,y\n1.0,2.0,3.0\n");
+        fclose(file);
+
+        REQUIRE(!dataset_open(&dataset, path));
+        REQUIRE(dataset.map==NULL);
+    }
+
+    SECTION("Headers whose sizes wrap around are rejected.")
+    {
+        DatasetHeader header;
+        FILE* file;
+
+        REQUIRE(dataset_save(path, &x, &y, DATASET_F64));
+        file = fopen(path, "r+b");
+        REQUIRE(fread(&header, sizeof(DatasetHeader), 1, file)==1);
+
+        // 2^61 samples of 5 doubles wrap X and y to zero bytes
+        header.n_samples = (uint64_t)1<<61;
+        header.y_offset = header.x_offset;
+        REQUIRE(!dataset_header_valid(&header, 1<<20));
+
+        // Offsets close to the top of the address space
+        header.n_samples = 37;
+        header.y_offset = UINT64_MAX - 8;
+        REQUIRE(!dataset_header_valid(&header, 1<<20));
+        header.n_features = UINT64_MAX/2;
+        REQUIRE(!dataset_header_valid(&header, 1<<20));
+
+        // Same header as the first case on disk
+        header.n_samples = (uint64_t)1<<61;
+        header.n_features = 5;
+        header.y_offset = header.x_offset;
+        fseek(file, 0, SEEK_SET);
+        REQUIRE(fwrite(&header, sizeof(DatasetHeader), 1, file)==1);
+        fclose(file);
+        REQUIRE(!dataset_open(&dataset, path));
+        REQUIRE(dataset.map==NULL);
+    }
+
+    close(fd);
+    remove(path);
+    mat_destroy(&x);
+    mat_destroy(&y);
+}
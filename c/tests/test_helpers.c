@@ -1,5 +1,10 @@
 // Tests for module helpers.h
+#include <stdio.h>
+#include <unistd.h>
 #include "../src/matrix.h"
+#include "../src/random.h"
+#include "../src/dataset.h"
+#include "../src/sgd.h"
 #include "../src/helpers.h"
 #include <catch2/catch_all.hpp>
 
@@ -16,6 +21,67 @@ TEST_CASE("Helpers for linear regression.", "[helpers]")
         make_regression_dataset(&x, &y, 1.0, 0.0, seed);
     }
 
+    SECTION("Noise-free datasets are exactly linear.")
+    {
+        SGDResult result;
+        RandomStream rng;
+
+        make_regression_dataset(&x, &y, -3.5, 0.0, seed);
+        for (size_t j=0; j<n_features; j++)
+            REQUIRE(x.data[j]!=x.data[n_features+j]);
+        result = normal_equation_solve(&x, &y, 0.0);
+        REQUIRE(result.converged);
+        REQUIRE(result.bias==Catch::Approx(-3.5).margin(1e-8));
+
+        // The model is drawn from stream 0 as (mean, std, coeff) triples
+        random_init(&rng, seed, 0);
+        for (size_t j=0; j<n_features; j++)
+        {
+            random_uniform(&rng);
+            random_uniform(&rng);
+            double coeff = 50.0*random_uniform(&rng) - 25.0;
+            REQUIRE(result.theta_sol.data[j]==Catch::Approx(coeff).margin(1e-8));
+        }
+        destroy_sgdresult(&result);
+    }
+
+    SECTION("Rows do not depend on the size of the dataset.")
+    {
+        Matrix x_large = mat_create(3*n_samples, n_features);
+        Matrix y_large = mat_create(3*n_samples, 1);
+
+        make_regression_dataset(&x, &y, 1.0, 2.0, seed);
+        make_regression_dataset(&x_large, &y_large, 1.0, 2.0, seed);
+        for (size_t i=0; i<n_samples*n_features; i++)
+            REQUIRE(x.data[i]==x_large.data[i]);
+        for (size_t i=0; i<n_samples; i++)
+            REQUIRE(y.data[i]==y_large.data[i]);
+        mat_destroy(&x_large);
+        mat_destroy(&y_large);
+    }
+
+    SECTION("Writing datasets to files.")
+    {
+        char path[] = "/tmp/test_helpers_XXXXXX";
+        int fd = mkstemp(path);
+        Dataset dataset;
+
+        make_regression_dataset(&x, &y, 1.0, 2.0, seed);
+        REQUIRE(fd>=0);
+        REQUIRE(make_regression_file(path, n_samples, n_features,
+                                     1.0, 2.0, seed, DATASET_F64));
+        REQUIRE(dataset_open(&dataset, path));
+        REQUIRE(dataset.n_samples==n_samples);
+        REQUIRE(dataset.n_features==n_features);
+        for (size_t i=0; i<n_samples*n_features; i++)
+            REQUIRE(dataset.x.data[i]==x.data[i]);
+        for (size_t i=0; i<n_samples; i++)
+            REQUIRE(dataset.y.data[i]==y.data[i]);
+        dataset_close(&dataset);
+        unlink(path);
+        close(fd);
+    }
+
     mat_destroy(&x);
     mat_destroy(&y);
 }
@@ -61,13 +61,125 @@ TEST_CASE("L2 loss.", "[losses]")
         for (size_t i=0; i<grad_expect.nrows; i++)
             for (size_t j=0; j<grad_expect.ncols; j++)
                 REQUIRE(grad.data[i*grad_expect.ncols+j]==\
-                        grad_expect.data[i*grad_expect.ncols+j]);
+                        Catch::Approx(grad_expect.data[i*grad_expect.ncols+j])\
+                        .epsilon(1e-12));
         
         mat_destroy(&x_theta_prod);
         mat_destroy(&grad_expect);
         mat_destroy(&grad);
     }
 
+    SECTION("Fused L2 loss and gradient must match the separate functions.")
+    {
+        Matrix residual = mat_create(20, 1);
+        Matrix grad = mat_create(10, 1);
+        Matrix y_pred = mat_mul(&x, false, &theta, false);
+        Matrix grad_expect = l2_gradient(&x, &y, &theta);
+
+        double loss = l2_loss_gradient(&x, &y, &theta, &residual, &grad);
+
+        REQUIRE(loss==Catch::Approx(l2_loss(&y, &y_pred)));
+        for (size_t i=0; i<grad.nrows; i++)
+            REQUIRE(grad.data[i]==Catch::Approx(grad_expect.data[i]));
+
+        mat_destroy(&residual);
+        mat_destroy(&grad);
+        mat_destroy(&y_pred);
+        mat_destroy(&grad_expect);
+    }
+
+    SECTION("Implicit centering matches explicitly centered data.")
+    {
+        Matrix x_mean = mat_create(1, 10);
+        Matrix x_centered = mat_copy(&x);
+        Matrix y_centered = mat_copy(&y);
+        Matrix residual = mat_create(20, 1);
+        Matrix grad = mat_create(10, 1);
+        Matrix grad_expect = mat_create(10, 1);
+        Matrix y_pred;
+        Centering centering;
+        double y_mean = 0.0;
+
+        for (size_t i=0; i<20; i++)
+        {
+            for (size_t j=0; j<10; j++)
+                x_mean.data[j] += x.data[i*10+j] / 20.0;
+            y_mean += y.data[i] / 20.0;
+        }
+        centering.x_mean = &x_mean;
+        centering.y_mean = y_mean;
+        mat_vec_sub(&x_centered, &x_mean);
+        mat_add_scalar(&y_centered, -y_mean);
+
+        double loss = l2_loss_gradient_centered(&x, &y, &centering, &theta,
+                                                &residual, &grad);
+        double loss_expect = l2_loss_gradient(&x_centered, &y_centered, &theta,
+                                              &residual, &grad_expect);
+        REQUIRE(loss==Catch::Approx(loss_expect));
+        for (size_t j=0; j<10; j++)
+            REQUIRE(grad.data[j]==Catch::Approx(grad_expect.data[j]));
+
+        // Shifted uncentered predictions give the centered residuals
+        y_pred = mat_mul(&x, false, &theta, false);
+        mat_add_scalar(&y_pred, centering_offset(&centering, &theta));
+        REQUIRE(l2_loss(&y, &y_pred)==Catch::Approx(loss_expect));
+
+        mat_destroy(&x_mean);
+        mat_destroy(&x_centered);
+        mat_destroy(&y_centered);
+        mat_destroy(&residual);
+        mat_destroy(&grad);
+        mat_destroy(&grad_expect);
+        mat_destroy(&y_pred);
+    }
+
+    SECTION("L2 callbacks must agree with each other.")
+    {
+        MatArena workspace = mat_arena_create(0);
+        LossFunctions l2 = l2_loss_functions();
+        Matrix grad_fused = mat_create(10, 1);
+        Matrix grad = mat_create(10, 1);
+        Matrix y_pred = mat_mul(&x, false, &theta, false);
+
+        double loss = l2.loss_grad_fn(&x, &y, NULL, &theta, &grad_fused,
+                                      &workspace, l2.ctx);
+        mat_arena_reset(&workspace);
+        l2.grad_fn(&x, &y, NULL, &theta, &grad, &workspace, l2.ctx);
+
+        REQUIRE(loss==Catch::Approx(l2.loss_fn(&y, &y_pred, &workspace, l2.ctx)));
+        for (size_t i=0; i<grad.nrows; i++)
+            REQUIRE(grad.data[i]==grad_fused.data[i]);
+
+        mat_destroy(&grad_fused);
+        mat_destroy(&grad);
+        mat_destroy(&y_pred);
+        mat_arena_destroy(&workspace);
+    }
+
+    SECTION("Single precision loss and gradient match double precision.")
+    {
+        FMatrix x_f = fmat_from_mat(&x);
+        FMatrix y_f = fmat_from_mat(&y);
+        FMatrix theta_f = fmat_from_mat(&theta);
+        FMatrix y_pred_f = fmat_mul(&x_f, false, &theta_f, false);
+        Matrix y_pred = mat_mul(&x, false, &theta, false);
+        Matrix grad = l2_gradient(&x, &y, &theta);
+        FMatrix grad_f = l2_gradient_float(&x_f, &y_f, &theta_f);
+
+        REQUIRE(l2_loss_float(&y_f, &y_pred_f)==\
+                Catch::Approx(l2_loss(&y, &y_pred)).epsilon(1e-4));
+        for (size_t i=0; i<grad.nrows; i++)
+            REQUIRE(grad_f.data[i]==Catch::Approx(grad.data[i]).epsilon(1e-4));
+
+        fmat_destroy(&x_f);
+        fmat_destroy(&y_f);
+        fmat_destroy(&theta_f);
+        fmat_destroy(&y_pred_f);
+        fmat_destroy(&grad_f);
+        mat_destroy(&y_pred);
+        mat_destroy(&grad);
+    }
+
     mat_destroy(&x);
     mat_destroy(&y);
     mat_destroy(&theta);
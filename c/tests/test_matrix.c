@@ -1,6 +1,7 @@
 // Tests for module matrix.h
 
 #include <stdbool.h>
+#include <limits.h>
 #include <catch2/catch_all.hpp>
 #include "../src/matrix.h"
 
@@ -214,6 +215,90 @@ TEST_CASE("Double matrix operations.", "[matrix]")
     mat_destroy(&mymat3);
 }
 
+TEST_CASE("Broadcast operations.", "[matrix]")
+{
+    // A strided view, so rows are not contiguous
+    Matrix parent = mat_create(6, 9);
+    Matrix mat = mat_view(&parent, 1, 2, 4, 5);
+    Matrix before, untouched;
+    Matrix same = mat_create(4, 5);
+    Matrix row = mat_create(1, 5);
+    Matrix col_parent = mat_create(4, 3);
+    Matrix col = mat_view(&col_parent, 0, 1, 4, 1);
+    Matrix scalar = mat_create(1, 1);
+    Matrix wrong = mat_create(3, 1);
+
+    mat_fill_random(&parent, 1);
+    mat_fill_random(&same, 2);
+    mat_fill_random(&row, 3);
+    mat_fill_random(&col_parent, 4);
+    scalar.data[0] = 1.5;
+    before = mat_copy(&mat);
+    untouched = mat_copy(&parent);
+
+    SECTION("axpby.")
+    {
+        REQUIRE(mat_axpby(&mat, 2.0, &same, -0.5));
+        for (size_t i=0; i<4; i++)
+            for (size_t j=0; j<5; j++)
+                REQUIRE(mat.data[i*mat.stride+j]==Catch::Approx(
+                        2.0*same.data[i*5+j] - 0.5*before.data[i*5+j]));
+
+        mat_copy_inplace(&before, &mat);
+        REQUIRE(mat_axpby(&mat, -1.0, &row, 1.0));
+        for (size_t i=0; i<4; i++)
+            for (size_t j=0; j<5; j++)
+                REQUIRE(mat.data[i*mat.stride+j]==before.data[i*5+j] - row.data[j]);
+
+        mat_copy_inplace(&before, &mat);
+        REQUIRE(mat_axpby(&mat, 3.0, &col, 2.0));
+        for (size_t i=0; i<4; i++)
+            for (size_t j=0; j<5; j++)
+                REQUIRE(mat.data[i*mat.stride+j]==Catch::Approx(
+                        3.0*col.data[i*col.stride] + 2.0*before.data[i*5+j]));
+
+        mat_copy_inplace(&before, &mat);
+        REQUIRE(mat_axpby(&mat, 1.0, &scalar, 1.0));
+        for (size_t i=0; i<4; i++)
+            for (size_t j=0; j<5; j++)
+                REQUIRE(mat.data[i*mat.stride+j]==before.data[i*5+j] + 1.5);
+
+        REQUIRE(!mat_axpby(&mat, 1.0, &wrong, 1.0));
+    }
+
+    SECTION("Elementwise products and scalar operations.")
+    {
+        REQUIRE(mat_elem_mul(&mat, &row));
+        REQUIRE(mat_elem_mul(&mat, &col));
+        for (size_t i=0; i<4; i++)
+            for (size_t j=0; j<5; j++)
+                REQUIRE(mat.data[i*mat.stride+j]==Catch::Approx(
+                        before.data[i*5+j] * row.data[j] * col.data[i*col.stride]));
+        REQUIRE(!mat_elem_mul(&mat, &wrong));
+
+        mat_copy_inplace(&before, &mat);
+        mat_scale_shift(&mat, -2.0, 0.25);
+        for (size_t i=0; i<4; i++)
+            for (size_t j=0; j<5; j++)
+                REQUIRE(mat.data[i*mat.stride+j]==-2.0*before.data[i*5+j] + 0.25);
+    }
+
+    // Elements outside the view are left alone
+    for (size_t i=0; i<6; i++)
+        for (size_t j=0; j<9; j++)
+            if (i<1 || i>=5 || j<2 || j>=7)
+                REQUIRE(parent.data[i*9+j]==untouched.data[i*9+j]);
+
+    mat_destroy(&parent);
+    mat_destroy(&before);
+    mat_destroy(&untouched);
+    mat_destroy(&same);
+    mat_destroy(&row);
+    mat_destroy(&col_parent);
+    mat_destroy(&scalar);
+    mat_destroy(&wrong);
+}
+
 TEST_CASE("Integer matrix operations.", "[matrix]")
 {
     unsigned int seed = 3224;
@@ -234,6 +319,21 @@ TEST_CASE("Integer matrix operations.", "[matrix]")
         REQUIRE(mymat.data==NULL);
     }
 
+     SECTION("Random integers over the full int range.")
+     {
+         bool negative = false, positive = false;
+
+         // high - low does not fit in an int
+         intmat_fill_random(&mymat, INT_MIN, INT_MAX, true, seed);
+         for (size_t i=0; i<mymat.nrows*mymat.ncols; i++)
+         {
+             REQUIRE(mymat.data[i]<INT_MAX);
+             negative = negative || mymat.data[i]<0;
+             positive = positive || mymat.data[i]>0;
+         }
+         REQUIRE((negative && positive));
+     }
+
      SECTION("Copying a matrix.")
      {
          intmat_fill_random(&mymat, 0, 10, true, seed);
@@ -423,3 +523,528 @@ TEST_CASE("Integer matrix operations.", "[matrix]")
     intmat_destroy(&mymat2);
     intmat_destroy(&mymat3);
 }
+
+TEST_CASE("Blocked integer matrix multiplication.", "[matrix]")
+{
+    // Shapes crossing the block sizes of igemm in every dimension
+    size_t shapes[][3] = {{100, 37, 300}, {7, 4100, 5}, {1, 1, 1}, {13, 16, 0}};
+    int betas[] = {0, 1, -2};
+    IGemmKernel kernels[] = {IGEMM_GENERIC, IGEMM_AVX2, IGEMM_AVX512};
+
+    for (int s=0; s<4; s++)
+    {
+        size_t m = shapes[s][0], n = shapes[s][1], k = shapes[s][2];
+        IntMatrix a = intmat_create(m*(k>0? k: 1), 1);
+        IntMatrix b = intmat_create((k>0? k: 1)*n, 1);
+        IntMatrix c0 = intmat_create(m*n, 1);
+        IntMatrix c = intmat_create(m*n, 1);
+        IntMatrix expected = intmat_create(m*n, 1);
+
+        intmat_fill_random(&a, -50, 50, true, 1);
+        intmat_fill_random(&b, -50, 50, true, 2);
+        intmat_fill_random(&c0, -50, 50, true, 3);
+
+        for (int t=0; t<4; t++)
+        {
+            bool trans_a = t&1, trans_b = t&2;
+            size_t lda = trans_a? m: k, ldb = trans_b? k: n;
+
+            for (int bi=0; bi<3; bi++)
+            {
+                // Reference, C = 3 op(A) op(B) + beta C
+                for (size_t i=0; i<m; i++)
+                    for (size_t j=0; j<n; j++)
+                    {
+                        int sum = 0;
+                        for (size_t l=0; l<k; l++)
+                            sum += (trans_a? a.data[l*lda+i]: a.data[i*lda+l])
+                                   * (trans_b? b.data[j*ldb+l]: b.data[l*ldb+j]);
+                        expected.data[i*n+j] = 3*sum + betas[bi]*c0.data[i*n+j];
+                    }
+
+                for (int kn=0; kn<3; kn++)
+                {
+                    igemm_set_kernel(kernels[kn]);
+                    intmat_copy_inplace(&c0, &c);
+                    igemm(trans_a? CblasTrans: CblasNoTrans,
+                          trans_b? CblasTrans: CblasNoTrans,
+                          m, n, k, 3, a.data, lda > 1? lda: 1,
+                          b.data, ldb > 1? ldb: 1, betas[bi], c.data, n);
+                    for (size_t i=0; i<m*n; i++)
+                        REQUIRE(c.data[i]==expected.data[i]);
+                }
+            }
+        }
+
+        intmat_destroy(&a);
+        intmat_destroy(&b);
+        intmat_destroy(&c0);
+        intmat_destroy(&c);
+        intmat_destroy(&expected);
+    }
+
+    SECTION("Kernel selection falls back to supported kernels.")
+    {
+        IGemmKernel best = igemm_set_kernel(IGEMM_AUTO);
+
+        REQUIRE(best!=IGEMM_AUTO);
+        REQUIRE(igemm_set_kernel(IGEMM_GENERIC)==IGEMM_GENERIC);
+        REQUIRE(igemm_set_kernel(IGEMM_AVX512)<=best);
+        igemm_set_kernel(IGEMM_AUTO);
+    }
+
+    SECTION("Large products with transposed operands.")
+    {
+        // A is stored k x m and B is stored n x k
+        IntMatrix a = intmat_create(1100, 1000);
+        IntMatrix b = intmat_create(1000, 1100);
+        IntMatrix c;
+
+        intmat_fill_random(&a, -3, 4, true, 5);
+        intmat_fill_random(&b, -3, 4, true, 6);
+        c = intmat_mul(&a, true, &b, true);
+        REQUIRE(c.nrows==1000);
+        REQUIRE(c.ncols==1000);
+
+        // Spot checks against the definition
+        for (size_t i=0; i<1000; i+=111)
+            for (size_t j=0; j<1000; j+=97)
+            {
+                int sum = 0;
+                for (size_t l=0; l<1100; l++)
+                    sum += a.data[l*1000+i] * b.data[j*1100+l];
+                REQUIRE(c.data[i*1000+j]==sum);
+            }
+
+        intmat_destroy(&a);
+        intmat_destroy(&b);
+        intmat_destroy(&c);
+    }
+}
+
+TEST_CASE("Matrix arena.", "[matrix]")
+{
+    MatArena arena = mat_arena_create(64);
+
+    SECTION("Drawing matrices from an arena.")
+    {
+        Matrix a = mat_arena_alloc(&arena, 4, 5);
+        Matrix b = mat_arena_alloc(&arena, 2, 3);
+
+        REQUIRE(a.nrows==4);
+        REQUIRE(a.ncols==5);
+        REQUIRE(!a.owner);
+        REQUIRE(b.data!=a.data);
+        for (size_t i=0; i<b.nrows*b.ncols; i++)
+            REQUIRE(b.data[i]==0.0);
+    }
+
+    SECTION("Resetting an arena reuses its memory.")
+    {
+        Matrix a = mat_arena_alloc(&arena, 4, 5);
+        double* first = a.data;
+
+        mat_arena_reset(&arena);
+        a = mat_arena_alloc(&arena, 4, 5);
+        REQUIRE(a.data==first);
+    }
+
+    SECTION("Arena grows to the high water mark after overflowing.")
+    {
+        Matrix a = mat_arena_alloc(&arena, 10, 10);
+        Matrix b = mat_arena_alloc(&arena, 10, 10);
+
+        REQUIRE(arena.overflow!=NULL);
+        mat_fill(&a, 1.0);
+        mat_fill(&b, 2.0);
+
+        mat_arena_reset(&arena);
+        REQUIRE(arena.overflow==NULL);
+        REQUIRE(arena.capacity>=200);
+
+        a = mat_arena_alloc(&arena, 10, 10);
+        b = mat_arena_alloc(&arena, 10, 10);
+        REQUIRE(arena.overflow==NULL);
+    }
+
+    SECTION("Bound arena serves mat_create.")
+    {
+        MatArena* previous = mat_arena_bind(&arena);
+        Matrix a = mat_create(3, 3);
+        Matrix b = mat_copy(&a);
+        mat_arena_bind(previous);
+
+        REQUIRE(a.data==arena.data);
+        REQUIRE(!b.owner);
+
+        // Destroying arena matrices leaves the arena intact
+        mat_destroy(&a);
+        mat_destroy(&b);
+        REQUIRE(a.data==NULL);
+
+        Matrix c = mat_create(3, 3);
+        REQUIRE(c.owner);
+        mat_destroy(&c);
+    }
+
+    mat_arena_destroy(&arena);
+}
+
+TEST_CASE("Cholesky factorization.", "[matrix]")
+{
+    unsigned int seed = 3224;
+    Matrix a = mat_create(6, 6);
+    Matrix spd = mat_create(6, 6);
+    Matrix x = mat_create(6, 1);
+    Matrix b;
+
+    // spd = A^T A + I is symmetric positive definite
+    mat_fill_random(&a, seed);
+    mat_mul_inplace(&a, true, &a, false, &spd);
+    for (size_t i=0; i<spd.nrows; i++)
+        spd.data[i*spd.ncols+i] += 1.0;
+    mat_fill_random(&x, seed+1);
+    b = mat_mul(&spd, false, &x, false);
+
+    SECTION("Solving a positive definite system.")
+    {
+        Matrix factor = mat_copy(&spd);
+
+        REQUIRE(mat_cholesky(&factor));
+        mat_cholesky_solve(&factor, &b);
+        for (size_t i=0; i<x.nrows; i++)
+            REQUIRE(b.data[i]==Catch::Approx(x.data[i]));
+
+        mat_destroy(&factor);
+    }
+
+    SECTION("Rejecting an indefinite matrix.")
+    {
+        spd.data[0] = -1.0;
+        REQUIRE(!mat_cholesky(&spd));
+    }
+
+    mat_destroy(&a);
+    mat_destroy(&spd);
+    mat_destroy(&x);
+    mat_destroy(&b);
+}
+
+TEST_CASE("Matrix views.", "[matrix]")
+{
+    unsigned int seed = 3224;
+    Matrix mymat = mat_create(10, 20);
+    mat_fill_random(&mymat, seed);
+
+    SECTION("Creating a view.")
+    {
+        Matrix view = mat_view(&mymat, 2, 3, 4, 5);
+
+        REQUIRE(view.nrows==4);
+        REQUIRE(view.ncols==5);
+        REQUIRE(view.stride==20);
+        REQUIRE(!view.owner);
+        REQUIRE(!mat_is_contiguous(&view));
+        for (size_t i=0; i<view.nrows; i++)
+            for (size_t j=0; j<view.ncols; j++)
+                REQUIRE(view.data[i*view.stride+j]==\
+                        mymat.data[(i+2)*mymat.ncols+j+3]);
+    }
+
+    SECTION("Views of whole rows are contiguous.")
+    {
+        Matrix view = mat_view(&mymat, 4, 0, 3, 20);
+        REQUIRE(mat_is_contiguous(&view));
+    }
+
+    SECTION("Views out of bounds are rejected.")
+    {
+        Matrix view = mat_view(&mymat, 8, 0, 3, 20);
+        REQUIRE(view.data==NULL);
+    }
+
+    SECTION("Writing through a view.")
+    {
+        Matrix view = mat_view(&mymat, 1, 1, 2, 2);
+        mat_fill(&view, -1.0);
+        mat_scale(&view, 3.0);
+
+        REQUIRE(mymat.data[1*20+1]==-3.0);
+        REQUIRE(mymat.data[2*20+2]==-3.0);
+        REQUIRE(mymat.data[3*20+3]!=-3.0);
+
+        // Destroying a view leaves the matrix intact
+        mat_destroy(&view);
+        REQUIRE(mymat.data!=NULL);
+    }
+
+    SECTION("Copying and adding views.")
+    {
+        Matrix view = mat_view(&mymat, 3, 5, 4, 6);
+        Matrix copy = mat_copy(&view);
+
+        REQUIRE(mat_is_contiguous(&copy));
+        mat_add(&copy, &view);
+        for (size_t i=0; i<copy.nrows; i++)
+            for (size_t j=0; j<copy.ncols; j++)
+                REQUIRE(copy.data[i*copy.ncols+j]==\
+                        2.0*view.data[i*view.stride+j]);
+        REQUIRE(mat_norm(&copy)==Catch::Approx(2.0*mat_norm(&view)));
+
+        mat_destroy(&copy);
+    }
+
+    SECTION("Multiplying views.")
+    {
+        Matrix a = mat_view(&mymat, 0, 0, 5, 4);
+        Matrix b = mat_view(&mymat, 5, 10, 4, 3);
+        Matrix a_copy = mat_copy(&a);
+        Matrix b_copy = mat_copy(&b);
+        Matrix result = mat_mul(&a, false, &b, false);
+        Matrix expect = mat_mul(&a_copy, false, &b_copy, false);
+        Matrix result_t = mat_create(4, 4);
+        Matrix expect_t = mat_mul(&a_copy, true, &a_copy, false);
+
+        mat_mul_inplace(&a, true, &a, false, &result_t);
+
+        for (size_t i=0; i<expect.nrows*expect.ncols; i++)
+            REQUIRE(result.data[i]==Catch::Approx(expect.data[i]));
+        for (size_t i=0; i<expect_t.nrows*expect_t.ncols; i++)
+            REQUIRE(result_t.data[i]==Catch::Approx(expect_t.data[i]));
+
+        mat_destroy(&a_copy);
+        mat_destroy(&b_copy);
+        mat_destroy(&result);
+        mat_destroy(&expect);
+        mat_destroy(&result_t);
+        mat_destroy(&expect_t);
+    }
+
+    mat_destroy(&mymat);
+}
+
+TEST_CASE("Gathering rows.", "[matrix]")
+{
+    unsigned int seed = 3224;
+    Matrix from = mat_create(50, 7);
+    IntMatrix idxs = intmat_create(30, 1);
+    Matrix to = mat_create(30, 7);
+
+    mat_fill_random(&from, seed);
+    intmat_fill_random(&idxs, 0, 50, true, seed);
+
+    SECTION("Gathering rows on one thread.")
+    {
+        mat_gather_rows(&from, &to, &idxs, 1);
+        for (size_t i=0; i<to.nrows; i++)
+            for (size_t j=0; j<to.ncols; j++)
+                REQUIRE(to.data[i*to.ncols+j]==\
+                        from.data[idxs.data[i]*from.ncols+j]);
+    }
+
+    SECTION("Gathering rows on several threads.")
+    {
+        Matrix big = mat_create(5000, 300);
+        IntMatrix big_idxs = intmat_create(4000, 1);
+        Matrix big_to = mat_create(4000, 300);
+
+        mat_fill_random(&big, seed);
+        intmat_fill_random(&big_idxs, 0, 5000, false, seed);
+        mat_gather_rows(&big, &big_to, &big_idxs, 4);
+        for (size_t i=0; i<big_to.nrows; i++)
+            for (size_t j=0; j<big_to.ncols; j+=37)
+                REQUIRE(big_to.data[i*big_to.ncols+j]==\
+                        big.data[big_idxs.data[i]*big.ncols+j]);
+
+        mat_destroy(&big);
+        mat_destroy(&big_to);
+        intmat_destroy(&big_idxs);
+    }
+
+    SECTION("Gathering rows from a view.")
+    {
+        Matrix view = mat_view(&from, 0, 2, 50, 4);
+        Matrix to_view = mat_create(30, 4);
+
+        mat_gather(&view, &to_view, &idxs, 0);
+        for (size_t i=0; i<to_view.nrows; i++)
+            for (size_t j=0; j<to_view.ncols; j++)
+                REQUIRE(to_view.data[i*to_view.ncols+j]==\
+                        from.data[idxs.data[i]*from.ncols+j+2]);
+
+        mat_destroy(&to_view);
+    }
+
+    SECTION("Gathering integer rows.")
+    {
+        IntMatrix int_from = intmat_create(50, 3);
+        IntMatrix int_to = intmat_create(30, 3);
+
+        intmat_fill_random(&int_from, -100, 100, true, seed);
+        intmat_gather(&int_from, &int_to, &idxs, 0);
+        for (size_t i=0; i<int_to.nrows; i++)
+            for (size_t j=0; j<int_to.ncols; j++)
+                REQUIRE(int_to.data[i*int_to.ncols+j]==\
+                        int_from.data[idxs.data[i]*int_from.ncols+j]);
+
+        intmat_destroy(&int_from);
+        intmat_destroy(&int_to);
+    }
+
+    SECTION("Gathering columns.")
+    {
+        IntMatrix cols = intmat_create(1, 3);
+        IntMatrix per_row = intmat_create(50, 1);
+        Matrix to_cols = mat_create(50, 3);
+        Matrix to_per_row = mat_create(50, 1);
+
+        cols.data[0] = 6;
+        cols.data[1] = 0;
+        cols.data[2] = 6;
+        intmat_fill_random(&per_row, 0, 7, true, seed);
+        mat_gather(&from, &to_cols, &cols, 1);
+        mat_gather(&from, &to_per_row, &per_row, 1);
+        for (size_t i=0; i<from.nrows; i++)
+        {
+            for (size_t j=0; j<3; j++)
+                REQUIRE(to_cols.data[i*3+j]==from.data[i*7+cols.data[j]]);
+            REQUIRE(to_per_row.data[i]==from.data[i*7+per_row.data[i]]);
+        }
+
+        intmat_destroy(&cols);
+        intmat_destroy(&per_row);
+        mat_destroy(&to_cols);
+        mat_destroy(&to_per_row);
+    }
+
+    mat_destroy(&from);
+    mat_destroy(&to);
+    intmat_destroy(&idxs);
+}
+
+TEST_CASE("64-bit dimensions.", "[matrix]")
+{
+    SECTION("Dimensions and element counts are size_t.")
+    {
+        Matrix mymat = mat_create(3, 4);
+
+        REQUIRE(sizeof(mymat.nrows)==sizeof(size_t));
+        REQUIRE(sizeof(mymat.stride)==sizeof(size_t));
+        mat_destroy(&mymat);
+    }
+
+    SECTION("Empty matrices are rejected.")
+    {
+        Matrix empty = mat_create(0, 4);
+        REQUIRE(empty.data==NULL);
+    }
+
+    SECTION("BLAS wrappers agree with plain loops.")
+    {
+        Matrix a = mat_create(40, 3);
+        Matrix x = mat_create(40, 1);
+        Matrix y = mat_create(3, 1);
+        double dot = 0.0;
+
+        mat_fill_random(&a, 17);
+        mat_fill_random(&x, 18);
+        dgemv_64(CblasTrans, 40, 3, 1.0, a.data, 3, x.data, 1,
+                 0.0, y.data, 1);
+        for (size_t j=0; j<3; j++)
+        {
+            double expected = 0.0;
+            for (size_t i=0; i<40; i++)
+                expected += a.data[i*3+j] * x.data[i];
+            REQUIRE(y.data[j]==Catch::Approx(expected));
+        }
+        for (size_t i=0; i<40; i++)
+            dot += x.data[i] * x.data[i];
+        REQUIRE(ddot_64(40, x.data, 1, x.data, 1)==Catch::Approx(dot));
+
+        mat_destroy(&a);
+        mat_destroy(&x);
+        mat_destroy(&y);
+    }
+}
+
+TEST_CASE("Single precision matrix operations.", "[matrix]")
+{
+    unsigned int seed = 4711;
+    Matrix mymat = mat_create(12, 7);
+    mat_fill_random(&mymat, seed);
+    FMatrix fmat = fmat_from_mat(&mymat);
+
+    SECTION("Converting between precisions.")
+    {
+        Matrix back = mat_from_fmat(&fmat);
+
+        REQUIRE(fmat.stride==7);
+        REQUIRE(fmat.owner);
+        for (size_t i=0; i<mymat.nrows*mymat.ncols; i++)
+            REQUIRE(back.data[i]==Catch::Approx(mymat.data[i]).epsilon(1e-6));
+        mat_destroy(&back);
+    }
+
+    SECTION("Filling and scaling.")
+    {
+        FMatrix view = fmat_view(&fmat, 2, 1, 3, 4);
+
+        fmat_fill(&view, 2.0f);
+        fmat_scale(&view, -1.5f);
+        REQUIRE(fmat.data[2*7+1]==-3.0f);
+        REQUIRE(fmat.data[4*7+4]==-3.0f);
+        REQUIRE(fmat.data[5*7+4]!=-3.0f);
+        REQUIRE(fmat_norm(&view)==Catch::Approx(10.3923048454));
+    }
+
+    SECTION("Multiplying matches double precision.")
+    {
+        Matrix prod = mat_mul(&mymat, true, &mymat, false);
+        FMatrix fprod = fmat_mul(&fmat, true, &fmat, false);
+
+        REQUIRE(fprod.nrows==7);
+        REQUIRE(fprod.ncols==7);
+        for (size_t i=0; i<prod.nrows*prod.ncols; i++)
+            REQUIRE(fprod.data[i]==Catch::Approx(prod.data[i]).epsilon(1e-5));
+
+        mat_destroy(&prod);
+        fmat_destroy(&fprod);
+    }
+
+    SECTION("Adding and subtracting.")
+    {
+        FMatrix copy = fmat_copy(&fmat);
+
+        fmat_add(&copy, &fmat);
+        fmat_sub(&copy, &fmat);
+        for (size_t i=0; i<fmat.nrows*fmat.ncols; i++)
+            REQUIRE(copy.data[i]==Catch::Approx(fmat.data[i]));
+        fmat_destroy(&copy);
+    }
+
+    SECTION("Gathering rows.")
+    {
+        IntMatrix idxs = intmat_create(4, 1);
+        FMatrix fbatch = fmat_create(4, 7);
+        Matrix batch = mat_create(4, 7);
+        int rows[4] = {11, 0, 5, 5};
+
+        for (size_t i=0; i<4; i++)
+            idxs.data[i] = rows[i];
+        fmat_gather_rows(&fmat, &fbatch, &idxs, 1);
+        mat_gather_rows_from_fmat(&fmat, &batch, &idxs);
+        for (size_t i=0; i<4; i++)
+            for (size_t j=0; j<7; j++)
+            {
+                REQUIRE(fbatch.data[i*7+j]==fmat.data[rows[i]*7+j]);
+                REQUIRE(batch.data[i*7+j]==(double)fmat.data[rows[i]*7+j]);
+            }
+
+        intmat_destroy(&idxs);
+        fmat_destroy(&fbatch);
+        mat_destroy(&batch);
+    }
+
+    mat_destroy(&mymat);
+    fmat_destroy(&fmat);
+}
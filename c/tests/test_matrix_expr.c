@@ -0,0 +1,154 @@
+// Tests for module matrix_expr.hpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <catch2/catch_all.hpp>
+#include "../src/matrix.h"
+#include "../src/matrix_expr.hpp"
+
+using mx::Mat;
+using mx::MatRef;
+using mx::t;
+
+TEST_CASE("Matrix expressions.", "[matrix_expr]")
+{
+    Matrix a = mat_create(6, 4);
+    Matrix b = mat_create(6, 4);
+    Matrix v = mat_create(4, 1);
+    Matrix w = mat_create(6, 1);
+
+    mat_fill_random(&a, 1);
+    mat_fill_random(&b, 2);
+    mat_fill_random(&v, 3);
+    mat_fill_random(&w, 4);
+
+    SECTION("Elementwise chains on views.")
+    {
+        Matrix big = mat_create(8, 7);
+        Matrix view = mat_view(&big, 1, 2, 6, 4);
+        MatRef dest(view), ra(a), rb(b);
+
+        mat_fill(&big, -1.0);
+        dest = 2.0 * ra - rb * 0.5 + 1.0;
+        for (size_t i=0; i<6; i++)
+            for (size_t j=0; j<4; j++)
+                REQUIRE(view.data[i*view.stride+j]==\
+                        2.0*a.data[i*4+j] - 0.5*b.data[i*4+j] + 1.0);
+        // Outside the view is untouched
+        REQUIRE(big.data[0]==-1.0);
+        REQUIRE(big.data[7*7+6]==-1.0);
+
+        dest -= mx::hadamard(ra, rb);
+        dest *= 3.0;
+        for (size_t i=0; i<6; i++)
+            for (size_t j=0; j<4; j++)
+                REQUIRE(view.data[i*view.stride+j]==Catch::Approx(
+                        3.0*(2.0*a.data[i*4+j] - 0.5*b.data[i*4+j] + 1.0
+                             - a.data[i*4+j]*b.data[i*4+j])));
+
+        mat_destroy(&big);
+    }
+
+    SECTION("Reductions.")
+    {
+        MatRef ra(a), rb(b);
+        double total = 0.0, total_sq = 0.0, total_abs = 0.0, total_dot = 0.0;
+
+        for (size_t i=0; i<6*4; i++)
+        {
+            double diff = a.data[i] - b.data[i];
+            total += diff;
+            total_sq += diff*diff;
+            total_abs += fabs(diff);
+            total_dot += a.data[i]*b.data[i];
+        }
+        REQUIRE(mx::sum(ra - rb)==total);
+        REQUIRE(mx::sum_sq(ra - rb)==total_sq);
+        REQUIRE(mx::sum_abs(ra - rb)==total_abs);
+        REQUIRE(mx::dot(ra, rb)==Catch::Approx(total_dot));
+        REQUIRE(mx::sum(mx::square(ra - rb))==total_sq);
+    }
+
+    SECTION("Products.")
+    {
+        MatRef ra(a), rb(b), rv(v), rw(w);
+        Matrix expect = mat_mul(&a, false, &v, false);
+        Matrix expect_t = mat_mul(&a, true, &w, false);
+        Matrix expect_mat = mat_mul(&a, true, &b, false);
+
+        // Matrix-vector products with the elementwise side fused first
+        Mat av(ra * rv - rw);
+        for (size_t i=0; i<6; i++)
+            REQUIRE(av(i, 0)==Catch::Approx(expect.data[i] - w.data[i]));
+        av = rw + 2.0 * (ra * rv);
+        for (size_t i=0; i<6; i++)
+            REQUIRE(av(i, 0)==Catch::Approx(w.data[i] + 2.0*expect.data[i]));
+        av -= ra * rv;
+        for (size_t i=0; i<6; i++)
+            REQUIRE(av(i, 0)==Catch::Approx(w.data[i] + expect.data[i]));
+
+        // Transposed matrix and a row vector used as a column
+        Mat atw(t(ra) * rw);
+        Matrix w_row = mat_create(1, 6);
+        for (size_t i=0; i<6; i++)
+            w_row.data[i] = w.data[i];
+        Mat atw_row(t(ra) * t(MatRef(w_row)));
+        for (size_t j=0; j<4; j++)
+        {
+            REQUIRE(atw(j, 0)==Catch::Approx(expect_t.data[j]));
+            REQUIRE(atw_row(j, 0)==Catch::Approx(expect_t.data[j]));
+        }
+
+        // Matrix-matrix product into a view of a larger matrix
+        Matrix big = mat_create(5, 9);
+        Matrix view = mat_view(&big, 1, 3, 4, 4);
+        MatRef dest(view);
+        dest = t(ra) * rb;
+        for (size_t i=0; i<4; i++)
+            for (size_t j=0; j<4; j++)
+                REQUIRE(dest(i, j)==Catch::Approx(expect_mat.data[i*4+j]));
+
+        mat_destroy(&expect);
+        mat_destroy(&expect_t);
+        mat_destroy(&expect_mat);
+        mat_destroy(&w_row);
+        mat_destroy(&big);
+    }
+
+    SECTION("Dimension mismatch leaves the destination unchanged.")
+    {
+        MatRef ra(a), rv(v), rw(w);
+        Mat dest(6, 1);
+
+        dest = 5.0;
+        dest = rw + rv;
+        REQUIRE(dest(0, 0)==5.0);
+        dest = ra * rw;
+        REQUIRE(dest(0, 0)==5.0);
+        REQUIRE(mx::sum(ra - rw)==0.0);
+    }
+
+    SECTION("Owning matrices use the bound arena and can be released.")
+    {
+        MatArena arena = mat_arena_create(1024);
+        Matrix released;
+
+        mat_arena_bind(&arena);
+        {
+            Mat temp(MatRef(a) + MatRef(b));
+            REQUIRE(arena.used>0);
+            released = temp.release();
+        }
+        mat_arena_bind(NULL);
+        REQUIRE(released.data[5]==a.data[5] + b.data[5]);
+
+        mat_destroy(&released);
+        mat_arena_destroy(&arena);
+    }
+
+    mat_destroy(&a);
+    mat_destroy(&b);
+    mat_destroy(&v);
+    mat_destroy(&w);
+}
@@ -0,0 +1,164 @@
+// Tests for module random.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <catch2/catch_all.hpp>
+#include "../src/matrix.h"
+#include "../src/stats.h"
+#include "../src/random.h"
+
+TEST_CASE("Counter-based random numbers.", "[random]")
+{
+    RandomStream rng, other;
+
+    SECTION("Philox4x32-10 known answers.")
+    {
+        // Test vectors of the Random123 reference implementation
+        uint32_t zero_counter[4] = {0, 0, 0, 0};
+        uint32_t zero_key[2] = {0, 0};
+        uint32_t ones_counter[4] = {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff};
+        uint32_t ones_key[2] = {0xffffffff, 0xffffffff};
+        uint32_t pi_counter[4] = {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344};
+        uint32_t pi_key[2] = {0xa4093822, 0x299f31d0};
+        uint32_t out[4];
+
+        philox4x32_10(zero_counter, zero_key, out);
+        REQUIRE(out[0]==0x6627e8d5);
+        REQUIRE(out[1]==0xe169c58d);
+        REQUIRE(out[2]==0xbc57ac4c);
+        REQUIRE(out[3]==0x9b00dbd8);
+        philox4x32_10(ones_counter, ones_key, out);
+        REQUIRE(out[0]==0x408f276d);
+        REQUIRE(out[1]==0x41c83b0e);
+        REQUIRE(out[2]==0xa20bc7c6);
+        REQUIRE(out[3]==0x6d5451fd);
+        philox4x32_10(pi_counter, pi_key, out);
+        REQUIRE(out[0]==0xd16cfe09);
+        REQUIRE(out[1]==0x94fdcceb);
+        REQUIRE(out[2]==0x5001e420);
+        REQUIRE(out[3]==0x24126ea1);
+    }
+
+    SECTION("Seeking matches sequential generation.")
+    {
+        uint32_t words[103];
+
+        random_init(&rng, 2718, 5);
+        for (int i=0; i<103; i++)
+            words[i] = random_u32(&rng);
+        for (uint64_t start=0; start<103; start+=7)
+        {
+            random_init(&other, 2718, 5);
+            random_seek(&other, start);
+            for (uint64_t i=start; i<103; i++)
+                REQUIRE(random_u32(&other)==words[i]);
+        }
+
+        // Other seeds and streams differ
+        random_init(&other, 2719, 5);
+        REQUIRE(random_u32(&other)!=words[0]);
+        random_init(&other, 2718, 6);
+        REQUIRE(random_u32(&other)!=words[0]);
+    }
+
+    SECTION("Ranges.")
+    {
+        uint64_t large = (uint64_t)1 << 40;
+        bool above_int = false;
+        double sum = 0.0;
+
+        random_init(&rng, 42, 0);
+        for (int i=0; i<100000; i++)
+        {
+            double u = random_uniform(&rng);
+            float f = random_uniform_float(&rng);
+            uint64_t r = random_below(&rng, large);
+
+            REQUIRE(u>=0.0);
+            REQUIRE(u<1.0);
+            REQUIRE(f>=0.0f);
+            REQUIRE(f<1.0f);
+            REQUIRE(r<large);
+            REQUIRE(random_below(&rng, 7)<7);
+            above_int = above_int || r>((uint64_t)1 << 31);
+            sum += u;
+        }
+        REQUIRE(above_int);
+        REQUIRE(sum/100000==Catch::Approx(0.5).margin(0.01));
+    }
+
+    SECTION("Normal numbers.")
+    {
+        size_t n = 200001;
+        double* z = (double *)malloc(n*sizeof(double));
+        double* head = (double *)malloc(5*sizeof(double));
+        double mean = 0.0, var = 0.0;
+        Matrix mat = mat_create(50000, 2);
+        Matrix means = mat_create(2, 1);
+        Matrix stds = mat_create(2, 1);
+        Matrix col_means;
+
+        random_init(&rng, 11, 0);
+        random_normal_fill(&rng, z, n);
+        for (size_t i=0; i<n; i++)
+            mean += z[i] / (double)n;
+        for (size_t i=0; i<n; i++)
+            var += (z[i]-mean)*(z[i]-mean) / (double)n;
+        REQUIRE(mean==Catch::Approx(0.0).margin(0.01));
+        REQUIRE(var==Catch::Approx(1.0).margin(0.01));
+
+        // A shorter fill is a prefix of a longer one
+        random_init(&rng, 11, 0);
+        random_normal_fill(&rng, head, 5);
+        for (size_t i=0; i<4; i++)
+            REQUIRE(head[i]==z[i]);
+
+        // Samples, not densities, with the requested moments
+        means.data[0] = 3.0;
+        means.data[1] = -7.0;
+        stds.data[0] = 2.0;
+        stds.data[1] = 0.5;
+        mat_fill_random_gaussian(&mat, &means, &stds, 11);
+        col_means = stats_mean(&mat, 0);
+        REQUIRE(col_means.data[0]==Catch::Approx(3.0).margin(0.05));
+        REQUIRE(col_means.data[1]==Catch::Approx(-7.0).margin(0.05));
+
+        free(z);
+        free(head);
+        mat_destroy(&mat);
+        mat_destroy(&means);
+        mat_destroy(&stds);
+        mat_destroy(&col_means);
+    }
+
+    SECTION("Matrix fills are independent of the number of threads.")
+    {
+        // Large enough to be filled by several threads
+        Matrix mat = mat_create(4096, 300);
+        FMatrix fmat = fmat_create(4096, 300);
+        Matrix view = mat_view(&mat, 10, 20, 5, 7);
+
+        mat_fill_random(&mat, 99);
+        fmat_fill_random(&fmat, 99);
+        random_init(&rng, 99, 0);
+        random_init(&other, 99, 0);
+        for (size_t i=0; i<mat.nrows*mat.ncols; i++)
+        {
+            REQUIRE(mat.data[i]==random_uniform(&rng));
+            REQUIRE(fmat.data[i]==random_uniform_float(&other));
+        }
+
+        // Views are filled in row-major order of their own elements,
+        // the rest of the matrix is left alone
+        double left = mat.data[10*300+19];
+        mat_fill_random(&view, 7);
+        random_init(&rng, 7, 0);
+        for (size_t i=0; i<view.nrows; i++)
+            for (size_t j=0; j<view.ncols; j++)
+                REQUIRE(view.data[i*view.stride+j]==random_uniform(&rng));
+        REQUIRE(mat.data[10*300+19]==left);
+
+        mat_destroy(&mat);
+        fmat_destroy(&fmat);
+    }
+}
@@ -0,0 +1,123 @@
+// Tests for module sampler.h
+
+#include <stdbool.h>
+#include <limits.h>
+#include <catch2/catch_all.hpp>
+#include "../src/matrix.h"
+#include "../src/sampler.h"
+
+// Draw one full epoch and check that every row appears exactly once
+static bool covers_epoch(BatchSampler* sampler, IntMatrix* idxs)
+{
+    unsigned int n_batches = sampler->n_samples / sampler->batch_size;
+    IntMatrix counts = intmat_create(sampler->n_samples, 1);
+    bool ok = true;
+
+    for (size_t b=0; b<n_batches; b++)
+    {
+        sampler_next(sampler, idxs);
+        for (size_t i=0; i<idxs->nrows; i++)
+            counts.data[idxs->data[i]]++;
+    }
+    for (size_t i=0; i<counts.nrows; i++)
+        ok = ok && counts.data[i]==1;
+
+    intmat_destroy(&counts);
+    return ok;
+}
+
+TEST_CASE("Minibatch samplers.", "[sampler]")
+{
+    unsigned int seed = 1234;
+    unsigned int n_samples = 120, batch_size = 8;
+    BatchSampler sampler;
+    IntMatrix idxs = intmat_create(batch_size, 1);
+
+    SECTION("Shuffle policy visits every row once per epoch.")
+    {
+        sampler_init(&sampler, n_samples, batch_size, SAMPLE_SHUFFLE, seed);
+        REQUIRE(covers_epoch(&sampler, &idxs));
+        REQUIRE(covers_epoch(&sampler, &idxs));
+        REQUIRE(sampler.epoch==1);
+        sampler_destroy(&sampler);
+    }
+
+    SECTION("Affine policy visits every row once per epoch.")
+    {
+        sampler_init(&sampler, n_samples, batch_size, SAMPLE_AFFINE, seed);
+        REQUIRE(covers_epoch(&sampler, &idxs));
+        REQUIRE(covers_epoch(&sampler, &idxs));
+        sampler_destroy(&sampler);
+    }
+
+    SECTION("Sequential policy hands out consecutive rows.")
+    {
+        sampler_init(&sampler, n_samples, batch_size, SAMPLE_SEQUENTIAL, seed);
+        sampler_next(&sampler, &idxs);
+        sampler_next(&sampler, &idxs);
+        for (size_t i=0; i<batch_size; i++)
+            REQUIRE(idxs.data[i]==(int)(batch_size+i));
+        sampler_destroy(&sampler);
+    }
+
+    SECTION("Sampling with replacement stays in range.")
+    {
+        sampler_init(&sampler, n_samples, batch_size, SAMPLE_REPLACEMENT, seed);
+        for (size_t b=0; b<100; b++)
+        {
+            sampler_next(&sampler, &idxs);
+            for (size_t i=0; i<batch_size; i++)
+                REQUIRE((idxs.data[i]>=0 && idxs.data[i]<(int)n_samples));
+        }
+        sampler_destroy(&sampler);
+    }
+
+    SECTION("Row indices must fit in an int.")
+    {
+        sampler_init(&sampler, (size_t)INT_MAX + 1, batch_size,
+                     SAMPLE_SEQUENTIAL, seed);
+        REQUIRE(sampler.n_samples==0);
+        sampler_destroy(&sampler);
+    }
+
+    SECTION("Consecutive epochs are reshuffled.")
+    {
+        unsigned int n_batches = n_samples / batch_size;
+        IntMatrix first = intmat_create(batch_size, 1);
+        bool differs = false;
+
+        sampler_init(&sampler, n_samples, batch_size, SAMPLE_SHUFFLE, seed);
+        sampler_next(&sampler, &first);
+        for (size_t b=1; b<n_batches; b++)
+            sampler_next(&sampler, &idxs);
+        sampler_next(&sampler, &idxs);
+        for (size_t i=0; i<batch_size; i++)
+            differs = differs || idxs.data[i]!=first.data[i];
+        REQUIRE(differs);
+
+        intmat_destroy(&first);
+        sampler_destroy(&sampler);
+    }
+
+    SECTION("Same seed gives the same batches.")
+    {
+        BatchSampler other;
+        IntMatrix other_idxs = intmat_create(batch_size, 1);
+
+        sampler_init(&sampler, n_samples, batch_size, SAMPLE_SHUFFLE, seed);
+        sampler_init(&other, n_samples, batch_size, SAMPLE_SHUFFLE, seed);
+        for (size_t b=0; b<40; b++)
+        {
+            sampler_next(&sampler, &idxs);
+            sampler_next(&other, &other_idxs);
+            for (size_t i=0; i<batch_size; i++)
+                REQUIRE(idxs.data[i]==other_idxs.data[i]);
+        }
+
+        intmat_destroy(&other_idxs);
+        sampler_destroy(&other);
+        sampler_destroy(&sampler);
+    }
+
+    intmat_destroy(&idxs);
+}
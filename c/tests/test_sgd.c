@@ -0,0 +1,346 @@
+// Tests for module sgd.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <catch2/catch_all.hpp>
+#include "../src/matrix.h"
+#include "../src/losses.h"
+#include "../src/stats.h"
+#include "../src/sparse.h"
+#include "../src/sgd.h"
+
+TEST_CASE("Parallel stochastic gradient descent.", "[sgd]")
+{
+    unsigned int seed = 31337;
+    Matrix x = mat_create(4000, 3);
+    Matrix y = mat_create(4000, 1);
+    Matrix theta = mat_create(3, 1);
+    LossFunctions l2 = l2_loss_functions();
+    SGDResult result;
+
+    // Noise-free linear data, y = x theta - 1
+    mat_fill_random(&x, seed);
+    theta.data[0] = 0.75;
+    theta.data[1] = 3.0;
+    theta.data[2] = -1.25;
+    mat_mul_inplace(&x, false, &theta, false, &y);
+    mat_add_scalar(&y, -1.0);
+
+    SECTION("Hogwild.")
+    {
+        unsigned int n_threads[] = {1, 3, 8};
+
+        for (int t=0; t<3; t++)
+        {
+            result = parallel_sgd_hogwild(&x, &y, 16, SAMPLE_SHUFFLE, 0.05,
+                                          &l2, 20000, 0.0, seed, n_threads[t]);
+            REQUIRE(!result.converged);
+            for (size_t j=0; j<3; j++)
+                REQUIRE(result.theta_sol.data[j]==Catch::Approx(theta.data[j]).margin(1e-3));
+            REQUIRE(result.bias==Catch::Approx(-1.0).margin(1e-3));
+            // The loss history is recorded by thread 0
+            if (n_threads[t]==1)
+                for (size_t k=0; k<20000/100; k++)
+                    REQUIRE(result.losses[k]>0.0);
+            destroy_sgdresult(&result);
+        }
+
+        // More threads than batches fit in the rows
+        result = parallel_sgd_hogwild(&x, &y, 1000, SAMPLE_SEQUENTIAL, 0.05,
+                                      &l2, 4000, 0.0, seed, 64);
+        REQUIRE(result.bias==Catch::Approx(-1.0).margin(1e-2));
+        destroy_sgdresult(&result);
+
+        // Stops as soon as one thread sees the tolerance reached
+        result = parallel_sgd_hogwild(&x, &y, 16, SAMPLE_SHUFFLE, 0.05,
+                                      &l2, 20000, 1e-6, seed, 4);
+        REQUIRE(result.converged);
+        destroy_sgdresult(&result);
+    }
+
+    SECTION("Synchronous data-parallel.")
+    {
+        SGDResult serial, repeat;
+
+        result = parallel_sgd_sync(&x, &y, 64, SAMPLE_SHUFFLE, 0.05,
+                                   5000, 0.0, seed, 4);
+        for (size_t j=0; j<3; j++)
+            REQUIRE(result.theta_sol.data[j]==Catch::Approx(theta.data[j]).margin(1e-3));
+        REQUIRE(result.bias==Catch::Approx(-1.0).margin(1e-3));
+
+        // The reduction order is fixed, so runs are reproducible
+        repeat = parallel_sgd_sync(&x, &y, 64, SAMPLE_SHUFFLE, 0.05,
+                                   5000, 0.0, seed, 4);
+        for (size_t j=0; j<3; j++)
+            REQUIRE(repeat.theta_sol.data[j]==result.theta_sol.data[j]);
+        destroy_sgdresult(&repeat);
+
+        // Any number of threads follows the serial trajectory
+        serial = stochastic_gradient_descent(&x, &y, 64, SAMPLE_SHUFFLE, 0.05,
+                                             &l2, 500, 0.0, seed);
+        for (unsigned int t=1; t<=7; t+=3)
+        {
+            repeat = parallel_sgd_sync(&x, &y, 64, SAMPLE_SHUFFLE, 0.05,
+                                       500, 0.0, seed, t);
+            for (size_t j=0; j<3; j++)
+                REQUIRE(repeat.theta_sol.data[j]==Catch::Approx(serial.theta_sol.data[j]).epsilon(1e-12));
+            REQUIRE(repeat.bias==Catch::Approx(serial.bias).epsilon(1e-12));
+            destroy_sgdresult(&repeat);
+        }
+        destroy_sgdresult(&serial);
+        destroy_sgdresult(&result);
+
+        // Batches smaller than the number of threads, idle workers
+        // contribute nothing to the reduction
+        serial = stochastic_gradient_descent(&x, &y, 2, SAMPLE_SEQUENTIAL, 0.05,
+                                             &l2, 100, 1e-30, seed);
+        result = parallel_sgd_sync(&x, &y, 2, SAMPLE_SEQUENTIAL, 0.05,
+                                   100, 1e-30, seed, 8);
+        REQUIRE(!result.converged);
+        for (size_t j=0; j<3; j++)
+            REQUIRE(result.theta_sol.data[j]==Catch::Approx(serial.theta_sol.data[j]).epsilon(1e-12));
+        REQUIRE(result.bias==Catch::Approx(serial.bias).epsilon(1e-12));
+        destroy_sgdresult(&serial);
+        destroy_sgdresult(&result);
+    }
+
+    mat_destroy(&x);
+    mat_destroy(&y);
+    mat_destroy(&theta);
+}
+
+TEST_CASE("Serial stochastic gradient descent.", "[sgd]")
+{
+    unsigned int seed = 31337;
+    Matrix x = mat_create(4000, 3);
+    Matrix y = mat_create(4000, 1);
+    Matrix theta = mat_create(3, 1);
+    LossFunctions l2 = l2_loss_functions();
+    SGDResult result;
+
+    // Same noise-free data as the parallel solvers, y = x theta - 1
+    mat_fill_random(&x, seed);
+    theta.data[0] = 0.75;
+    theta.data[1] = 3.0;
+    theta.data[2] = -1.25;
+    mat_mul_inplace(&x, false, &theta, false, &y);
+    mat_add_scalar(&y, -1.0);
+
+    SECTION("Mixed precision.")
+    {
+        FMatrix x_f = fmat_from_mat(&x);
+        SGDResult mixed;
+
+        // Only the rounding of X to single precision differs
+        result = stochastic_gradient_descent(&x, &y, 32, SAMPLE_SHUFFLE, 0.05,
+                                             &l2, 2000, 0.0, seed);
+        mixed = stochastic_gradient_descent_mixed(&x_f, &y, 32, SAMPLE_SHUFFLE,
+                                                  0.05, &l2, 2000, 0.0, seed);
+        for (size_t j=0; j<3; j++)
+            REQUIRE(mixed.theta_sol.data[j]==Catch::Approx(result.theta_sol.data[j]).epsilon(1e-5));
+        REQUIRE(mixed.bias==Catch::Approx(result.bias).epsilon(1e-5));
+
+        fmat_destroy(&x_f);
+        destroy_sgdresult(&mixed);
+        destroy_sgdresult(&result);
+    }
+
+    mat_destroy(&x);
+    mat_destroy(&y);
+    mat_destroy(&theta);
+}
+
+TEST_CASE("Full-batch solvers.", "[sgd]")
+{
+    unsigned int seed = 31337;
+    Matrix x = mat_create(4000, 3);
+    Matrix y = mat_create(4000, 1);
+    Matrix theta = mat_create(3, 1);
+    LossFunctions l2 = l2_loss_functions();
+    SGDResult result;
+
+    // Same noise-free data as the parallel solvers, y = x theta - 1
+    mat_fill_random(&x, seed);
+    theta.data[0] = 0.75;
+    theta.data[1] = 3.0;
+    theta.data[2] = -1.25;
+    mat_mul_inplace(&x, false, &theta, false, &y);
+    mat_add_scalar(&y, -1.0);
+
+    SECTION("Gram gradient descent.")
+    {
+        SGDResult gram;
+
+        // The Gram form takes the same steps as the residual form
+        result = gradient_descent(&x, &y, 0.05, &l2, 300, 0.0, seed);
+        gram = gradient_descent_gram(&x, &y, 0.05, 300, 0.0, seed);
+        for (size_t j=0; j<3; j++)
+            REQUIRE(gram.theta_sol.data[j]==Catch::Approx(result.theta_sol.data[j]).epsilon(1e-9));
+        REQUIRE(gram.bias==Catch::Approx(result.bias).epsilon(1e-9));
+
+        // One loss every 100 iterations, decreasing
+        for (size_t k=0; k<3; k++)
+        {
+            REQUIRE(result.losses[k]>0.0);
+            REQUIRE(gram.losses[k]==Catch::Approx(result.losses[k]).epsilon(1e-9));
+            if (k>0)
+                REQUIRE(result.losses[k]<result.losses[k-1]);
+        }
+        destroy_sgdresult(&gram);
+        destroy_sgdresult(&result);
+    }
+
+    SECTION("Normal equations with a ridge term.")
+    {
+        double ridge = 500.0, norm_ols = 0.0, norm_ridge = 0.0;
+        Matrix xc = mat_create(4000, 3);
+        Matrix yc = mat_create(4000, 1);
+        Matrix x_mean = stats_mean(&x, 0);
+        Matrix y_mean = stats_mean(&y, 0);
+        Matrix gram, xty, lhs;
+        SGDResult ols;
+
+        ols = normal_equation_solve(&x, &y, 0.0);
+        result = normal_equation_solve(&x, &y, ridge);
+        REQUIRE(result.converged);
+
+        // The ridge term shrinks the coefficients
+        for (size_t j=0; j<3; j++)
+        {
+            REQUIRE(ols.theta_sol.data[j]==Catch::Approx(theta.data[j]).margin(1e-8));
+            norm_ols += ols.theta_sol.data[j]*ols.theta_sol.data[j];
+            norm_ridge += result.theta_sol.data[j]*result.theta_sol.data[j];
+        }
+        REQUIRE(norm_ridge<norm_ols);
+
+        // theta solves (Xc^T Xc + ridge I) theta = Xc^T yc on the
+        // explicitly centered data
+        for (size_t i=0; i<4000; i++)
+        {
+            for (size_t j=0; j<3; j++)
+                xc.data[i*3+j] = x.data[i*3+j] - x_mean.data[j];
+            yc.data[i] = y.data[i] - y_mean.data[0];
+        }
+        gram = mat_mul(&xc, true, &xc, false);
+        xty = mat_mul(&xc, true, &yc, false);
+        for (size_t j=0; j<3; j++)
+            gram.data[j*3+j] += ridge;
+        lhs = mat_mul(&gram, false, &(result.theta_sol), false);
+        for (size_t j=0; j<3; j++)
+            REQUIRE(lhs.data[j]==Catch::Approx(xty.data[j]).epsilon(1e-10));
+        REQUIRE(result.bias==Catch::Approx(y_mean.data[0]
+                - x_mean.data[0]*result.theta_sol.data[0]
+                - x_mean.data[1]*result.theta_sol.data[1]
+                - x_mean.data[2]*result.theta_sol.data[2]).epsilon(1e-12));
+
+        mat_destroy(&xc);
+        mat_destroy(&yc);
+        mat_destroy(&x_mean);
+        mat_destroy(&y_mean);
+        mat_destroy(&gram);
+        mat_destroy(&xty);
+        mat_destroy(&lhs);
+        destroy_sgdresult(&ols);
+        destroy_sgdresult(&result);
+
+        // A duplicated column makes X^T X singular without a ridge term
+        Matrix x_dup = mat_create(4000, 3);
+        for (size_t i=0; i<4000; i++)
+        {
+            x_dup.data[i*3] = x.data[i*3];
+            x_dup.data[i*3+1] = x.data[i*3+1];
+            x_dup.data[i*3+2] = x.data[i*3];
+        }
+        result = normal_equation_solve(&x_dup, &y, 0.0);
+        REQUIRE(!result.converged);
+        for (size_t j=0; j<3; j++)
+            REQUIRE(result.theta_sol.data[j]==0.0);
+        REQUIRE(result.bias==0.0);
+        destroy_sgdresult(&result);
+
+        // and the ridge term makes it solvable again
+        result = normal_equation_solve(&x_dup, &y, ridge);
+        REQUIRE(result.converged);
+        REQUIRE(result.theta_sol.data[0]==Catch::Approx(result.theta_sol.data[2]));
+        destroy_sgdresult(&result);
+        mat_destroy(&x_dup);
+    }
+
+    mat_destroy(&x);
+    mat_destroy(&y);
+    mat_destroy(&theta);
+}
+
+TEST_CASE("Solver phase profile.", "[sgd]")
+{
+    Matrix x = mat_create(1000, 4);
+    Matrix y = mat_create(1000, 1);
+    LossFunctions l2 = l2_loss_functions();
+    SGDResult result;
+
+    mat_fill_random(&x, 5);
+    mat_fill_random(&y, 6);
+    result = stochastic_gradient_descent(&x, &y, 32, SAMPLE_SHUFFLE, 0.01,
+                                         &l2, 500, 0.0, 7);
+#ifdef SGD_PROFILE
+    // Every phase but forward (fused into the loss) runs once per iteration
+    double phases = 0.0;
+
+    REQUIRE(result.profile.enabled);
+    REQUIRE(result.profile.calls[PROFILE_FORWARD]==0);
+    for (int p=0; p<PROFILE_N_PHASES; p++)
+    {
+        if (p!=PROFILE_FORWARD)
+            REQUIRE(result.profile.calls[p]==500);
+        REQUIRE(result.profile.seconds[p]>=0.0);
+        phases += result.profile.seconds[p];
+    }
+    REQUIRE(phases<=result.profile.total_seconds*1.01);
+    destroy_sgdresult(&result);
+
+    // Without the fused callback the predictions are a phase of their own
+    l2.loss_grad_fn = NULL;
+    result = stochastic_gradient_descent(&x, &y, 32, SAMPLE_SHUFFLE, 0.01,
+                                         &l2, 500, 0.0, 7);
+    REQUIRE(result.profile.calls[PROFILE_FORWARD]==500);
+    REQUIRE(result.profile.calls[PROFILE_LOSS]==500);
+    destroy_sgdresult(&result);
+    l2 = l2_loss_functions();
+
+    // The other solvers are instrumented too, the parallel ones on
+    // the calling thread
+    result = gradient_descent_gram(&x, &y, 0.01, 500, 0.0, 7);
+    REQUIRE(result.profile.calls[PROFILE_LOSS]==500);
+    REQUIRE(result.profile.calls[PROFILE_BACKWARD]==500);
+    destroy_sgdresult(&result);
+
+    result = parallel_sgd_hogwild(&x, &y, 32, SAMPLE_SHUFFLE, 0.01,
+                                  &l2, 500, 0.0, 7, 1);
+    REQUIRE(result.profile.calls[PROFILE_SAMPLE]==500);
+    REQUIRE(result.profile.calls[PROFILE_BACKWARD]==500);
+    destroy_sgdresult(&result);
+
+    result = parallel_sgd_sync(&x, &y, 32, SAMPLE_SHUFFLE, 0.01,
+                               500, 0.0, 7, 2);
+    for (int p=0; p<PROFILE_N_PHASES; p++)
+        if (p!=PROFILE_FORWARD)
+            REQUIRE(result.profile.calls[p]==500);
+
+    CSRMatrix x_sparse = csr_from_dense(&x);
+    destroy_sgdresult(&result);
+    result = stochastic_gradient_descent_sparse(&x_sparse, &y, 32, SAMPLE_SHUFFLE,
+                                                0.01, 500, 0.0, 7);
+    for (int p=0; p<PROFILE_N_PHASES; p++)
+        REQUIRE(result.profile.calls[p]==500);
+    csr_destroy(&x_sparse);
+#else
+    REQUIRE(!result.profile.enabled);
+    REQUIRE(result.profile.total_seconds==0.0);
+#endif
+    REQUIRE(sgd_profile_phase_name(PROFILE_GATHER)==std::string("gather"));
+
+    destroy_sgdresult(&result);
+    mat_destroy(&x);
+    mat_destroy(&y);
+}
@@ -0,0 +1,158 @@
+// Tests for module sparse.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <catch2/catch_all.hpp>
+#include "../src/matrix.h"
+#include "../src/stats.h"
+#include "../src/sparse.h"
+#include "../src/sgd.h"
+
+TEST_CASE("Sparse CSR matrices.", "[sparse]")
+{
+    // Every third element is nonzero
+    Matrix dense = mat_create(7, 5);
+    for (size_t i=0; i<7*5; i++)
+        dense.data[i] = i%3==0? (double)i - 10.0: 0.0;
+    CSRMatrix csr = csr_from_dense(&dense);
+
+    SECTION("Conversion.")
+    {
+        Matrix back = csr_to_dense(&csr);
+
+        REQUIRE(csr.nnz==12);
+        REQUIRE(csr.row_ptr[0]==0);
+        REQUIRE(csr.row_ptr[7]==csr.nnz);
+        for (size_t i=0; i<7*5; i++)
+            REQUIRE(back.data[i]==dense.data[i]);
+
+        // Column means count the implicit zeros
+        Matrix mean = csr_col_mean(&csr);
+        Matrix expected = stats_mean(&dense, 0);
+        for (size_t j=0; j<5; j++)
+            REQUIRE(mean.data[j]==Catch::Approx(expected.data[j]));
+
+        mat_destroy(&back);
+        mat_destroy(&mean);
+        mat_destroy(&expected);
+    }
+
+    SECTION("Products.")
+    {
+        Matrix x = mat_create(5, 1);
+        Matrix y = mat_create(7, 1);
+        Matrix y_dense, g_dense;
+        Matrix r = mat_create(7, 1);
+        Matrix g = mat_create(5, 1);
+
+        mat_fill_random(&x, 3);
+        mat_fill_random(&r, 4);
+
+        csr_matvec(&csr, &x, &y);
+        y_dense = mat_mul(&dense, false, &x, false);
+        for (size_t i=0; i<7; i++)
+            REQUIRE(y.data[i]==Catch::Approx(y_dense.data[i]));
+
+        // g = 1 + 0.5 A^T r
+        mat_fill(&g, 1.0);
+        csr_matvec_trans(&csr, 0.5, &r, &g);
+        g_dense = mat_mul(&dense, true, &r, false);
+        for (size_t j=0; j<5; j++)
+            REQUIRE(g.data[j]==Catch::Approx(1.0 + 0.5*g_dense.data[j]));
+
+        mat_destroy(&x);
+        mat_destroy(&y);
+        mat_destroy(&r);
+        mat_destroy(&g);
+        mat_destroy(&y_dense);
+        mat_destroy(&g_dense);
+    }
+
+    SECTION("Row gather.")
+    {
+        IntMatrix idxs = intmat_create(4, 1);
+        CSRMatrix rows = csr_create(4, 5, 0);
+        Matrix gathered;
+
+        idxs.data[0] = 6;
+        idxs.data[1] = 0;
+        idxs.data[2] = 3;
+        idxs.data[3] = 6;
+        REQUIRE(csr_gather_rows(&csr, &rows, &idxs));
+        gathered = csr_to_dense(&rows);
+        for (size_t i=0; i<4; i++)
+            for (size_t j=0; j<5; j++)
+                REQUIRE(gathered.data[i*5+j]==dense.data[idxs.data[i]*5+j]);
+
+        // Reuses its arrays when refilled with fewer nonzeros
+        size_t capacity = rows.capacity;
+        idxs.data[0] = 1;
+        REQUIRE(csr_gather_rows(&csr, &rows, &idxs));
+        REQUIRE(rows.capacity==capacity);
+        REQUIRE(rows.row_ptr[1]==csr.row_ptr[2]-csr.row_ptr[1]);
+
+        // Out of bounds indices fail and leave the destination alone
+        size_t nnz = rows.nnz;
+        idxs.data[2] = (int)csr.nrows;
+        REQUIRE(!csr_gather_rows(&csr, &rows, &idxs));
+        REQUIRE(rows.nnz==nnz);
+
+        intmat_destroy(&idxs);
+        csr_destroy(&rows);
+        mat_destroy(&gathered);
+    }
+
+    mat_destroy(&dense);
+    csr_destroy(&csr);
+}
+
+TEST_CASE("Sparse stochastic gradient descent.", "[sparse]")
+{
+    unsigned int seed = 2024;
+    size_t n_samples = 5000, n_features = 50;
+    Matrix dense = mat_create(n_samples, n_features);
+    Matrix y = mat_create(n_samples, 1);
+    Matrix theta = mat_create(n_features, 1);
+    CSRMatrix x;
+    SGDResult result;
+
+    // About 10% nonzeros, noise-free y = x theta + 4
+    mat_fill_random(&dense, seed);
+    for (size_t i=0; i<n_samples*n_features; i++)
+        dense.data[i] = dense.data[i]<0.1? 10.0*dense.data[i]: 0.0;
+    for (size_t j=0; j<n_features; j++)
+        theta.data[j] = (double)j/10.0 - 2.0;
+    mat_mul_inplace(&dense, false, &theta, false, &y);
+    mat_add_scalar(&y, 4.0);
+    x = csr_from_dense(&dense);
+
+    result = stochastic_gradient_descent_sparse(&x, &y, 32, SAMPLE_SHUFFLE,
+                                                0.05, 40000, 0.0, seed);
+    REQUIRE(!result.converged);
+    for (size_t j=0; j<n_features; j++)
+        REQUIRE(result.theta_sol.data[j]==Catch::Approx(theta.data[j]).margin(1e-3));
+    REQUIRE(result.bias==Catch::Approx(4.0).margin(1e-3));
+    destroy_sgdresult(&result);
+
+    // Nonzeros far from zero. The implicit centering decouples the
+    // bias from theta, so this converges as fast as the data above.
+    csr_destroy(&x);
+    for (size_t i=0; i<n_samples*n_features; i++)
+        if (dense.data[i]!=0.0)
+            dense.data[i] += 20.0;
+    mat_mul_inplace(&dense, false, &theta, false, &y);
+    mat_add_scalar(&y, 4.0);
+    x = csr_from_dense(&dense);
+
+    result = stochastic_gradient_descent_sparse(&x, &y, 32, SAMPLE_SHUFFLE,
+                                                0.002, 10000, 0.0, seed);
+    for (size_t j=0; j<n_features; j++)
+        REQUIRE(result.theta_sol.data[j]==Catch::Approx(theta.data[j]).margin(1e-6));
+    REQUIRE(result.bias==Catch::Approx(4.0).margin(1e-6));
+
+    destroy_sgdresult(&result);
+    mat_destroy(&dense);
+    mat_destroy(&y);
+    mat_destroy(&theta);
+    csr_destroy(&x);
+}
@@ -59,5 +59,18 @@ TEST_CASE("Statistical functions.", "[stats]")
         mat_destroy(&mean);
     }
 
+    SECTION("Finding the mean of a view.")
+    {
+        mat_fill(&mymat, 1.0);
+        Matrix view = mat_view(&mymat, 2, 4, 5, 6);
+        mat_fill(&view, 7.0);
+        Matrix row_mean = stats_mean(&view, 0);
+
+        for (size_t j=0; j<row_mean.ncols; j++)
+            REQUIRE(row_mean.data[j]==7.0);
+
+        mat_destroy(&row_mean);
+    }
+
     mat_destroy(&mymat);
 }
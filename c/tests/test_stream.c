@@ -0,0 +1,200 @@
+// Tests for module stream.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <catch2/catch_all.hpp>
+#include "../src/matrix.h"
+#include "../src/stats.h"
+#include "../src/dataset.h"
+#include "../src/csv.h"
+#include "../src/stream.h"
+#include "../src/sgd.h"
+
+// Check that every chunk of the stream holds the matching rows
+static void check_chunks(DataStream* stream, Matrix* x, Matrix* y, double eps)
+{
+    for (size_t k=0; k<stream->n_chunks; k++)
+    {
+        size_t rows = stream_chunk_size(stream, k);
+        Matrix x_chunk = mat_create(rows, stream->n_features);
+        Matrix y_chunk = mat_create(rows, 1);
+
+        REQUIRE(stream_read_chunk(stream, k, &x_chunk, &y_chunk));
+        for (size_t i=0; i<rows; i++)
+        {
+            size_t row = k*stream->chunk_rows + i;
+            for (size_t j=0; j<x->ncols; j++)
+                REQUIRE(x_chunk.data[i*x_chunk.ncols+j]==Catch::Approx(x->data[row*x->stride+j]).margin(eps));
+            REQUIRE(y_chunk.data[i]==Catch::Approx(y->data[row]).margin(eps));
+        }
+        mat_destroy(&x_chunk);
+        mat_destroy(&y_chunk);
+    }
+}
+
+TEST_CASE("Streaming data files in chunks.", "[stream]")
+{
+    unsigned int seed = 8128;
+    char path[] = "/tmp/test_stream_XXXXXX";
+    int fd = mkstemp(path);
+    Matrix x = mat_create(103, 4);
+    Matrix y = mat_create(103, 1);
+    Matrix x_mean, y_mean;
+    DataStream stream;
+
+    mat_fill_random(&x, seed);
+    mat_scale(&x, 10.0);
+    mat_fill_random(&y, seed+1);
+    x_mean = stats_mean(&x, 0);
+    y_mean = stats_mean(&y, 0);
+    REQUIRE(fd>=0);
+
+    SECTION("Dataset files.")
+    {
+        REQUIRE(dataset_save(path, &x, &y, DATASET_F64));
+        REQUIRE(stream_open(&stream, path, 10, NULL));
+        REQUIRE(stream.n_samples==103);
+        REQUIRE(stream.n_features==4);
+        REQUIRE(stream.n_chunks==11);
+        REQUIRE(stream_chunk_size(&stream, 10)==3);
+        REQUIRE(stream_chunk_size(&stream, 11)==0);
+        for (size_t j=0; j<4; j++)
+            REQUIRE(stream.feature_means.data[j]==Catch::Approx(x_mean.data[j]));
+        REQUIRE(stream.y_mean==Catch::Approx(y_mean.data[0]));
+        check_chunks(&stream, &x, &y, 0.0);
+        stream_close(&stream);
+
+        // Single precision files are widened per chunk
+        REQUIRE(dataset_save(path, &x, &y, DATASET_F32));
+        REQUIRE(stream_open(&stream, path, 16, NULL));
+        REQUIRE(stream.n_chunks==7);
+        check_chunks(&stream, &x, &y, 1e-5);
+        stream_close(&stream);
+    }
+
+    SECTION("CSV files.")
+    {
+        FILE* file = fopen(path, "w");
+        CSVOptions options = csv_default_options();
+
+        // Header and blank lines are not rows
+        fprintf(file, "a,b,c,d,y\n");
+        for (size_t i=0; i<x.nrows; i++)
+        {
+            for (size_t j=0; j<x.ncols; j++)
+                fprintf(file, "%.17g,", x.data[i*x.ncols+j]);
+            fprintf(file, "%.17g\n%s", y.data[i], i%7==0? "\n": "");
+        }
+        fclose(file);
+
+        REQUIRE(stream_open(&stream, path, 20, &options));
+        REQUIRE(stream.format==STREAM_CSV);
+        REQUIRE(stream.n_samples==103);
+        REQUIRE(stream.n_features==4);
+        REQUIRE(stream.n_chunks==6);
+        for (size_t j=0; j<4; j++)
+            REQUIRE(stream.feature_means.data[j]==Catch::Approx(x_mean.data[j]));
+        REQUIRE(stream.y_mean==Catch::Approx(y_mean.data[0]));
+        check_chunks(&stream, &x, &y, 0.0);
+        stream_close(&stream);
+    }
+
+    SECTION("Background reader visits every chunk once per epoch.")
+    {
+        ChunkReader reader;
+        Matrix x_chunk, y_chunk;
+
+        REQUIRE(dataset_save(path, &x, &y, DATASET_F64));
+        REQUIRE(stream_open(&stream, path, 10, NULL));
+
+        for (int policy=0; policy<2; policy++)
+        {
+            int seen[11] = {0};
+            REQUIRE(chunk_reader_start(&reader, &stream,
+                    policy==0? SAMPLE_SEQUENTIAL: SAMPLE_SHUFFLE, seed));
+            for (size_t n=0; n<3*stream.n_chunks; n++)
+            {
+                size_t chunk;
+                REQUIRE(chunk_reader_next(&reader, &x_chunk, &y_chunk));
+
+                // Chunks are identified by the first value of y
+                for (chunk=0; chunk<stream.n_chunks; chunk++)
+                    if (y.data[chunk*10]==y_chunk.data[0])
+                        break;
+                REQUIRE(chunk<stream.n_chunks);
+                REQUIRE(x_chunk.nrows==stream_chunk_size(&stream, chunk));
+                REQUIRE(x_chunk.data[0]==x.data[chunk*10*x.ncols]);
+                if (policy==0)
+                    REQUIRE(chunk==n%stream.n_chunks);
+                seen[chunk]++;
+                chunk_reader_release(&reader);
+
+                if ((n+1)%stream.n_chunks==0)
+                    for (size_t k=0; k<stream.n_chunks; k++)
+                        REQUIRE(seen[k]==(int)((n+1)/stream.n_chunks));
+            }
+            chunk_reader_stop(&reader);
+        }
+        stream_close(&stream);
+    }
+
+    SECTION("Invalid files.")
+    {
+        FILE* file = fopen(path, "w");
+        fprintf(file, "not a dataset");
+        fclose(file);
+        REQUIRE(!stream_open(&stream, path, 10, NULL));
+        REQUIRE(!stream_open(&stream, path, 0, NULL));
+    }
+
+    unlink(path);
+    close(fd);
+    mat_destroy(&x);
+    mat_destroy(&y);
+    mat_destroy(&x_mean);
+    mat_destroy(&y_mean);
+}
+
+TEST_CASE("Streaming stochastic gradient descent.", "[stream]")
+{
+    unsigned int seed = 1729;
+    char path[] = "/tmp/test_stream_sgd_XXXXXX";
+    int fd = mkstemp(path);
+    Matrix x = mat_create(2000, 3);
+    Matrix y = mat_create(2000, 1);
+    Matrix theta = mat_create(3, 1);
+    LossFunctions l2 = l2_loss_functions();
+    DataStream stream;
+    SGDResult result;
+
+    // Noise-free linear data, y = x theta + 2
+    REQUIRE(fd>=0);
+    mat_fill_random(&x, seed);
+    theta.data[0] = 1.5;
+    theta.data[1] = -2.0;
+    theta.data[2] = 0.5;
+    mat_mul_inplace(&x, false, &theta, false, &y);
+    mat_add_scalar(&y, 2.0);
+    REQUIRE(dataset_save(path, &x, &y, DATASET_F64));
+    REQUIRE(stream_open(&stream, path, 300, NULL));
+
+    result = stochastic_gradient_descent_stream(&stream, 16, SAMPLE_SHUFFLE,
+                                                0.05, &l2, 20000, 0.0, seed);
+    for (size_t j=0; j<3; j++)
+        REQUIRE(result.theta_sol.data[j]==Catch::Approx(theta.data[j]).margin(1e-3));
+    REQUIRE(result.bias==Catch::Approx(2.0).margin(1e-3));
+#ifdef SGD_PROFILE
+    REQUIRE(result.profile.enabled);
+    REQUIRE(result.profile.calls[PROFILE_LOSS]==20000);
+#endif
+
+    destroy_sgdresult(&result);
+    stream_close(&stream);
+    unlink(path);
+    close(fd);
+    mat_destroy(&x);
+    mat_destroy(&y);
+    mat_destroy(&theta);
+}